@@ -0,0 +1,453 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <bco.h>
+#include <bco/executor/multithread_executor.h>
+
+//Scheduler benchmarks, every scenario runs on the SimpleExecutor and on the MultithreadExecutor
+//with several worker counts. Results go to stdout (or --json FILE) as JSON, a summary to stderr.
+//    bco_benchmark [--json FILE] [--scale FACTOR] [--threads 1,2,4]
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+//a scenario which doesn't finish is a scheduler bug, its routines still point into the stack of
+//the scenario so the only way out is to exit
+constexpr auto kScenarioTimeout = std::chrono::seconds { 60 };
+
+uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+class Countdown {
+public:
+    explicit Countdown(size_t count)
+        : count_(count)
+    {
+    }
+    void count_down()
+    {
+        if (count_.fetch_sub(1, std::memory_order::acq_rel) == 1) {
+            std::lock_guard lock { mtx_ };
+            done_ = true;
+            cv_.notify_all();
+        }
+    }
+    void wait()
+    {
+        std::unique_lock lock { mtx_ };
+        if (!cv_.wait_for(lock, kScenarioTimeout, [this]() { return done_; })) {
+            std::cerr << "scenario timed out" << std::endl;
+            std::_Exit(2);
+        }
+    }
+
+private:
+    std::atomic<size_t> count_;
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    bool done_ { false };
+};
+
+struct ExecutorConfig {
+    std::string name;
+    uint32_t threads;
+};
+
+struct Result {
+    std::string scenario;
+    ExecutorConfig executor;
+    uint64_t ops { 0 };
+    double seconds { 0 };
+    //one entry per measured operation, in nanoseconds
+    std::vector<uint64_t> latencies {};
+};
+
+std::shared_ptr<bco::Context> make_context(const ExecutorConfig& config)
+{
+    std::unique_ptr<bco::ExecutorInterface> executor;
+    if (config.name == "simple") {
+        executor = std::make_unique<bco::SimpleExecutor>();
+    } else {
+        executor = std::make_unique<bco::MultithreadExecutor>(config.threads);
+    }
+    auto ctx = std::make_shared<bco::Context>(std::move(executor));
+    ctx->start();
+    return ctx;
+}
+
+//spawn throughput: one routine spawns N routines that finish at once,
+//latency is from spawn() to the first line of the spawned routine
+bco::Routine spawned(uint64_t spawned_at, uint64_t* latency, Countdown* done)
+{
+    *latency = now_ns() - spawned_at;
+    done->count_down();
+    co_return;
+}
+
+bco::Routine spawner(bco::Context* ctx, std::vector<uint64_t>* latencies, Countdown* done, bool direct)
+{
+    for (auto& latency : *latencies) {
+        if (direct) {
+            ctx->spawn(&spawned, now_ns(), &latency, done);
+        } else {
+            ctx->spawn(std::bind(&spawned, now_ns(), &latency, done));
+        }
+    }
+    co_return;
+}
+
+//'direct' posts the coroutine handle instead of a std::function making the routine
+void bench_spawn(bco::Context& ctx, size_t n, bool direct, Result& result)
+{
+    result.latencies.resize(n);
+    Countdown done { n };
+    ctx.spawn(&spawner, &ctx, &result.latencies, &done, direct);
+    done.wait();
+    result.ops = n;
+}
+
+//yield storm: R routines yielding back to the executor Y times each,
+//latency is from the yield to the resumption
+bco::Routine yielder(uint64_t* latencies, size_t yields, Countdown* done)
+{
+    for (size_t i = 0; i < yields; i++) {
+        uint64_t start = now_ns();
+        co_await bco::switch_to(bco::get_current_executor());
+        latencies[i] = now_ns() - start;
+    }
+    done->count_down();
+}
+
+void bench_yield_storm(bco::Context& ctx, size_t routines, size_t yields, Result& result)
+{
+    result.latencies.resize(routines * yields);
+    Countdown done { routines };
+    for (size_t i = 0; i < routines; i++) {
+        ctx.spawn(std::bind(&yielder, result.latencies.data() + i * yields, yields, &done));
+    }
+    done.wait();
+    result.ops = routines * yields;
+}
+
+//ping-pong through two Channels, latency is the round trip
+bco::Routine pinger(bco::Channel<uint64_t>* ping, bco::Channel<uint64_t>* pong, std::vector<uint64_t>* latencies, Countdown* done)
+{
+    for (auto& latency : *latencies) {
+        uint64_t start = now_ns();
+        ping->send(start);
+        co_await pong->recv();
+        latency = now_ns() - start;
+    }
+    ping->send(0);
+    done->count_down();
+}
+
+bco::Routine ponger(bco::Channel<uint64_t>* ping, bco::Channel<uint64_t>* pong)
+{
+    while (true) {
+        uint64_t value = co_await ping->recv();
+        if (value == 0) {
+            co_return;
+        }
+        pong->send(value);
+    }
+}
+
+void bench_ping_pong(bco::Context& ctx, size_t round_trips, Result& result)
+{
+    result.latencies.resize(round_trips);
+    bco::Channel<uint64_t> ping;
+    bco::Channel<uint64_t> pong;
+    Countdown done { 1 };
+    ctx.spawn(std::bind(&ponger, &ping, &pong));
+    ctx.spawn(std::bind(&pinger, &ping, &pong, &result.latencies, &done));
+    done.wait();
+    result.ops = round_trips;
+}
+
+//fan-out/fan-in: N tasks report to one collector through a Channel,
+//latency is from the fan-out to the collector receiving the result
+bco::Routine fan_worker(uint64_t started_at, bco::Channel<uint64_t>* results)
+{
+    results->send(started_at);
+    co_return;
+}
+
+bco::Routine fan_in(size_t n, bco::Channel<uint64_t>* results, uint64_t* latencies, Countdown* done)
+{
+    for (size_t i = 0; i < n; i++) {
+        uint64_t started_at = co_await results->recv();
+        latencies[i] = now_ns() - started_at;
+    }
+    done->count_down();
+}
+
+bco::Routine fan_out(bco::Context* ctx, size_t n, bco::Channel<uint64_t>* results)
+{
+    for (size_t i = 0; i < n; i++) {
+        ctx->spawn(&fan_worker, now_ns(), results);
+    }
+    co_return;
+}
+
+void bench_fan_out_fan_in(bco::Context& ctx, size_t n, Result& result)
+{
+    result.latencies.resize(n);
+    bco::Channel<uint64_t> results;
+    Countdown done { 1 };
+    ctx.spawn(std::bind(&fan_in, n, &results, result.latencies.data(), &done));
+    ctx.spawn(std::bind(&fan_out, &ctx, n, &results));
+    done.wait();
+    result.ops = n;
+}
+
+//producers/consumers through a small BoundedChannel, senders are held back while it is full,
+//latency is from send() to the consumer receiving the value
+bco::Routine bounded_producer(size_t n, bco::BoundedChannel<uint64_t>* channel)
+{
+    for (size_t i = 0; i < n; i++) {
+        co_await channel->send(now_ns());
+    }
+}
+
+bco::Routine bounded_consumer(size_t n, bco::BoundedChannel<uint64_t>* channel, uint64_t* latencies, Countdown* done)
+{
+    for (size_t i = 0; i < n; i++) {
+        uint64_t sent_at = *co_await channel->recv();
+        latencies[i] = now_ns() - sent_at;
+    }
+    done->count_down();
+}
+
+void bench_bounded_channel(bco::Context& ctx, size_t pairs, size_t per_pair, Result& result)
+{
+    result.latencies.resize(pairs * per_pair);
+    bco::BoundedChannel<uint64_t> channel { 256 };
+    Countdown done { pairs };
+    for (size_t i = 0; i < pairs; i++) {
+        ctx.spawn(std::bind(&bounded_consumer, per_pair, &channel, result.latencies.data() + i * per_pair, &done));
+    }
+    for (size_t i = 0; i < pairs; i++) {
+        ctx.spawn(std::bind(&bounded_producer, per_pair, &channel));
+    }
+    done.wait();
+    result.ops = pairs * per_pair;
+}
+
+//scatter-gather: one routine awaits K shard calls at once with when_all() per round,
+//each call hops through the executor, latency is the round
+bco::Func<uint64_t> shard_call(uint64_t shard)
+{
+    co_await bco::switch_to(bco::get_current_executor());
+    co_return shard;
+}
+
+bco::Routine gatherer(size_t shards, std::vector<uint64_t>* latencies, Countdown* done)
+{
+    std::vector<bco::Func<uint64_t>> calls;
+    for (auto& latency : *latencies) {
+        uint64_t start = now_ns();
+        calls.clear();
+        for (size_t shard = 0; shard < shards; shard++) {
+            calls.push_back(shard_call(shard));
+        }
+        co_await bco::when_all(calls);
+        latency = now_ns() - start;
+    }
+    done->count_down();
+}
+
+void bench_scatter_gather(bco::Context& ctx, size_t shards, size_t rounds, Result& result)
+{
+    result.latencies.resize(rounds);
+    Countdown done { 1 };
+    ctx.spawn(std::bind(&gatherer, shards, &result.latencies, &done));
+    done.wait();
+    result.ops = rounds * shards;
+}
+
+//timer heavy: R routines sleeping 1ms in a loop, latency is the oversleep
+bco::Routine sleeper(uint64_t* latencies, size_t rounds, Countdown* done)
+{
+    constexpr auto kSleep = std::chrono::milliseconds { 1 };
+    for (size_t i = 0; i < rounds; i++) {
+        uint64_t start = now_ns();
+        co_await bco::sleep_for(kSleep);
+        uint64_t slept = now_ns() - start;
+        const uint64_t requested = std::chrono::nanoseconds { kSleep }.count();
+        latencies[i] = slept > requested ? slept - requested : 0;
+    }
+    done->count_down();
+}
+
+void bench_timers(bco::Context& ctx, size_t routines, size_t rounds, Result& result)
+{
+    result.latencies.resize(routines * rounds);
+    Countdown done { routines };
+    for (size_t i = 0; i < routines; i++) {
+        ctx.spawn(std::bind(&sleeper, result.latencies.data() + i * rounds, rounds, &done));
+    }
+    done.wait();
+    result.ops = routines * rounds;
+}
+
+//cross-thread posting: foreign threads post plain tasks, latency is from post() to run
+void bench_cross_thread_post(bco::Context& ctx, size_t producers, size_t per_producer, Result& result)
+{
+    result.latencies.resize(producers * per_producer);
+    Countdown done { producers * per_producer };
+    std::vector<std::thread> threads;
+    for (size_t p = 0; p < producers; p++) {
+        threads.emplace_back([&, p]() {
+            uint64_t* latencies = result.latencies.data() + p * per_producer;
+            for (size_t i = 0; i < per_producer; i++) {
+                uint64_t posted_at = now_ns();
+                ctx.executor()->post(bco::PriorityTask { bco::Priority::Medium, [latency = latencies + i, posted_at, &done]() {
+                                                            *latency = now_ns() - posted_at;
+                                                            done.count_down();
+                                                        } });
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    done.wait();
+    result.ops = producers * per_producer;
+}
+
+struct Percentiles {
+    uint64_t p50 { 0 };
+    uint64_t p99 { 0 };
+    uint64_t max { 0 };
+};
+
+Percentiles percentiles(std::vector<uint64_t> values)
+{
+    Percentiles result;
+    if (values.empty()) {
+        return result;
+    }
+    auto at = [&values](double q) {
+        auto nth = values.begin() + static_cast<ptrdiff_t>(q * static_cast<double>(values.size() - 1));
+        std::nth_element(values.begin(), nth, values.end());
+        return *nth;
+    };
+    result.p50 = at(0.50);
+    result.p99 = at(0.99);
+    result.max = *std::max_element(values.begin(), values.end());
+    return result;
+}
+
+void write_json(std::ostream& out, const std::vector<Result>& results)
+{
+    out << "{\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto& r = results[i];
+        auto p = percentiles(r.latencies);
+        out << (i == 0 ? "\n" : ",\n")
+            << "    {\"scenario\": \"" << r.scenario << "\", \"executor\": \"" << r.executor.name << "\", \"threads\": " << r.executor.threads
+            << ", \"ops\": " << r.ops << ", \"seconds\": " << r.seconds
+            << ", \"ops_per_sec\": " << (r.seconds > 0 ? static_cast<double>(r.ops) / r.seconds : 0)
+            << ", \"latency_ns\": {\"p50\": " << p.p50 << ", \"p99\": " << p.p99 << ", \"max\": " << p.max << "}}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+std::vector<uint32_t> parse_threads(const char* arg)
+{
+    std::vector<uint32_t> threads;
+    for (const char* p = arg; *p != '\0';) {
+        char* end = nullptr;
+        auto value = std::strtoul(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        threads.push_back(static_cast<uint32_t>(std::max(value, 1ul)));
+        p = *end == ',' ? end + 1 : end;
+    }
+    return threads;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const char* json_path = nullptr;
+    double scale = 1.0;
+    std::vector<uint32_t> thread_counts { 1, 2, 4, std::max(std::thread::hardware_concurrency(), 1u) };
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--json") == 0) {
+            json_path = argv[i + 1];
+        } else if (std::strcmp(argv[i], "--scale") == 0) {
+            scale = std::max(std::atof(argv[i + 1]), 0.001);
+        } else if (std::strcmp(argv[i], "--threads") == 0) {
+            thread_counts = parse_threads(argv[i + 1]);
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--json FILE] [--scale FACTOR] [--threads 1,2,4]\n";
+            return 1;
+        }
+    }
+    std::ranges::sort(thread_counts);
+    thread_counts.erase(std::unique(thread_counts.begin(), thread_counts.end()), thread_counts.end());
+
+    std::vector<ExecutorConfig> executors { { "simple", 1 } };
+    for (uint32_t threads : thread_counts) {
+        executors.push_back({ "multithread", threads });
+    }
+    auto scaled = [scale](size_t n) { return std::max<size_t>(static_cast<size_t>(static_cast<double>(n) * scale), 1); };
+
+    using Scenario = std::function<void(bco::Context&, Result&)>;
+    const std::vector<std::pair<std::string, Scenario>> scenarios {
+        { "spawn", [&](bco::Context& ctx, Result& r) { bench_spawn(ctx, scaled(100000), false, r); } },
+        { "spawn_direct", [&](bco::Context& ctx, Result& r) { bench_spawn(ctx, scaled(100000), true, r); } },
+        { "yield_storm", [&](bco::Context& ctx, Result& r) { bench_yield_storm(ctx, 1000, scaled(1000), r); } },
+        { "ping_pong", [&](bco::Context& ctx, Result& r) { bench_ping_pong(ctx, scaled(100000), r); } },
+        { "fan_out_fan_in", [&](bco::Context& ctx, Result& r) { bench_fan_out_fan_in(ctx, scaled(1000000), r); } },
+        { "bounded_channel", [&](bco::Context& ctx, Result& r) { bench_bounded_channel(ctx, 4, scaled(250000), r); } },
+        { "scatter_gather", [&](bco::Context& ctx, Result& r) { bench_scatter_gather(ctx, 16, scaled(50000), r); } },
+        { "timers", [&](bco::Context& ctx, Result& r) { bench_timers(ctx, 1000, scaled(20), r); } },
+        { "cross_thread_post", [&](bco::Context& ctx, Result& r) { bench_cross_thread_post(ctx, 4, scaled(250000), r); } },
+    };
+
+    std::vector<Result> results;
+    for (const auto& [name, scenario] : scenarios) {
+        for (const auto& executor : executors) {
+            Result result { .scenario = name, .executor = executor };
+            auto ctx = make_context(executor);
+            auto start = Clock::now();
+            scenario(*ctx, result);
+            result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            ctx->shutdown(std::chrono::seconds { 5 });
+
+            auto p = percentiles(result.latencies);
+            std::cerr << name << " " << executor.name << "/" << executor.threads << ": "
+                      << static_cast<uint64_t>(result.seconds > 0 ? static_cast<double>(result.ops) / result.seconds : 0) << " ops/s, p50 "
+                      << p.p50 << "ns, p99 " << p.p99 << "ns" << std::endl;
+            results.push_back(std::move(result));
+        }
+    }
+
+    if (json_path != nullptr) {
+        std::ofstream out { json_path };
+        write_json(out, results);
+    } else {
+        write_json(std::cout, results);
+    }
+    return 0;
+}
@@ -5,9 +5,8 @@
 
 #include <bco.h>
 
-using CurrProactor = bco::net::IOCP;
-
-class EchoServer : public std::enable_shared_from_this<EchoServer> {
+template <typename P>
+class EchoServer : public std::enable_shared_from_this<EchoServer<P>> {
 public:
     EchoServer(std::shared_ptr<bco::Context> ctx, uint16_t port)
         : ctx_(ctx)
@@ -19,7 +18,7 @@ public:
     void start()
     {
         ctx_->spawn(std::move([shared_this = this->shared_from_this()]() -> bco::Routine {
-            auto [socket, error] = bco::net::TcpSocket<CurrProactor>::create(shared_this->ctx_->get_proactor<CurrProactor>(), AF_INET);
+            auto [socket, error] = bco::net::TcpSocket<P>::create(shared_this->ctx_->template get_proactor<P>(), AF_INET);
             if (error < 0) {
                 std::cerr << "Create socket failed with " << error << std::endl;
                 co_return;
@@ -40,15 +39,13 @@ public:
             auto shared_that = shared_this;
             while (true) {
                 auto [cli_sock, addr] = co_await socket.accept();
-                shared_that->ctx_->spawn(std::bind(&EchoServer::serve, shared_that.get(), shared_that, cli_sock));
+                shared_that->ctx_->spawn(&EchoServer::serve, shared_that.get(), shared_that, cli_sock);
             }
         }));
-
-        ctx_->start();
     }
 
 private:
-    bco::Routine serve(std::shared_ptr<EchoServer> shared_this, bco::net::TcpSocket<CurrProactor> sock)
+    bco::Routine serve(std::shared_ptr<EchoServer> shared_this, bco::net::TcpSocket<P> sock)
     {
         bco::Buffer buffer(1024);
         while (true) {
@@ -80,15 +77,17 @@ void init_winsock()
 int main()
 {
     init_winsock();
-    auto ctx = std::make_shared<bco::Context>(std::make_unique<bco::SimpleExecutor>());
-    auto socket_proactor = std::make_unique<CurrProactor>();
-    socket_proactor->start(/*ctx->executor()*/);
-    ctx->add_proactor(std::move(socket_proactor));
-    auto server = std::make_shared<EchoServer>(ctx, uint16_t { 30000 });
-    server->start();
+    auto runtime = bco::Runtime::Builder {}.build();
+    std::cout << "Running on " << runtime.describe() << std::endl;
+    runtime.visit_proactor([&runtime](auto* proactor) {
+        using P = std::remove_pointer_t<decltype(proactor)>;
+        auto server = std::make_shared<EchoServer<P>>(runtime.context(), uint16_t { 30000 });
+        server->start();
+    });
+    runtime.start();
     while (true) {
         std::this_thread::sleep_for(std::chrono::seconds { 1000 });
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -1,12 +1,23 @@
 #pragma once
 
 #include <bco/coroutine/task.h>
+#include <bco/coroutine/frame_pool.h>
 #include <bco/coroutine/channel.h>
 #include <bco/coroutine/cofunc.h>
+#include <bco/coroutine/parallel.h>
+#include <bco/coroutine/pipeline.h>
+#include <bco/coroutine/mailbox.h>
+#include <bco/coroutine/when.h>
+#include <bco/coroutine/generator.h>
+#include <bco/coroutine/sync.h>
+#include <bco/coroutine/local.h>
 
 #include <bco/proactor.h>
 #include <bco/executor.h>
 #include <bco/context.h>
+#include <bco/runtime.h>
+#include <bco/accounting.h>
+#include <bco/cancellation.h>
 
 #include <bco/exception.h>
 #include <bco/buffer.h>
@@ -14,6 +25,7 @@
 
 #include <bco/net/address.h>
 #include <bco/net/event.h>
+#include <bco/net/io_awaiter.h>
 #include <bco/net/socket.h>
 #include <bco/net/tcp.h>
 #include <bco/net/udp.h>
@@ -25,6 +37,9 @@
 #include <bco/net/proactor/iocp.h>
 #else
 #include <bco/net/proactor/epoll.h>
+#include <bco/net/proactor/iouring.h>
+#include <bco/net/prefork.h>
+#include <bco/profiler.h>
 #endif // _WIN32
 
 
@@ -0,0 +1,63 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace bco {
+
+//Per-routine CPU time, resume count and time spent runnable but not running.
+//Off by default, see enable_routine_accounting().
+struct RoutineStats {
+    std::atomic<uint64_t> cpu_ns { 0 };
+    std::atomic<uint64_t> resumes { 0 };
+    std::atomic<uint64_t> ready_wait_ns { 0 };
+};
+
+struct RoutineUsage {
+    const void* id;
+    std::chrono::steady_clock::time_point start_time;
+    std::chrono::nanoseconds cpu;
+    uint64_t resumes;
+    std::chrono::nanoseconds ready_wait;
+};
+
+//Run time is measured with the thread CPU clock between the points where a routine (or a Func
+//it awaits) resumes and suspends. When coroutines resume each other inline the time is
+//attributed to the one that resumed last.
+void enable_routine_accounting(bool enable);
+
+namespace detail {
+
+extern std::atomic<bool> routine_accounting;
+//stats of the slice being measured on this thread
+extern constinit thread_local RoutineStats* running_slice;
+
+uint64_t steady_now_ns();
+void set_task_ready_at(uint64_t ready_at);
+void begin_slice_slow(RoutineStats* stats, bool resumed);
+void end_slice_slow(RoutineStats* stats);
+
+inline void begin_slice(RoutineStats* stats, bool resumed)
+{
+    if (stats != nullptr && routine_accounting.load(std::memory_order::relaxed)) {
+        begin_slice_slow(stats, resumed);
+    }
+}
+
+//Not gated by the flag: accounting switched off mid slice would leave running_slice pointing
+//to stats that are freed with their routine.
+inline void end_slice(RoutineStats* stats)
+{
+    if (stats != nullptr && running_slice == stats) {
+        end_slice_slow(stats);
+    }
+}
+
+} // namespace detail
+
+inline bool routine_accounting_enabled()
+{
+    return detail::routine_accounting.load(std::memory_order::relaxed);
+}
+
+} // namespace bco
@@ -0,0 +1,134 @@
+#pragma once
+#include <atomic>
+#include <coroutine>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace bco {
+
+class CancellationSource;
+
+namespace detail {
+
+//registered with a CancellationSource, runs once when it is cancelled
+struct CancellationNode {
+    void (*invoke)(CancellationNode* node) = nullptr;
+    CancellationNode* prev = nullptr;
+    CancellationNode* next = nullptr;
+    //set by cancel() while the node runs, tells it the node destroyed itself
+    bool* destroyed = nullptr;
+    std::atomic<bool> done { false };
+};
+
+} // namespace detail
+
+//Observes whether a CancellationSource was cancelled. It is only a pointer, the source has to
+//outlive the tokens and the operations using them. Default constructed, it never is.
+class CancellationToken {
+public:
+    CancellationToken() = default;
+
+    bool cancellable() const noexcept { return source_ != nullptr; }
+    bool cancelled() const noexcept;
+
+private:
+    friend class CancellationSource;
+    template <typename F>
+    friend class CancellationCallback;
+    explicit CancellationToken(CancellationSource* source)
+        : source_(source)
+    {
+    }
+    CancellationSource* source_ = nullptr;
+};
+
+//Cancels the operations and coroutines holding one of its tokens, e.g. a socket operation
+//completes with -ECANCELED. It allocates nothing, it usually lives in the coroutine frame or the
+//awaiter starting the operations.
+class CancellationSource {
+public:
+    CancellationSource() = default;
+    //cancelled as well once 'parent' is
+    explicit CancellationSource(CancellationToken parent);
+    ~CancellationSource();
+    CancellationSource(const CancellationSource&) = delete;
+    CancellationSource& operator=(const CancellationSource&) = delete;
+
+    CancellationToken token() noexcept { return CancellationToken { this }; }
+    //runs the registered callbacks on this thread, false if it was cancelled already
+    bool cancel();
+    bool cancelled() const noexcept { return cancelled_.load(std::memory_order::acquire); }
+
+private:
+    template <typename F>
+    friend class CancellationCallback;
+    struct ParentLink : detail::CancellationNode {
+        CancellationSource* self = nullptr;
+        CancellationSource* parent = nullptr;
+    };
+
+    //false if cancelled already, the node is not added then
+    bool add(detail::CancellationNode* node);
+    //waits for the node if it is running on another thread
+    void remove(detail::CancellationNode* node);
+
+private:
+    std::mutex mtx_;
+    std::atomic<bool> cancelled_ { false };
+    detail::CancellationNode* head_ = nullptr;
+    detail::CancellationNode* running_ = nullptr;
+    std::thread::id running_thread_;
+    ParentLink parent_link_;
+};
+
+inline bool CancellationToken::cancelled() const noexcept
+{
+    return source_ != nullptr && source_->cancelled();
+}
+
+//Calls f once the token is cancelled, at once if it already is, from the thread cancelling it.
+//Unregistered by the destructor, which waits for f if it is running on another thread.
+template <typename F>
+class CancellationCallback : private detail::CancellationNode {
+public:
+    CancellationCallback(CancellationToken token, F f)
+        : f_(std::move(f))
+        , source_(token.source_)
+    {
+        invoke = [](detail::CancellationNode* node) { static_cast<CancellationCallback*>(node)->f_(); };
+        if (source_ != nullptr && !source_->add(this)) {
+            source_ = nullptr;
+            f_();
+        }
+    }
+    ~CancellationCallback()
+    {
+        if (source_ != nullptr) {
+            source_->remove(this);
+        }
+    }
+    CancellationCallback(const CancellationCallback&) = delete;
+    CancellationCallback& operator=(const CancellationCallback&) = delete;
+
+private:
+    F f_;
+    CancellationSource* source_;
+};
+
+namespace detail {
+
+//the token of the awaiting coroutine, none if its promise has no cancellation_token()
+template <typename Promise>
+CancellationToken cancellation_token_of(std::coroutine_handle<Promise> coroutine)
+{
+    if constexpr (requires { coroutine.promise().cancellation_token(); }) {
+        return coroutine.promise().cancellation_token();
+    } else {
+        return {};
+    }
+}
+
+} // namespace detail
+
+} // namespace bco
@@ -0,0 +1,155 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+namespace bco {
+
+//Completion of an asynchronous operation. The operation provides it when it is submitted, the
+//proactor fills in the result and hands it to the executor as is, nothing is copied on the way.
+class CompletionNode {
+public:
+    explicit CompletionNode(size_t affinity)
+        : affinity_(affinity)
+    {
+    }
+    virtual ~CompletionNode() = default;
+    CompletionNode(const CompletionNode&) = delete;
+    CompletionNode& operator=(const CompletionNode&) = delete;
+
+    //runs the continuation of the operation, frees the node if it owns itself
+    virtual void run() = 0;
+    //the continuation will never run, e.g. the proactor is destroyed with the operation in flight
+    virtual void discard() { delete this; }
+    //worker that should run the node, see PriorityTask::affinity
+    size_t affinity() const { return affinity_; }
+
+private:
+    friend class CompletionList;
+    friend class CompletionQueue;
+    CompletionNode* next_ { nullptr };
+    size_t affinity_;
+};
+
+//FIFO list of completions, owns the nodes it holds
+class CompletionList {
+public:
+    CompletionList() = default;
+    CompletionList(CompletionList&& other) noexcept
+        : head_(std::exchange(other.head_, nullptr))
+        , tail_(std::exchange(other.tail_, nullptr))
+        , size_(std::exchange(other.size_, 0))
+    {
+    }
+    CompletionList& operator=(CompletionList&& other) noexcept
+    {
+        std::swap(head_, other.head_);
+        std::swap(tail_, other.tail_);
+        std::swap(size_, other.size_);
+        return *this;
+    }
+    ~CompletionList()
+    {
+        while (auto node = pop_front()) {
+            node->discard();
+        }
+    }
+
+    bool empty() const { return head_ == nullptr; }
+    size_t size() const { return size_; }
+
+    void push_back(CompletionNode* node)
+    {
+        node->next_ = nullptr;
+        if (tail_ == nullptr) {
+            head_ = node;
+        } else {
+            tail_->next_ = node;
+        }
+        tail_ = node;
+        size_++;
+    }
+
+    //the caller owns the node
+    CompletionNode* pop_front()
+    {
+        CompletionNode* node = head_;
+        if (node == nullptr) {
+            return nullptr;
+        }
+        head_ = node->next_;
+        if (head_ == nullptr) {
+            tail_ = nullptr;
+        }
+        node->next_ = nullptr;
+        size_--;
+        return node;
+    }
+
+    void splice(CompletionList&& other)
+    {
+        if (other.empty()) {
+            return;
+        }
+        if (tail_ == nullptr) {
+            head_ = other.head_;
+        } else {
+            tail_->next_ = other.head_;
+        }
+        tail_ = other.tail_;
+        size_ += other.size_;
+        other.head_ = other.tail_ = nullptr;
+        other.size_ = 0;
+    }
+
+private:
+    friend class CompletionQueue;
+    CompletionNode* head_ { nullptr };
+    CompletionNode* tail_ { nullptr };
+    size_t size_ { 0 };
+};
+
+//Lock-free queue between a proactor and the executor.
+//Any thread pushes with one CAS, the consumer takes everything with one exchange, so there is
+//no ABA and no node is touched by two threads at the same time.
+class CompletionQueue {
+public:
+    CompletionQueue() = default;
+    CompletionQueue(const CompletionQueue&) = delete;
+    CompletionQueue& operator=(const CompletionQueue&) = delete;
+    //completions never taken are dropped
+    ~CompletionQueue() { take_all(); }
+
+    void push(CompletionNode* node)
+    {
+        node->next_ = head_.load(std::memory_order::relaxed);
+        while (!head_.compare_exchange_weak(node->next_, node, std::memory_order::release, std::memory_order::relaxed)) {
+        }
+    }
+
+    //in the order they were pushed
+    CompletionList take_all()
+    {
+        CompletionList list;
+        if (head_.load(std::memory_order::relaxed) == nullptr) {
+            return list;
+        }
+        CompletionNode* node = head_.exchange(nullptr, std::memory_order::acquire);
+        list.tail_ = node;
+        while (node != nullptr) {
+            CompletionNode* next = node->next_;
+            node->next_ = list.head_;
+            list.head_ = node;
+            list.size_++;
+            node = next;
+        }
+        return list;
+    }
+
+    bool empty() const { return head_.load(std::memory_order::relaxed) == nullptr; }
+
+private:
+    std::atomic<CompletionNode*> head_ { nullptr };
+};
+
+} // namespace bco
@@ -1,15 +1,37 @@
 #pragma once
+#include <array>
 #include <cassert>
-#include <map>
-#include <set>
+#include <condition_variable>
+#include <functional>
+#include <iosfwd>
 #include <memory>
 #include <mutex>
+#include <string>
+#include <type_traits>
 
 #include <bco/coroutine/task.h>
 #include <bco/executor.h>
+#include <bco/routine_registry.h>
 
 namespace bco {
 
+namespace detail {
+
+//how many proactor types a process can use, each one owns a slot in every Context
+constexpr size_t kMaxProactorTypes = 8;
+
+size_t next_proactor_slot();
+
+//slot of P, fixed the first time P is used with any Context
+template <typename P>
+size_t proactor_slot()
+{
+    static const size_t slot = next_proactor_slot();
+    return slot;
+}
+
+} // namespace detail
+
 class Context : public std::enable_shared_from_this<Context> {
 public:
     Context() = default;
@@ -20,50 +42,80 @@ public:
 
     template <typename P> requires Proactor<P> void add_proactor(std::unique_ptr<P>&& proactor);
     template <typename P> requires Proactor<P> P* get_proactor();
-    std::vector<PriorityTask> get_proactor_tasks();
+    CompletionList get_proactor_tasks();
 
     void start();
+    //Refuses new accepts, lets running routines, queued tasks and in-flight I/O finish, then fails
+    //the remaining I/O with -ECANCELED and joins the executor. The cancelled routines get the last
+    //'cancel_grace' before the deadline to observe their errors, the deadline is not exceeded.
+    //Returns false if I/O had to be cancelled. Must not be called from the executor's threads.
+    bool shutdown(std::chrono::steady_clock::time_point deadline, std::chrono::milliseconds cancel_grace = std::chrono::milliseconds { 100 });
+    bool shutdown(std::chrono::milliseconds timeout, std::chrono::milliseconds cancel_grace = std::chrono::milliseconds { 100 });
     void spawn(std::function<Routine()>&& coroutine);
-    void add_routine(Routine routine);
-    void del_routine(Routine routine);
+    //Creates the routine suspended and posts only its handle, so the coroutine frame is the one
+    //allocation. Takes a function or member function, not a functor: a lambda's captures would
+    //be gone before the routine runs. Arguments are passed as to any coroutine, take them by value.
+    template <typename F, typename... Args>
+        requires(std::is_pointer_v<F> || std::is_member_function_pointer_v<F>) && std::is_invocable_r_v<Routine, F, Args...>
+    void spawn(F coroutine, Args&&... args);
+    void add_routine(detail::RoutineNode& node);
+    void del_routine(detail::RoutineNode& node);
+    //0 while tracking is off, see set_routine_tracking()
     size_t routines_size();
+    //Routines started while tracking is off are not counted by routines_size(), shutdown() only
+    //sees their pending tasks and I/O. Building with BCO_ROUTINE_TRACKING=OFF turns it off for good.
+    void set_routine_tracking(bool enable);
+    bool routine_tracking() const { return BCO_ROUTINE_TRACKING && routine_tracking_.load(std::memory_order::relaxed); }
+    //the n live routines which consumed the most CPU, needs enable_routine_accounting()
+    std::vector<RoutineUsage> top_routines_by_cpu(size_t n);
+    //Async backtrace of every tracked routine, innermost coroutine first, and what it is
+    //suspended on. A routine that runs meanwhile may show a stack it had a moment ago.
+    //Ages are only known for routines started while accounting was on.
+    void dump_async_stacks(std::ostream& out);
+    std::string async_stacks();
 
 private:
-    void spawn_aux(std::function<Routine()> coroutine);
+    void spawn_aux(std::function<Routine()> coroutine, std::shared_ptr<detail::LocalStorage> locals);
+    bool idle();
+    template <typename Pred> bool wait_until(std::chrono::steady_clock::time_point deadline, Pred pred);
+    template <typename Func> void for_each_proactor(Func&& func);
 
 private:
     std::unique_ptr<ExecutorInterface> executor_;
-    std::map<std::size_t, std::unique_ptr<ProactorInterface>> proactors_;
+    std::array<std::unique_ptr<ProactorInterface>, detail::kMaxProactorTypes> proactors_;
 
-    using TimePoint = std::chrono::steady_clock::time_point;
     using Clock = std::chrono::steady_clock;
-    struct RoutineInfo {
-        Routine routine;
-        TimePoint start_time;
-        std::strong_ordering operator<=>(const RoutineInfo& other) const
-        {
-            return routine <=> other.routine;
-        }
-    };
-    std::set<RoutineInfo> routines_;
-    std::mutex mutex_;
+    detail::RoutineRegistry routines_;
+    std::atomic<bool> routine_tracking_ { true };
+    //shutdown() waits on it, routines finishing meanwhile notify it
+    std::atomic<bool> shutting_down_ { false };
+    std::mutex shutdown_mtx_;
+    std::condition_variable shutdown_cv_;
 };
 
 template <typename P> requires Proactor<P>
 inline void Context::add_proactor(std::unique_ptr<P>&& proactor)
 {
-    //proactors_[typeid(P).hash_code()] = std::move(proactor);
-    proactors_.emplace(typeid(P).hash_code(), std::move(proactor));
+    proactors_[detail::proactor_slot<P>()] = std::move(proactor);
 }
 
 template <typename P> requires Proactor<P>
 inline P* Context::get_proactor()
 {
-#ifndef NODEBUG
-    auto it = proactors_.find(typeid(P).hash_code());
-    assert(it != proactors_.cend());
-#endif // NODEBUG
-    return static_cast<P*>(proactors_[typeid(P).hash_code()].get());
+    auto* proactor = proactors_[detail::proactor_slot<P>()].get();
+    assert(proactor != nullptr);
+    return static_cast<P*>(proactor);
+}
+
+template <typename F, typename... Args>
+    requires(std::is_pointer_v<F> || std::is_member_function_pointer_v<F>) && std::is_invocable_r_v<Routine, F, Args...>
+inline void Context::spawn(F coroutine, Args&&... args)
+{
+    Routine routine = [&]() {
+        detail::SpawnScope scope { detail::spawning_context, this };
+        return std::invoke(coroutine, std::forward<Args>(args)...);
+    }();
+    executor_->post(PriorityTask { Priority::Medium, [handle = routine.handle()]() { handle.resume(); } });
 }
 
-} // namespace bco
\ No newline at end of file
+} // namespace bco
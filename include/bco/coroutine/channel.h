@@ -1,57 +1,861 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cassert>
 #include <deque>
+#include <memory>
 #include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <variant>
 #include <bco/utils.h>
 #include <bco/context.h>
 #include "task.h"
+#include "bco/cancellation.h"
+#include "bco/executor.h"
 
 namespace bco {
 
 template <typename T>
 class Channel {
+public:
+    class RecvAwaiter {
+    public:
+        explicit RecvAwaiter(Channel& channel)
+            : channel_(channel)
+        {
+        }
+        bool await_ready() { return channel_.try_recv(*this); }
+        detail::AwaitInfo await_info() const { return { "Channel::recv" }; }
+        bool await_suspend(std::coroutine_handle<> coroutine)
+        {
+            coroutine_ = coroutine;
+            executor_ = get_current_executor();
+            affinity_ = get_current_worker_index(executor_);
+            return channel_.park(*this);
+        }
+        T await_resume() { return std::move(*value_); }
+
+    private:
+        friend class Channel;
+        Channel& channel_;
+        std::optional<T> value_;
+        std::coroutine_handle<> coroutine_;
+        ExecutorInterface* executor_ = nullptr;
+        size_t affinity_ = kAnyWorker;
+    };
+
 public:
     Channel() = default;
     void send(T value)
     {
-        std::lock_guard lock { mtx_ };
-        if (pending_tasks_.empty()) {
-            ready_values_.push_back(value);
-        } else {
-            Item item = pending_tasks_.front();
-            pending_tasks_.pop_front();
-            item.task.set_result(std::move(value));
-            std::shared_ptr<bco::Context> ctx = item.ctx.lock();
-            if (ctx != nullptr) {
-                ctx->spawn([item]() mutable -> Routine { item.task.resume(); co_return; });
+        RecvAwaiter* receiver = nullptr;
+        {
+            std::lock_guard lock { mtx_ };
+            if (receivers_.empty()) {
+                ready_values_.push_back(std::move(value));
+                return;
             }
+            receiver = receivers_.front();
+            receivers_.pop_front();
+            receiver->value_.emplace(std::move(value));
         }
+        detail::resume_on(receiver->executor_, receiver->coroutine_, receiver->affinity_);
     }
-    Task<T> recv()
+    //the receiver waits in its own frame, nothing is allocated per recv()
+    [[nodiscard]] RecvAwaiter recv() { return RecvAwaiter { *this }; }
+
+private:
+    bool try_recv(RecvAwaiter& awaiter)
+    {
+        std::lock_guard lock { mtx_ };
+        return pop_ready(awaiter);
+    }
+    //false if a value came in since await_ready()
+    bool park(RecvAwaiter& awaiter)
     {
         std::lock_guard lock { mtx_ };
+        if (pop_ready(awaiter)) {
+            return false;
+        }
+        receivers_.push_back(&awaiter);
+        return true;
+    }
+    bool pop_ready(RecvAwaiter& awaiter)
+    {
         if (ready_values_.empty()) {
-            Item item;
-            item.ctx = get_current_context();
-            pending_tasks_.push_back(item);
-            return item.task;
+            return false;
+        }
+        awaiter.value_.emplace(std::move(ready_values_.front()));
+        ready_values_.pop_front();
+        return true;
+    }
+
+private:
+    std::deque<RecvAwaiter*> receivers_;
+    std::deque<T> ready_values_;
+    std::mutex mtx_;
+};
+
+namespace detail {
+
+//Bounded multi producer multi consumer ring, capacity is rounded up to a power of two and must be
+//at least 2: with a single slot its written and read sequence numbers would collide.
+//Every slot carries the position it is next written (position) or read (position + 1) at, a side
+//claims a position with one CAS and then waits for nobody.
+template <typename T>
+class MpmcRing {
+    struct Slot {
+        std::atomic<size_t> sequence;
+        std::optional<T> value;
+    };
+
+public:
+    explicit MpmcRing(size_t capacity)
+        : mask_(std::bit_ceil(capacity) - 1)
+        , slots_(new Slot[mask_ + 1])
+    {
+        if (capacity < 2) {
+            throw std::logic_error { "MpmcRing: 'capacity' less than 2" };
+        }
+        for (size_t i = 0; i <= mask_; i++) {
+            slots_[i].sequence.store(i, std::memory_order::relaxed);
+        }
+    }
+    MpmcRing(const MpmcRing&) = delete;
+    MpmcRing& operator=(const MpmcRing&) = delete;
+
+    //moves from 'value' only on success
+    bool push(T& value)
+    {
+        size_t pos = tail_.load(std::memory_order::relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &slots_[pos & mask_];
+            const auto diff = static_cast<intptr_t>(slot->sequence.load(std::memory_order::acquire) - pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order::relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail_.load(std::memory_order::relaxed);
+            }
+        }
+        slot->value.emplace(std::move(value));
+        slot->sequence.store(pos + 1, std::memory_order::release);
+        return true;
+    }
+    bool pop(std::optional<T>& out)
+    {
+        size_t pos = head_.load(std::memory_order::relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &slots_[pos & mask_];
+            const auto diff = static_cast<intptr_t>(slot->sequence.load(std::memory_order::acquire) - (pos + 1));
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order::relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head_.load(std::memory_order::relaxed);
+            }
+        }
+        out.emplace(std::move(*slot->value));
+        slot->value.reset();
+        slot->sequence.store(pos + mask_ + 1, std::memory_order::release);
+        return true;
+    }
+    size_t capacity() const { return mask_ + 1; }
+    //a snapshot, others may be pushing or popping
+    size_t size() const
+    {
+        const size_t head = head_.load(std::memory_order::acquire);
+        const size_t tail = tail_.load(std::memory_order::acquire);
+        return tail > head ? std::min(tail - head, mask_ + 1) : 0;
+    }
+
+private:
+    const size_t mask_;
+    std::unique_ptr<Slot[]> slots_;
+    alignas(64) std::atomic<size_t> head_ { 0 };
+    alignas(64) std::atomic<size_t> tail_ { 0 };
+};
+
+//a coroutine waiting on a channel, in the frame of its awaiter
+struct ChannelWaiter {
+    void park(std::coroutine_handle<> coroutine)
+    {
+        this->coroutine = coroutine;
+        executor = get_current_executor();
+        affinity = get_current_worker_index(executor);
+    }
+    void resume() { resume_on(executor, coroutine, affinity); }
+
+    ChannelWaiter* next { nullptr };
+    std::coroutine_handle<> coroutine;
+    ExecutorInterface* executor { nullptr };
+    size_t affinity { kAnyWorker };
+};
+
+//FIFO of waiters, guarded by the channel lock
+class WaiterQueue {
+public:
+    void push(ChannelWaiter* waiter)
+    {
+        waiter->next = nullptr;
+        if (tail_ != nullptr) {
+            tail_->next = waiter;
         } else {
-            Task<T> task;
-            T value = ready_values_.front();
-            ready_values_.pop_front();
-            task.set_result(std::move(value));
-            return task;
+            head_ = waiter;
         }
+        tail_ = waiter;
+    }
+    ChannelWaiter* front() const { return head_; }
+    void pop()
+    {
+        head_ = head_->next;
+        if (head_ == nullptr) {
+            tail_ = nullptr;
+        }
+    }
+    //false if it is not in the queue
+    bool erase(ChannelWaiter* waiter)
+    {
+        ChannelWaiter* prev = nullptr;
+        for (ChannelWaiter* it = head_; it != nullptr; prev = it, it = it->next) {
+            if (it == waiter) {
+                (prev != nullptr ? prev->next : head_) = it->next;
+                if (tail_ == it) {
+                    tail_ = prev;
+                }
+                return true;
+            }
+        }
+        return false;
     }
 
 private:
-    // Context ctx_;
-    struct Item {
-        Task<T> task;
-        std::weak_ptr<Context> ctx;
+    ChannelWaiter* head_ { nullptr };
+    ChannelWaiter* tail_ { nullptr };
+};
+
+//A coroutine receiving from one channel, or from the cases of one select(). The first side
+//completing it claims it for the index of its case, directly if it holds a value or through kBusy
+//while it pops one, back to waiting if there was none. The others skip it.
+//A select() is visible to a channel before it registered with the others, whoever of the claimer
+//and the select comes second resumes the coroutine.
+class RecvWaiter : public ChannelWaiter {
+public:
+    static constexpr size_t kWaiting = ~size_t { 0 };
+    static constexpr size_t kBusy = kWaiting - 1;
+
+    explicit RecvWaiter(bool registering = false)
+        : arrived_(!registering)
+    {
+    }
+    //with a value at hand, false if another side completed it
+    bool claim(size_t index)
+    {
+        size_t state = kWaiting;
+        while (!state_.compare_exchange_weak(state, index, std::memory_order::acq_rel)) {
+            if (state == kBusy) {
+                std::this_thread::yield();
+                state = kWaiting;
+            } else if (state != kWaiting) {
+                return false;
+            }
+        }
+        return true;
+    }
+    //before looking for a value, complete() or release() follows
+    bool acquire()
+    {
+        size_t state = kWaiting;
+        while (!state_.compare_exchange_weak(state, kBusy, std::memory_order::acq_rel)) {
+            if (state == kBusy) {
+                std::this_thread::yield();
+                state = kWaiting;
+            } else if (state != kWaiting) {
+                return false;
+            }
+        }
+        return true;
+    }
+    void complete(size_t index) { state_.store(index, std::memory_order::release); }
+    void release() { state_.store(kWaiting, std::memory_order::release); }
+    //the index of the case which completed it, kWaiting if none did
+    size_t index() const { return state_.load(std::memory_order::acquire); }
+    //true for the second of the claimer and the registering select()
+    bool arrive() { return arrived_.exchange(true, std::memory_order::acq_rel); }
+    //by the claimer, the frame of the waiter may be gone once this returns
+    void wake()
+    {
+        if (arrive()) {
+            resume();
+        }
+    }
+
+private:
+    std::atomic<size_t> state_ { kWaiting };
+    std::atomic<bool> arrived_;
+};
+
+//a RecvWaiter in the queue of one channel, a select() has one per channel
+template <typename T>
+struct RecvNode {
+    RecvNode* prev { nullptr };
+    RecvNode* next { nullptr };
+    RecvWaiter* waiter { nullptr };
+    std::optional<T>* value { nullptr };
+    size_t index { 0 };
+    bool linked { false };
+};
+
+//FIFO of receivers, guarded by the channel lock. A select() unlinks its nodes from the middle.
+template <typename T>
+class RecvQueue {
+public:
+    void push(RecvNode<T>* node)
+    {
+        node->prev = tail_;
+        node->next = nullptr;
+        if (tail_ != nullptr) {
+            tail_->next = node;
+        } else {
+            head_ = node;
+        }
+        tail_ = node;
+        node->linked = true;
+    }
+    RecvNode<T>* front() const { return head_; }
+    void erase(RecvNode<T>* node)
+    {
+        (node->prev != nullptr ? node->prev->next : head_) = node->next;
+        (node->next != nullptr ? node->next->prev : tail_) = node->prev;
+        node->linked = false;
+    }
+
+private:
+    RecvNode<T>* head_ { nullptr };
+    RecvNode<T>* tail_ { nullptr };
+};
+
+} // namespace detail
+
+template <typename T>
+class RecvCase;
+
+//Bounded channel between any number of senders and receivers, on any threads.
+//send() suspends while the channel is full, recv() while it is empty. While nobody waits, values
+//go through a lock-free ring. A value sent while a receiver waits is handed to it directly, the
+//lock is only taken to park or wake up a waiting side.
+//The capacity is rounded up to a power of two, capacity() tells the one in use. Capacities below 2
+//throw std::logic_error.
+//A waiting send() or recv() gives up once the awaiting coroutine is cancelled, e.g. as the loser
+//of a when_any(), send() then returns false and recv() std::nullopt.
+template <typename T>
+class BoundedChannel {
+public:
+    class SendAwaiter : private detail::ChannelWaiter {
+        struct Cancel {
+            SendAwaiter* self;
+            void operator()() const
+            {
+                if (self->channel_.cancel_sender(*self)) {
+                    self->wake();
+                }
+            }
+        };
+
+    public:
+        SendAwaiter(BoundedChannel& channel, T&& value)
+            : channel_(channel)
+            , value_(std::move(value))
+        {
+        }
+        //movable until awaited, e.g. into when_any()
+        SendAwaiter(SendAwaiter&& other) noexcept(std::is_nothrow_move_constructible_v<T>)
+            : SendAwaiter(other.channel_, std::move(other.value_))
+        {
+        }
+        bool await_ready() { return channel_.try_send(value_); }
+        detail::AwaitInfo await_info() const { return { "BoundedChannel::send" }; }
+        template <typename Promise>
+        bool await_suspend(std::coroutine_handle<Promise> coroutine)
+        {
+            park(coroutine);
+            if (!channel_.park_sender(*this)) {
+                return false;
+            }
+            const CancellationToken token = detail::cancellation_token_of(coroutine);
+            if (token.cancellable()) {
+                callback_.emplace(token, Cancel { this });
+            }
+            //woken while the callback was registered, the coroutine goes on right away
+            return !arrived_.exchange(true, std::memory_order::acq_rel);
+        }
+        //false if it was cancelled before the value got in
+        bool await_resume()
+        {
+            callback_.reset();
+            return !cancelled_;
+        }
+
+    private:
+        friend class BoundedChannel;
+        //the second of the waker and await_suspend() resumes the coroutine
+        void wake()
+        {
+            if (arrived_.exchange(true, std::memory_order::acq_rel)) {
+                resume();
+            }
+        }
+
+        BoundedChannel& channel_;
+        T value_;
+        std::atomic<bool> arrived_ { false };
+        bool cancelled_ = false;
+        std::optional<CancellationCallback<Cancel>> callback_;
     };
-    std::deque<Item> pending_tasks_;
-    std::deque<T> ready_values_;
+
+    class RecvAwaiter {
+        struct Cancel {
+            RecvAwaiter* self;
+            void operator()() const
+            {
+                if (self->channel_.cancel_receiver(self->node_)) {
+                    self->waiter_.wake();
+                }
+            }
+        };
+
+    public:
+        explicit RecvAwaiter(BoundedChannel& channel)
+            : channel_(channel)
+        {
+            node_.waiter = &waiter_;
+            node_.value = &value_;
+        }
+        //movable until awaited, e.g. into when_any()
+        RecvAwaiter(RecvAwaiter&& other) noexcept
+            : RecvAwaiter(other.channel_)
+        {
+        }
+        bool await_ready() { return channel_.pop(value_); }
+        detail::AwaitInfo await_info() const { return { "BoundedChannel::recv" }; }
+        template <typename Promise>
+        bool await_suspend(std::coroutine_handle<Promise> coroutine)
+        {
+            waiter_.park(coroutine);
+            if (!channel_.park_receiver(node_)) {
+                return false;
+            }
+            const CancellationToken token = detail::cancellation_token_of(coroutine);
+            if (token.cancellable()) {
+                callback_.emplace(token, Cancel { this });
+            }
+            //completed while the callback was registered, the coroutine goes on right away
+            return !waiter_.arrive();
+        }
+        //std::nullopt if it was cancelled before a value came
+        std::optional<T> await_resume()
+        {
+            callback_.reset();
+            return std::move(value_);
+        }
+
+    private:
+        BoundedChannel& channel_;
+        std::optional<T> value_;
+        //resumed by the second of the channel and await_suspend()
+        detail::RecvWaiter waiter_ { true };
+        detail::RecvNode<T> node_;
+        std::optional<CancellationCallback<Cancel>> callback_;
+    };
+
+public:
+    explicit BoundedChannel(size_t capacity = 1024)
+        : ring_(capacity)
+    {
+    }
+    BoundedChannel(const BoundedChannel&) = delete;
+    BoundedChannel& operator=(const BoundedChannel&) = delete;
+
+    //moves from 'value' only on success
+    bool try_send(T& value)
+    {
+        if (receivers_waiting_.load(std::memory_order::acquire) > 0) {
+            std::unique_lock lock { mtx_ };
+            if (detail::RecvNode<T>* receiver = claim_receiver()) {
+                receiver->value->emplace(std::move(value));
+                lock.unlock();
+                receiver->waiter->wake();
+                return true;
+            }
+        }
+        if (!ring_.push(value)) {
+            return false;
+        }
+        wake_receiver();
+        return true;
+    }
+    [[nodiscard]] SendAwaiter send(T value) { return SendAwaiter { *this, std::move(value) }; }
+
+    std::optional<T> try_recv()
+    {
+        std::optional<T> value;
+        pop(value);
+        return value;
+    }
+    [[nodiscard]] RecvAwaiter recv() { return RecvAwaiter { *this }; }
+    //a case of select()
+    [[nodiscard]] RecvCase<T> recv_case() { return RecvCase<T> { *this }; }
+
+    size_t capacity() const { return ring_.capacity(); }
+    size_t size() const { return ring_.size(); }
+
+private:
+    friend class RecvCase<T>;
+
+    //A side parks after it counted itself and then checked the ring again, the other side changes
+    //the ring and then checks the count. With a full fence on both sides at least one of them
+    //sees the other.
+    bool pop(std::optional<T>& value)
+    {
+        if (!ring_.pop(value)) {
+            return false;
+        }
+        wake_sender();
+        return true;
+    }
+    //false if the waiter was completed meanwhile, by this channel or by another case of a select()
+    bool park_receiver(detail::RecvNode<T>& receiver)
+    {
+        std::unique_lock lock { mtx_ };
+        receivers_waiting_.fetch_add(1, std::memory_order::relaxed);
+        std::atomic_thread_fence(std::memory_order::seq_cst);
+        if (!receiver.waiter->acquire()) {
+            receivers_waiting_.fetch_sub(1, std::memory_order::relaxed);
+            return false;
+        }
+        if (ring_.pop(*receiver.value)) {
+            receiver.waiter->complete(receiver.index);
+            receivers_waiting_.fetch_sub(1, std::memory_order::relaxed);
+            lock.unlock();
+            wake_sender();
+            return false;
+        }
+        receiver.waiter->release();
+        receivers_.push(&receiver);
+        return true;
+    }
+    void unpark_receiver(detail::RecvNode<T>& receiver)
+    {
+        std::lock_guard lock { mtx_ };
+        if (receiver.linked) {
+            receivers_.erase(&receiver);
+            receivers_waiting_.fetch_sub(1, std::memory_order::relaxed);
+        }
+    }
+    //false if a value completed it first
+    bool cancel_receiver(detail::RecvNode<T>& receiver)
+    {
+        std::lock_guard lock { mtx_ };
+        if (!receiver.linked || !receiver.waiter->claim(receiver.index)) {
+            return false;
+        }
+        erase_receiver(&receiver);
+        return true;
+    }
+    //false if it sent its value meanwhile
+    bool park_sender(SendAwaiter& sender)
+    {
+        std::unique_lock lock { mtx_ };
+        if (detail::RecvNode<T>* receiver = claim_receiver()) {
+            receiver->value->emplace(std::move(sender.value_));
+            lock.unlock();
+            receiver->waiter->wake();
+            return false;
+        }
+        senders_waiting_.fetch_add(1, std::memory_order::relaxed);
+        std::atomic_thread_fence(std::memory_order::seq_cst);
+        if (ring_.push(sender.value_)) {
+            senders_waiting_.fetch_sub(1, std::memory_order::relaxed);
+            return false;
+        }
+        senders_.push(&sender);
+        return true;
+    }
+    //false if its value got in first
+    bool cancel_sender(SendAwaiter& sender)
+    {
+        std::lock_guard lock { mtx_ };
+        if (!senders_.erase(&sender)) {
+            return false;
+        }
+        senders_waiting_.fetch_sub(1, std::memory_order::relaxed);
+        sender.cancelled_ = true;
+        return true;
+    }
+    //a value went into the ring
+    void wake_receiver()
+    {
+        std::atomic_thread_fence(std::memory_order::seq_cst);
+        if (receivers_waiting_.load(std::memory_order::relaxed) == 0) {
+            return;
+        }
+        std::unique_lock lock { mtx_ };
+        while (detail::RecvNode<T>* receiver = receivers_.front()) {
+            if (!receiver->waiter->acquire()) {
+                erase_receiver(receiver);
+                continue;
+            }
+            if (!ring_.pop(*receiver->value)) {
+                receiver->waiter->release();
+                return;
+            }
+            receiver->waiter->complete(receiver->index);
+            erase_receiver(receiver);
+            lock.unlock();
+            receiver->waiter->wake();
+            wake_sender();
+            return;
+        }
+    }
+    //a slot of the ring was freed, the first waiting sender takes it
+    void wake_sender()
+    {
+        std::atomic_thread_fence(std::memory_order::seq_cst);
+        if (senders_waiting_.load(std::memory_order::relaxed) == 0) {
+            return;
+        }
+        std::unique_lock lock { mtx_ };
+        auto* sender = static_cast<SendAwaiter*>(senders_.front());
+        if (sender == nullptr) {
+            return;
+        }
+        //a receiver parks only while the ring is empty, the value goes to it if one came meanwhile
+        detail::RecvNode<T>* receiver = claim_receiver();
+        if (receiver != nullptr) {
+            receiver->value->emplace(std::move(sender->value_));
+        } else if (!ring_.push(sender->value_)) {
+            return;
+        }
+        senders_.pop();
+        senders_waiting_.fetch_sub(1, std::memory_order::relaxed);
+        lock.unlock();
+        if (receiver != nullptr) {
+            receiver->waiter->wake();
+        }
+        sender->wake();
+    }
+    //the first receiver still waiting, claimed for a value at hand
+    detail::RecvNode<T>* claim_receiver()
+    {
+        while (detail::RecvNode<T>* receiver = receivers_.front()) {
+            erase_receiver(receiver);
+            if (receiver->waiter->claim(receiver->index)) {
+                return receiver;
+            }
+        }
+        return nullptr;
+    }
+    void erase_receiver(detail::RecvNode<T>* receiver)
+    {
+        receivers_.erase(receiver);
+        receivers_waiting_.fetch_sub(1, std::memory_order::relaxed);
+    }
+
+private:
+    detail::MpmcRing<T> ring_;
+    alignas(64) std::atomic<size_t> receivers_waiting_ { 0 };
+    std::atomic<size_t> senders_waiting_ { 0 };
     std::mutex mtx_;
+    detail::RecvQueue<T> receivers_;
+    detail::WaiterQueue senders_;
 };
 
-}
\ No newline at end of file
+//receives from a BoundedChannel in a select()
+template <typename T>
+class RecvCase {
+public:
+    using value_type = T;
+
+    explicit RecvCase(BoundedChannel<T>& channel)
+        : channel_(&channel)
+    {
+    }
+    //movable until the select() is awaited
+    RecvCase(RecvCase&& other) noexcept
+        : channel_(other.channel_)
+    {
+    }
+    bool poll() { return channel_->pop(value_); }
+    //false if the waiter was completed meanwhile
+    bool enroll(detail::RecvWaiter& waiter, size_t index)
+    {
+        node_.waiter = &waiter;
+        node_.value = &value_;
+        node_.index = index;
+        enrolled_ = true;
+        return channel_->park_receiver(node_);
+    }
+    void withdraw()
+    {
+        if (enrolled_) {
+            channel_->unpark_receiver(node_);
+        }
+    }
+    T result() { return std::move(*value_); }
+
+private:
+    BoundedChannel<T>* channel_;
+    std::optional<T> value_;
+    detail::RecvNode<T> node_;
+    bool enrolled_ { false };
+};
+
+//completes a select() once the duration passed
+class TimeoutCase {
+    //shared with the delayed task, which may run after the select() went on
+    struct Alarm {
+        std::mutex mtx;
+        detail::RecvWaiter* waiter { nullptr };
+        size_t index { 0 };
+        void fire()
+        {
+            std::unique_lock lock { mtx };
+            if (waiter == nullptr || !waiter->claim(index)) {
+                return;
+            }
+            detail::RecvWaiter* claimed = std::exchange(waiter, nullptr);
+            lock.unlock();
+            claimed->wake();
+        }
+    };
+
+public:
+    using value_type = std::monostate;
+
+    explicit TimeoutCase(std::chrono::milliseconds duration)
+        : duration_(duration)
+    {
+    }
+    bool poll() { return duration_.count() <= 0; }
+    bool enroll(detail::RecvWaiter& waiter, size_t index)
+    {
+        alarm_ = std::make_shared<Alarm>();
+        alarm_->waiter = &waiter;
+        alarm_->index = index;
+        get_current_executor()->post_delay(duration_, PriorityTask { Priority::Medium, [alarm = alarm_]() { alarm->fire(); } });
+        return true;
+    }
+    void withdraw()
+    {
+        if (alarm_ != nullptr) {
+            std::lock_guard lock { alarm_->mtx };
+            alarm_->waiter = nullptr;
+        }
+    }
+    std::monostate result() { return {}; }
+
+private:
+    std::chrono::milliseconds duration_;
+    std::shared_ptr<Alarm> alarm_;
+};
+
+template <typename Rep, typename Period>
+[[nodiscard]] TimeoutCase timeout_case(std::chrono::duration<Rep, Period> duration)
+{
+    return TimeoutCase { std::chrono::duration_cast<std::chrono::milliseconds>(duration) };
+}
+
+namespace detail {
+
+//Registers one RecvWaiter with every case in order, the case completing it first wins. The
+//others are unregistered once it is resumed, their nodes live in the awaiter.
+template <typename... Cases>
+class SelectAwaiter {
+public:
+    using Result = std::variant<typename Cases::value_type...>;
+
+    explicit SelectAwaiter(Cases&&... cases)
+        : cases_(std::move(cases)...)
+    {
+    }
+    SelectAwaiter(SelectAwaiter&& other) noexcept
+        : cases_(std::move(other.cases_))
+    {
+    }
+    bool await_ready() { return poll(std::index_sequence_for<Cases...> {}); }
+    AwaitInfo await_info() const { return { "select" }; }
+    bool await_suspend(std::coroutine_handle<> coroutine)
+    {
+        waiter_.park(coroutine);
+        const size_t stopped = enroll(std::index_sequence_for<Cases...> {});
+        //the case it stopped at completed it, no other side resumes it
+        if (stopped < sizeof...(Cases) && waiter_.index() == stopped) {
+            return false;
+        }
+        return !waiter_.arrive();
+    }
+    Result await_resume()
+    {
+        std::apply([](auto&... cases) { (cases.withdraw(), ...); }, cases_);
+        return take(ready_ < sizeof...(Cases) ? ready_ : waiter_.index());
+    }
+
+private:
+    template <size_t... Is>
+    bool poll(std::index_sequence<Is...>)
+    {
+        return ((std::get<Is>(cases_).poll() && (ready_ = Is, true)) || ...);
+    }
+    //the index of the case it stopped at, the number of cases if all are registered
+    template <size_t... Is>
+    size_t enroll(std::index_sequence<Is...>)
+    {
+        size_t stopped = sizeof...(Cases);
+        ((std::get<Is>(cases_).enroll(waiter_, Is) || (stopped = Is, false)) && ...);
+        return stopped;
+    }
+    template <size_t I = 0>
+    Result take(size_t index)
+    {
+        if constexpr (I + 1 < sizeof...(Cases)) {
+            if (index != I) {
+                return take<I + 1>(index);
+            }
+        }
+        return Result { std::in_place_index<I>, std::get<I>(cases_).result() };
+    }
+
+private:
+    std::tuple<Cases...> cases_;
+    RecvWaiter waiter_ { true };
+    size_t ready_ { sizeof...(Cases) };
+};
+
+} // namespace detail
+
+//Awaits the first ready of several cases, e.g.
+//    auto result = co_await select(commands.recv_case(), events.recv_case(), timeout_case(1s));
+//    if (result.index() == 0) { handle(std::get<0>(result)); }
+//Cases are polled in order first. Only one value is taken out of all channels, nothing is
+//allocated but the timer of a timeout_case().
+template <typename... Cases>
+[[nodiscard]] detail::SelectAwaiter<Cases...> select(Cases... cases)
+{
+    return detail::SelectAwaiter<Cases...> { std::move(cases)... };
+}
+
+} // namespace bco
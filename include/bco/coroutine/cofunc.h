@@ -9,6 +9,8 @@
 #include <concepts>
 
 #include "task.h"
+#include "when.h"
+#include "bco/cancellation.h"
 #include "bco/executor.h"
 
 namespace bco {
@@ -23,12 +25,41 @@ private:
     ExecutorInterface* executor_;
 };
 
+//Resumes early, on the executor it was awaited on, once the awaiting coroutine is cancelled.
 class DelayTask : public Task<> {
+    //shared with the delayed task, which may run after the coroutine went on
+    struct Timer {
+        std::coroutine_handle<> coroutine;
+        ExecutorInterface* executor;
+        size_t affinity;
+        std::atomic<bool> fired { false };
+        std::atomic<bool> suspended { false };
+        //the first of the timer and the cancellation resumes the coroutine, once it is suspended
+        void fire(bool on_executor);
+    };
+    struct Fire {
+        Timer* timer;
+        void operator()() const { timer->fire(false); }
+    };
+
 public:
     DelayTask(std::chrono::milliseconds duration);
-    void await_suspend(std::coroutine_handle<> coroutine) noexcept;
+    //movable until awaited, e.g. into when_any()
+    DelayTask(DelayTask&& other) noexcept;
+    template <typename Promise>
+    bool await_suspend(std::coroutine_handle<Promise> coroutine)
+    {
+        return suspend(coroutine, cancellation_token_of(coroutine));
+    }
+    void await_resume() { callback_.reset(); }
+
+private:
+    bool suspend(std::coroutine_handle<> coroutine, CancellationToken token);
+
 private:
     std::chrono::milliseconds duration_;
+    std::shared_ptr<Timer> timer_;
+    std::optional<CancellationCallback<Fire>> callback_;
 };
 
 template <typename T>
@@ -103,7 +134,6 @@ public:
         : Timeout { std::chrono::duration_cast<std::chrono::milliseconds>(duration) }
     {
     }
-    template <>
     explicit Timeout(std::chrono::milliseconds duration)
         : duration_ { duration }
     {
@@ -140,6 +170,21 @@ template <typename T>
     return detail::ExpirableTask { timeout.duration(), task };
 }
 
+//Cancels the awaitable once the timeout passed, its result if it finished before. A Func or a
+//socket operation is not left running behind, it is awaited until it saw the cancellation. What
+//it returns then, usually -ECANCELED but possibly an accepted socket, is dropped; await
+//when_any() with on_loser() to see it.
+template <typename A>
+requires(!std::invocable<A>)
+[[nodiscard]] Func<std::optional<detail::non_void_t<detail::await_result_t<A>>>> run_with(Timeout timeout, A awaitable)
+{
+    auto result = co_await when_any(std::move(awaitable), sleep_for(timeout.duration()));
+    if (result.index() != 0) {
+        co_return std::nullopt;
+    }
+    co_return std::move(std::get<0>(result));
+}
+
 template <typename Callable> requires std::invocable<Callable>
 [[nodiscard]] detail::ExpirableTaskAnyfunc<std::optional<std::invoke_result<Callable>>> run_with(Timeout timeout, Callable&& func)
 {
@@ -0,0 +1,144 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+#include <bco/accounting.h>
+#include <bco/cancellation.h>
+
+#ifndef BCO_ASYNC_TRACE_DEPTH
+#define BCO_ASYNC_TRACE_DEPTH 8
+#endif
+
+namespace bco {
+
+namespace detail {
+
+class LocalStorage;
+
+//What a coroutine is suspended on in an async stack dump, 'format' is a printf format with at
+//most one long long, e.g. { "TcpSocket::recv fd=%lld", fd }. Awaiters describe themselves
+//with an 'AwaitInfo await_info() const' member, the others are shown by their type.
+struct AwaitInfo {
+    const char* format { nullptr };
+    long long arg { 0 };
+};
+
+//Await chain of a Routine, kept in its promise so Context::dump_async_stacks() can read it
+//while the routine runs on another thread. Only plain values are stored, as relaxed atomics: a
+//dump may catch a stack while it changes but never follows a pointer into a Func that is gone.
+struct AsyncTrace {
+    struct Entry {
+        //resume function of the coroutine
+        std::atomic<void*> function { nullptr };
+        std::atomic<const char*> label { nullptr };
+    };
+    //Funcs deeper than the entries are counted but not recorded
+    std::atomic<uint32_t> depth { 0 };
+    std::atomic<const char*> await_format { nullptr };
+    std::atomic<long long> await_arg { 0 };
+    //see awaiter_signature(), null while the routine runs
+    std::atomic<const char*> await_type { nullptr };
+    Entry entries[BCO_ASYNC_TRACE_DEPTH];
+};
+
+//Logical call stack of the coroutines, one frame per Routine and Func.
+//'parent' is the Func or Routine awaiting this one, 'resumer' is whatever was running on this
+//thread when this one was resumed, it gets the thread back when this one suspends.
+struct CoroutineFrame {
+    void* address { nullptr };
+    CoroutineFrame* parent { nullptr };
+    CoroutineFrame* resumer { nullptr };
+    RoutineStats* stats { nullptr };
+    AsyncTrace* trace { nullptr };
+    //0 for the Routine
+    uint32_t depth { 0 };
+    //handed down to the Funcs it awaits and the operations they start
+    CancellationToken cancellation;
+    //the CoroutineLocal values of the Routine, shared by its Funcs
+    LocalStorage* locals { nullptr };
+};
+
+//innermost frame running on this thread, also read by the SIGPROF handler of the Profiler
+extern constinit thread_local std::atomic<CoroutineFrame*> current_frame;
+
+inline CoroutineFrame* get_current_frame()
+{
+    return current_frame.load(std::memory_order::relaxed);
+}
+
+inline void set_current_frame(CoroutineFrame* frame)
+{
+    //the frame must be complete before a signal handler can see it
+    std::atomic_signal_fence(std::memory_order::release);
+    current_frame.store(frame, std::memory_order::relaxed);
+}
+
+//the coroutine of 'frame' starts or continues running on this thread
+inline void enter_frame(CoroutineFrame* frame, bool resumed)
+{
+    frame->resumer = get_current_frame();
+    set_current_frame(frame);
+    begin_slice(frame->stats, resumed);
+}
+
+//the coroutine of 'frame' is about to suspend or finish
+inline void leave_frame(CoroutineFrame* frame)
+{
+    end_slice(frame->stats);
+    set_current_frame(frame->resumer);
+}
+
+//the type name is cut out of it when a dump is printed, storing it costs nothing
+template <typename Awaiter>
+const char* awaiter_signature()
+{
+#ifdef _MSC_VER
+    return __FUNCSIG__;
+#else
+    return __PRETTY_FUNCTION__;
+#endif
+}
+
+//'frame' got its address and parent, it runs on top of the trace of its parent
+inline void push_trace(CoroutineFrame& frame)
+{
+    frame.trace = frame.parent->trace;
+    frame.depth = frame.parent->depth + 1;
+    if (frame.trace == nullptr) {
+        return;
+    }
+    if (frame.depth < BCO_ASYNC_TRACE_DEPTH) {
+        auto& entry = frame.trace->entries[frame.depth];
+        //GCC, Clang and MSVC put the resume function pointer first in the coroutine frame
+        entry.function.store(*static_cast<void**>(frame.address), std::memory_order::relaxed);
+        entry.label.store(nullptr, std::memory_order::relaxed);
+    }
+    frame.trace->depth.store(frame.depth + 1, std::memory_order::relaxed);
+}
+
+inline void pop_trace(CoroutineFrame& frame)
+{
+    if (frame.trace != nullptr) {
+        frame.trace->depth.store(frame.depth, std::memory_order::relaxed);
+    }
+}
+
+inline void trace_suspend(CoroutineFrame& frame, AwaitInfo info, const char* signature)
+{
+    if (frame.trace != nullptr) {
+        frame.trace->await_format.store(info.format, std::memory_order::relaxed);
+        frame.trace->await_arg.store(info.arg, std::memory_order::relaxed);
+        frame.trace->await_type.store(signature, std::memory_order::relaxed);
+    }
+}
+
+inline void trace_resume(CoroutineFrame& frame)
+{
+    if (frame.trace != nullptr) {
+        frame.trace->await_type.store(nullptr, std::memory_order::relaxed);
+    }
+}
+
+} // namespace detail
+
+} // namespace bco
@@ -0,0 +1,44 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#ifndef BCO_FRAME_POOL
+#define BCO_FRAME_POOL 1
+#endif
+
+namespace bco {
+
+//The coroutine frames of Routines and Funcs come from thread local free lists, one per size
+//class of 64 bytes up to 4KiB, bigger frames straight from the heap. A frame freed on another
+//thread goes back to the thread which allocated it, in batches.
+//Building with BCO_FRAME_POOL=OFF allocates every frame from the heap.
+struct FramePoolStats {
+    static constexpr size_t kGranularity = 64;
+    static constexpr size_t kSizeClasses = 64;
+
+    uint64_t allocations = 0;
+    //served from a free list instead of the heap
+    uint64_t hits = 0;
+    //bigger than the largest size class
+    uint64_t large = 0;
+    //freed on another thread than the one which allocated it
+    uint64_t remote_frees = 0;
+    //allocations per size class, class i holds frames of up to (i + 1) * kGranularity bytes
+    //including a 16 byte header
+    std::array<uint64_t, kSizeClasses> size_classes {};
+
+    double hit_rate() const { return allocations == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(allocations); }
+};
+
+//sum over all threads, all zero when built without the pool
+FramePoolStats frame_pool_stats();
+
+namespace detail {
+
+void* allocate_frame(size_t size);
+void deallocate_frame(void* frame) noexcept;
+
+} // namespace detail
+
+} // namespace bco
@@ -0,0 +1,165 @@
+#pragma once
+#include <coroutine>
+#include <exception>
+#include <type_traits>
+#include <utility>
+
+#include "bco/cancellation.h"
+#include "frame_pool.h"
+#include "task.h"
+
+namespace bco {
+
+template <typename T>
+class Generator;
+
+namespace detail {
+
+template <typename T>
+class GeneratorPromise {
+    //the generator runs on top of the consumer between next() and co_yield, like an awaited Func
+    struct YieldAwaiter {
+        bool await_ready() noexcept { return false; }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<GeneratorPromise> coroutine) noexcept
+        {
+            auto& promise = coroutine.promise();
+            unlink_frame(promise.frame_);
+            return promise.consumer_;
+        }
+        void await_resume() noexcept { }
+    };
+
+public:
+#if BCO_FRAME_POOL
+    static void* operator new(size_t size) { return allocate_frame(size); }
+    static void operator delete(void* frame) noexcept { deallocate_frame(frame); }
+#endif
+    Generator<T> get_return_object();
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    YieldAwaiter final_suspend() noexcept
+    {
+        value_ = nullptr;
+        return {};
+    }
+    //the value stays in the generator frame until the consumer asks for the next one
+    YieldAwaiter yield_value(std::remove_reference_t<T>& value) noexcept
+    {
+        value_ = std::addressof(value);
+        return {};
+    }
+    YieldAwaiter yield_value(std::remove_reference_t<T>&& value) noexcept
+    {
+        value_ = std::addressof(value);
+        return {};
+    }
+    void unhandled_exception() { exception_ = std::current_exception(); }
+    void return_void() { }
+    template <typename A>
+    auto await_transform(A&& awaitable)
+    {
+        return track_await(std::forward<A>(awaitable), &frame_);
+    }
+    CoroutineFrame& frame() { return frame_; }
+    CancellationToken cancellation_token() const { return frame_.cancellation; }
+    LocalStorage* locals() const { return frame_.locals; }
+
+private:
+    template <typename U>
+    friend class GeneratorNextAwaiter;
+
+    std::remove_reference_t<T>* value_ = nullptr;
+    std::exception_ptr exception_;
+    std::coroutine_handle<> consumer_;
+    CoroutineFrame frame_;
+};
+
+//resumes the generator until its next co_yield, a null pointer once it returned
+template <typename T>
+class GeneratorNextAwaiter {
+public:
+    explicit GeneratorNextAwaiter(std::coroutine_handle<GeneratorPromise<T>> coroutine)
+        : coroutine_(coroutine)
+    {
+    }
+    bool await_ready() const noexcept { return coroutine_.done(); }
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> consumer) noexcept
+    {
+        auto& promise = coroutine_.promise();
+        promise.consumer_ = consumer;
+        link_frame(promise.frame_, coroutine_.address(), consumer);
+        return coroutine_;
+    }
+    std::remove_reference_t<T>* await_resume()
+    {
+        auto& promise = coroutine_.promise();
+        if (promise.exception_) {
+            std::rethrow_exception(std::exchange(promise.exception_, nullptr));
+        }
+        return promise.value_;
+    }
+
+private:
+    std::coroutine_handle<GeneratorPromise<T>> coroutine_;
+};
+
+template <typename T>
+struct IsFuncAwaitable<GeneratorNextAwaiter<T>> : std::true_type { };
+
+} // namespace detail
+
+//Lazy coroutine producing a stream with co_yield, its body may co_await anything a Func can.
+//Nothing runs until the consumer awaits next(), the generator then runs on the consumer's thread
+//until its next co_yield and transfers straight back, there is no queue or lock in between:
+//  Generator<Message> messages(TcpSocket& socket);
+//  auto stream = messages(socket);
+//  while (auto* message = co_await stream.next()) {
+//      handle(*message);
+//  }
+//The pointer is valid until next() is awaited again. An exception leaving the body is rethrown
+//by next(). The generator takes the cancellation token and the locals of the coroutine awaiting
+//next().
+template <typename T>
+class Generator {
+public:
+    using promise_type = detail::GeneratorPromise<T>;
+
+    Generator(Generator&& other) noexcept
+        : coroutine_(std::exchange(other.coroutine_, nullptr))
+    {
+    }
+    Generator& operator=(Generator&& other) noexcept
+    {
+        if (this != &other) {
+            if (coroutine_) {
+                coroutine_.destroy();
+            }
+            coroutine_ = std::exchange(other.coroutine_, nullptr);
+        }
+        return *this;
+    }
+    //a generator suspended at a co_yield may be dropped, its frame is destroyed
+    ~Generator()
+    {
+        if (coroutine_) {
+            coroutine_.destroy();
+        }
+    }
+    detail::GeneratorNextAwaiter<T> next() { return detail::GeneratorNextAwaiter<T> { coroutine_ }; }
+
+private:
+    friend promise_type;
+    explicit Generator(std::coroutine_handle<promise_type> coroutine)
+        : coroutine_(coroutine)
+    {
+    }
+    std::coroutine_handle<promise_type> coroutine_;
+};
+
+template <typename T>
+Generator<T> detail::GeneratorPromise<T>::get_return_object()
+{
+    return Generator<T> { std::coroutine_handle<GeneratorPromise>::from_promise(*this) };
+}
+
+} // namespace bco
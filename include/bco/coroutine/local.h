@@ -0,0 +1,135 @@
+#pragma once
+#include <coroutine>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "frame.h"
+
+namespace bco {
+
+namespace detail {
+
+//how the values of one CoroutineLocal are copied into a spawned routine and destroyed
+struct LocalType {
+    void* (*copy)(const void* value);
+    void (*destroy)(void* value);
+};
+
+template <typename T>
+inline constexpr LocalType local_type_of {
+    [](const void* value) -> void* { return new T(*static_cast<const T*>(value)); },
+    [](void* value) { delete static_cast<T*>(value); },
+};
+
+//The values of the CoroutineLocals of one Routine, in its promise. A CoroutineLocal is an index
+//into it, each value is allocated on its own when it is first set.
+class LocalStorage {
+public:
+    LocalStorage() = default;
+    LocalStorage(const LocalStorage&) = delete;
+    LocalStorage& operator=(const LocalStorage&) = delete;
+    ~LocalStorage();
+
+    void* get(size_t index) const { return index < slots_.size() ? slots_[index].value : nullptr; }
+    //takes 'value', null clears the slot
+    void set(size_t index, void* value, const LocalType* type);
+    //copies the values of 'parent', for a routine it spawned
+    void inherit(const LocalStorage& parent);
+    bool empty() const { return slots_.empty(); }
+
+    static size_t next_index();
+
+private:
+    struct Slot {
+        void* value { nullptr };
+        const LocalType* type { nullptr };
+    };
+    std::vector<Slot> slots_;
+};
+
+//set by Context::spawn for the Routine it creates on the executor, the locals of the spawner
+extern constinit thread_local const LocalStorage* spawning_locals;
+
+//the locals of the Routine running on this thread, null outside a coroutine
+inline LocalStorage* current_locals()
+{
+    auto* frame = get_current_frame();
+    return frame != nullptr ? frame->locals : nullptr;
+}
+
+//the locals of the awaiting coroutine, none if its promise has no locals()
+template <typename Promise>
+LocalStorage* locals_of(std::coroutine_handle<Promise> coroutine)
+{
+    if constexpr (requires { coroutine.promise().locals(); }) {
+        return coroutine.promise().locals();
+    } else {
+        return nullptr;
+    }
+}
+
+} // namespace detail
+
+//A value per Routine, reached through the current coroutine of the thread, e.g. the trace id of
+//the request a routine serves:
+//    inline bco::CoroutineLocal<uint64_t> trace_id;
+//    trace_id.set(id);
+//    if (const uint64_t* id = trace_id.get()) { ... }
+//The Funcs and Generators a routine awaits share its values. The children of its when_all()/
+//when_any(), which run concurrently, and the routines it spawns start with copies of them.
+//Outside a coroutine get() returns null and set() does nothing.
+//The slots live in the promise but every value is a heap allocation: emplace() allocates each
+//time, set() only when the routine has no value yet. Every CoroutineLocal takes a slot for good,
+//they are meant to be globals.
+template <typename T>
+class CoroutineLocal {
+    static_assert(std::is_copy_constructible_v<T>, "the values are copied into spawned routines");
+
+public:
+    CoroutineLocal()
+        : index_(detail::LocalStorage::next_index())
+    {
+    }
+    CoroutineLocal(const CoroutineLocal&) = delete;
+    CoroutineLocal& operator=(const CoroutineLocal&) = delete;
+
+    T* get() const
+    {
+        auto* locals = detail::current_locals();
+        return locals != nullptr ? static_cast<T*>(locals->get(index_)) : nullptr;
+    }
+    template <typename... Args>
+    T* emplace(Args&&... args)
+    {
+        auto* locals = detail::current_locals();
+        if (locals == nullptr) {
+            return nullptr;
+        }
+        auto* value = new T(std::forward<Args>(args)...);
+        locals->set(index_, value, &detail::local_type_of<T>);
+        return value;
+    }
+    void set(T value)
+    {
+        if constexpr (std::is_move_assignable_v<T>) {
+            if (T* current = get()) {
+                *current = std::move(value);
+                return;
+            }
+        }
+        emplace(std::move(value));
+    }
+    void reset()
+    {
+        if (auto* locals = detail::current_locals()) {
+            locals->set(index_, nullptr, nullptr);
+        }
+    }
+
+private:
+    const size_t index_;
+};
+
+} // namespace bco
@@ -0,0 +1,302 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <coroutine>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include <bco/utils.h>
+#include "task.h"
+
+namespace bco {
+
+namespace detail {
+
+//Parking slot of the one coroutine waiting on a side of one or more rings.
+//The waiter publishes itself and then re-checks the ring, the other side changes the ring and
+//then checks for a waiter. With a full fence on both sides at least one of them sees the other,
+//whoever clears 'parked_' first owns the wakeup.
+class Doorbell {
+public:
+    void park(std::coroutine_handle<> coroutine)
+    {
+        assert(!parked_.load(std::memory_order::relaxed));
+        coroutine_ = coroutine;
+        executor_ = get_current_executor();
+        affinity_ = get_current_worker_index(executor_);
+        parked_.store(true, std::memory_order::release);
+        std::atomic_thread_fence(std::memory_order::seq_cst);
+    }
+    //true if the waiter took itself back, false if someone is already resuming it
+    bool unpark()
+    {
+        return parked_.exchange(false, std::memory_order::acq_rel);
+    }
+    void ring()
+    {
+        std::atomic_thread_fence(std::memory_order::seq_cst);
+        if (parked_.load(std::memory_order::relaxed) && parked_.exchange(false, std::memory_order::acq_rel)) {
+            resume_on(executor_, coroutine_, affinity_);
+        }
+    }
+
+private:
+    std::atomic<bool> parked_ { false };
+    std::coroutine_handle<> coroutine_;
+    ExecutorInterface* executor_ { nullptr };
+    size_t affinity_ { kAnyWorker };
+};
+
+//Bounded single producer single consumer ring, capacity is rounded up to a power of two.
+//Each side caches the other side's index and only reloads it when the cache says full/empty.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity)
+        : mask_(std::bit_ceil(std::max(capacity, size_t { 2 })) - 1)
+        , slots_(mask_ + 1)
+    {
+    }
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    bool push(T& value)
+    {
+        const size_t tail = tail_.load(std::memory_order::relaxed);
+        if (tail - cached_head_ > mask_) {
+            cached_head_ = head_.load(std::memory_order::acquire);
+            if (tail - cached_head_ > mask_) {
+                return false;
+            }
+        }
+        slots_[tail & mask_].emplace(std::move(value));
+        tail_.store(tail + 1, std::memory_order::release);
+        return true;
+    }
+    size_t pop(std::vector<T>& out, size_t max)
+    {
+        const size_t head = head_.load(std::memory_order::relaxed);
+        if (cached_tail_ == head) {
+            cached_tail_ = tail_.load(std::memory_order::acquire);
+        }
+        const size_t count = std::min(cached_tail_ - head, max);
+        for (size_t i = 0; i < count; i++) {
+            auto& slot = slots_[(head + i) & mask_];
+            out.push_back(std::move(*slot));
+            slot.reset();
+        }
+        if (count > 0) {
+            head_.store(head + count, std::memory_order::release);
+        }
+        return count;
+    }
+    bool empty() const { return tail_.load(std::memory_order::acquire) == head_.load(std::memory_order::acquire); }
+    bool full() const { return tail_.load(std::memory_order::acquire) - head_.load(std::memory_order::acquire) > mask_; }
+    size_t size() const { return tail_.load(std::memory_order::acquire) - head_.load(std::memory_order::acquire); }
+
+private:
+    const size_t mask_;
+    std::vector<std::optional<T>> slots_;
+    alignas(64) std::atomic<size_t> head_ { 0 };
+    size_t cached_tail_ { 0 };
+    alignas(64) std::atomic<size_t> tail_ { 0 };
+    size_t cached_head_ { 0 };
+};
+
+//Source: size_t drain(std::vector<T>&, size_t max), bool empty(), Doorbell& receiver_bell()
+template <typename Source, typename T>
+class RecvAwaiter {
+public:
+    RecvAwaiter(Source& source, size_t max)
+        : source_(source)
+        , max_(std::max(max, size_t { 1 }))
+    {
+    }
+    bool await_ready() { return source_.drain(items_, max_) > 0; }
+    AwaitInfo await_info() const { return { "Mailbox::recv" }; }
+    bool await_suspend(std::coroutine_handle<> coroutine)
+    {
+        auto& bell = source_.receiver_bell();
+        bell.park(coroutine);
+        if (!source_.empty() && bell.unpark()) {
+            return false;
+        }
+        return true;
+    }
+    std::vector<T> await_resume()
+    {
+        if (items_.empty()) {
+            source_.drain(items_, max_);
+        }
+        return std::move(items_);
+    }
+
+private:
+    Source& source_;
+    const size_t max_;
+    std::vector<T> items_;
+};
+
+} // namespace detail
+
+template <typename T>
+class MailboxGrid;
+
+//Bounded mailbox from one sender to one receiver, typically two Contexts on different threads.
+//send() suspends while the mailbox is full, recv() suspends while it is empty and then returns
+//everything available up to 'max' at once. Neither side takes a lock or allocates per message,
+//the executor is only involved when a parked side has to be woken up.
+//At most one coroutine may be sending and one receiving at any time.
+template <typename T>
+class Mailbox {
+public:
+    static constexpr size_t kDefaultBatch = 64;
+
+    class SendAwaiter {
+    public:
+        SendAwaiter(Mailbox& mailbox, T&& value)
+            : mailbox_(mailbox)
+            , value_(std::move(value))
+        {
+        }
+        bool await_ready() { return sent_ = mailbox_.try_send(value_); }
+        detail::AwaitInfo await_info() const { return { "Mailbox::send" }; }
+        bool await_suspend(std::coroutine_handle<> coroutine)
+        {
+            mailbox_.space_bell_.park(coroutine);
+            if (!mailbox_.ring_.full() && mailbox_.space_bell_.unpark()) {
+                return false;
+            }
+            return true;
+        }
+        void await_resume()
+        {
+            if (!sent_) {
+                sent_ = mailbox_.try_send(value_);
+                assert(sent_ && "Mailbox: more than one sender");
+            }
+        }
+
+    private:
+        Mailbox& mailbox_;
+        T value_;
+        bool sent_ { false };
+    };
+
+    explicit Mailbox(size_t capacity = 1024)
+        : ring_(capacity)
+        , receiver_bell_(&own_bell_)
+    {
+    }
+    Mailbox(const Mailbox&) = delete;
+    Mailbox& operator=(const Mailbox&) = delete;
+
+    //moves from 'value' only on success
+    bool try_send(T& value)
+    {
+        if (!ring_.push(value)) {
+            return false;
+        }
+        receiver_bell_->ring();
+        return true;
+    }
+    [[nodiscard]] SendAwaiter send(T value) { return SendAwaiter { *this, std::move(value) }; }
+
+    size_t try_recv(std::vector<T>& out, size_t max = kDefaultBatch) { return drain(out, max); }
+    [[nodiscard]] detail::RecvAwaiter<Mailbox, T> recv(size_t max = kDefaultBatch) { return { *this, max }; }
+
+    size_t size() const { return ring_.size(); }
+
+private:
+    friend class detail::RecvAwaiter<Mailbox, T>;
+    friend class MailboxGrid<T>;
+
+    Mailbox(size_t capacity, detail::Doorbell* receiver_bell)
+        : ring_(capacity)
+        , receiver_bell_(receiver_bell)
+    {
+    }
+    size_t drain(std::vector<T>& out, size_t max)
+    {
+        size_t count = ring_.pop(out, max);
+        if (count > 0) {
+            space_bell_.ring();
+        }
+        return count;
+    }
+    bool empty() const { return ring_.empty(); }
+    detail::Doorbell& receiver_bell() { return *receiver_bell_; }
+
+private:
+    detail::SpscRing<T> ring_;
+    detail::Doorbell space_bell_;
+    detail::Doorbell own_bell_;
+    detail::Doorbell* receiver_bell_;
+};
+
+//One Mailbox per directed pair of 'contexts' participants, e.g. one Context per shard:
+//    co_await grid.send(my_shard, other_shard, std::move(msg));
+//    for (auto& msg : co_await grid.recv(my_shard)) { ... }
+//recv() drains all mailboxes addressed to a participant round robin and parks on a single
+//doorbell shared by them, so one sender that is never idle cannot starve the others.
+template <typename T>
+class MailboxGrid {
+public:
+    MailboxGrid(size_t contexts, size_t capacity = 1024)
+        : size_(contexts)
+    {
+        inboxes_.reserve(size_);
+        for (size_t to = 0; to < size_; to++) {
+            inboxes_.push_back(std::make_unique<Inbox>());
+        }
+        mailboxes_.reserve(size_ * size_);
+        for (size_t from = 0; from < size_; from++) {
+            for (size_t to = 0; to < size_; to++) {
+                mailboxes_.push_back(std::unique_ptr<Mailbox<T>> { new Mailbox<T> { capacity, &inboxes_[to]->bell } });
+            }
+        }
+        for (size_t to = 0; to < size_; to++) {
+            for (size_t from = 0; from < size_; from++) {
+                inboxes_[to]->mailboxes.push_back(&between(from, to));
+            }
+        }
+    }
+
+    size_t size() const { return size_; }
+    Mailbox<T>& between(size_t from, size_t to) { return *mailboxes_[from * size_ + to]; }
+
+    [[nodiscard]] auto send(size_t from, size_t to, T value) { return between(from, to).send(std::move(value)); }
+    [[nodiscard]] auto recv(size_t to, size_t max = Mailbox<T>::kDefaultBatch) { return detail::RecvAwaiter<Inbox, T> { *inboxes_[to], max }; }
+
+private:
+    class Inbox {
+    public:
+        size_t drain(std::vector<T>& out, size_t max)
+        {
+            size_t count = 0;
+            for (size_t i = 0; i < mailboxes.size() && count < max; i++) {
+                count += mailboxes[(next + i) % mailboxes.size()]->drain(out, max - count);
+            }
+            next = (next + 1) % mailboxes.size();
+            return count;
+        }
+        bool empty() const
+        {
+            return std::ranges::all_of(mailboxes, [](const Mailbox<T>* mailbox) { return mailbox->empty(); });
+        }
+        detail::Doorbell& receiver_bell() { return bell; }
+
+        detail::Doorbell bell;
+        std::vector<Mailbox<T>*> mailboxes;
+        size_t next { 0 };
+    };
+private:
+    const size_t size_;
+    std::vector<std::unique_ptr<Inbox>> inboxes_;
+    std::vector<std::unique_ptr<Mailbox<T>>> mailboxes_;
+};
+
+} // namespace bco
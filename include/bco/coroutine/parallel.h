@@ -0,0 +1,211 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <optional>
+#include <ranges>
+#include <vector>
+
+#include <bco/executor.h>
+#include <bco/utils.h>
+#include "task.h"
+
+namespace bco {
+
+namespace detail {
+
+//Splits [0, chunks) recursively: the right half is posted to the executor, which puts it on
+//the current worker's queue so that idle workers can steal it, the left half keeps running here.
+//The last finished chunk joins and resumes the awaiting coroutine, no thread ever blocks.
+template <typename Derived, typename T>
+class ForkJoinTask : public Task<T> {
+public:
+    ForkJoinTask(ExecutorInterface* executor, size_t chunks)
+        : executor_(executor)
+        , chunks_(chunks)
+        , pending_ { chunks }
+    {
+    }
+    ForkJoinTask(const ForkJoinTask&) = delete;
+    ForkJoinTask& operator=(const ForkJoinTask&) = delete;
+
+    //an empty range joins right away, not in the constructor where Derived is not built yet
+    bool await_ready()
+    {
+        if (chunks_ == 0) {
+            finish();
+            return true;
+        }
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> coroutine) noexcept
+    {
+        this->ctx_->caller_coroutine_ = coroutine;
+        fork(0, chunks_);
+    }
+
+private:
+    void fork(size_t first, size_t last)
+    {
+        while (last - first > 1 && executor_ != nullptr) {
+            const size_t mid = first + (last - first) / 2;
+            executor_->post(PriorityTask {
+                .priority = Priority::Medium,
+                .task = [this, mid, last]() { fork(mid, last); } });
+            last = mid;
+        }
+        for (size_t chunk = first; chunk < last; chunk++) {
+            static_cast<Derived*>(this)->run_chunk(chunk);
+            if (pending_.fetch_sub(1, std::memory_order::acq_rel) == 1) {
+                finish();
+                //the awaiting coroutine may be gone after this
+                this->resume();
+                return;
+            }
+        }
+    }
+    void finish()
+    {
+        if constexpr (std::is_void_v<T>) {
+            static_cast<Derived*>(this)->join();
+            this->set_done(true);
+        } else {
+            this->set_result(static_cast<Derived*>(this)->join());
+        }
+    }
+
+protected:
+    ExecutorInterface* executor_;
+    const size_t chunks_;
+    std::atomic<size_t> pending_;
+};
+
+inline size_t chunk_count(size_t size, size_t grain)
+{
+    grain = std::max(grain, size_t { 1 });
+    return (size + grain - 1) / grain;
+}
+
+template <typename View, typename Fn>
+class ParallelForTask : public ForkJoinTask<ParallelForTask<View, Fn>, void> {
+    using SuperType = ForkJoinTask<ParallelForTask<View, Fn>, void>;
+    friend SuperType;
+
+public:
+    ParallelForTask(ExecutorInterface* executor, View view, size_t grain, Fn fn)
+        : SuperType(executor, chunk_count(std::ranges::size(view), grain))
+        , view_(std::move(view))
+        , grain_(std::max(grain, size_t { 1 }))
+        , fn_(std::move(fn))
+    {
+    }
+
+private:
+    void run_chunk(size_t chunk)
+    {
+        const size_t size = std::ranges::size(view_);
+        auto first = std::ranges::begin(view_) + chunk * grain_;
+        auto last = std::ranges::begin(view_) + std::min(size, (chunk + 1) * grain_);
+        for (; first != last; ++first) {
+            std::invoke(fn_, *first);
+        }
+    }
+    void join() { }
+
+private:
+    View view_;
+    const size_t grain_;
+    Fn fn_;
+};
+
+template <typename View, typename T, typename Op>
+class ParallelReduceTask : public ForkJoinTask<ParallelReduceTask<View, T, Op>, T> {
+    using SuperType = ForkJoinTask<ParallelReduceTask<View, T, Op>, T>;
+    friend SuperType;
+
+public:
+    ParallelReduceTask(ExecutorInterface* executor, View view, size_t grain, T init, Op op)
+        : SuperType(executor, chunk_count(std::ranges::size(view), grain))
+        , view_(std::move(view))
+        , grain_(std::max(grain, size_t { 1 }))
+        , init_(std::move(init))
+        , op_(std::move(op))
+        , partials_(this->chunks_)
+    {
+    }
+
+private:
+    void run_chunk(size_t chunk)
+    {
+        const size_t size = std::ranges::size(view_);
+        auto first = std::ranges::begin(view_) + chunk * grain_;
+        auto last = std::ranges::begin(view_) + std::min(size, (chunk + 1) * grain_);
+        T partial = *first;
+        for (++first; first != last; ++first) {
+            partial = std::invoke(op_, std::move(partial), *first);
+        }
+        partials_[chunk].emplace(std::move(partial));
+    }
+    //chunks are combined in order, so op only has to be associative
+    T join()
+    {
+        T result = std::move(init_);
+        for (auto& partial : partials_) {
+            result = std::invoke(op_, std::move(result), std::move(*partial));
+        }
+        return result;
+    }
+
+private:
+    View view_;
+    const size_t grain_;
+    T init_;
+    Op op_;
+    std::vector<std::optional<T>> partials_;
+};
+
+} // namespace detail
+
+//co_await bco::parallel_for(items, 1024, [](auto& item) { ... });
+//fn is invoked once per element, grain is the number of elements processed by one piece of work
+template <std::ranges::random_access_range R, typename Fn>
+requires std::ranges::sized_range<R> && std::ranges::viewable_range<R>
+[[nodiscard]] auto parallel_for(R&& range, size_t grain, Fn fn)
+{
+    using View = std::views::all_t<R>;
+    return detail::ParallelForTask<View, Fn> { get_current_executor(), std::views::all(std::forward<R>(range)), grain, std::move(fn) };
+}
+
+//co_await bco::parallel_reduce(items, 1024, 0, std::plus {});
+template <std::ranges::random_access_range R, typename T, typename Op = std::plus<>>
+requires std::ranges::sized_range<R> && std::ranges::viewable_range<R>
+[[nodiscard]] auto parallel_reduce(R&& range, size_t grain, T init, Op op = {})
+{
+    using View = std::views::all_t<R>;
+    return detail::ParallelReduceTask<View, T, Op> { get_current_executor(), std::views::all(std::forward<R>(range)), grain, std::move(init), std::move(op) };
+}
+
+//Sorts chunks of 'grain' elements in parallel, then merges them pairwise in parallel rounds.
+//The range must stay alive until the returned Func has been awaited.
+template <std::ranges::random_access_range R, typename Compare = std::ranges::less>
+requires std::ranges::sized_range<R> && std::sortable<std::ranges::iterator_t<R>, Compare>
+[[nodiscard]] Func<> parallel_sort(R& range, size_t grain, Compare comp = {})
+{
+    const size_t size = std::ranges::size(range);
+    grain = std::max(grain, size_t { 1 });
+    auto first = std::ranges::begin(range);
+    auto at = [first, size](size_t index) { return first + std::min(index, size); };
+
+    co_await parallel_for(std::views::iota(size_t { 0 }, detail::chunk_count(size, grain)), 1,
+        [&](size_t chunk) { std::sort(at(chunk * grain), at((chunk + 1) * grain), comp); });
+    for (size_t width = grain; width < size; width *= 2) {
+        co_await parallel_for(std::views::iota(size_t { 0 }, detail::chunk_count(size, width * 2)), 1,
+            [&](size_t pair) {
+                const size_t start = pair * width * 2;
+                std::inplace_merge(at(start), at(start + width), at(start + width * 2), comp);
+            });
+    }
+}
+
+} // namespace bco
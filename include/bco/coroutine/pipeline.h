@@ -0,0 +1,696 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <bco/context.h>
+#include <bco/utils.h>
+#include "task.h"
+
+namespace bco {
+
+enum class Ordering {
+    Unordered,
+    Preserve,
+};
+
+struct StageOptions {
+    size_t parallelism = 1;
+    //Bound of the queue the stage writes into. With Ordering::Preserve the one of the last stage
+    //also bounds how far the pipeline runs ahead of its oldest unfinished item.
+    size_t capacity = 64;
+    //max items a worker takes from its input queue at once
+    size_t batch = 1;
+};
+
+struct StageStats {
+    std::string name;
+    size_t parallelism;
+    size_t queue_depth;
+    uint64_t processed;
+    double throughput;
+};
+
+namespace detail {
+
+//The first queue of an ordered pipeline, the ordered last one tells it up to which sequence
+//number it released the items.
+class SequenceSource {
+public:
+    virtual ~SequenceSource() = default;
+    virtual void release(uint64_t next) = 0;
+};
+
+//Where the stages report an item their callable threw on. The first exception is kept for
+//Pipeline::pop() to rethrow, the lost item is dropped, see PipelineFailures.
+class FailureSink {
+public:
+    virtual ~FailureSink() = default;
+    void fail(uint64_t seq, std::exception_ptr error)
+    {
+        {
+            std::lock_guard lock { mtx_ };
+            if (!failed_) {
+                failed_ = true;
+                error_ = std::move(error);
+            }
+        }
+        drop(seq);
+    }
+    //the first exception, handed out once
+    std::exception_ptr take()
+    {
+        std::lock_guard lock { mtx_ };
+        return std::exchange(error_, nullptr);
+    }
+
+protected:
+    virtual void drop(uint64_t seq) = 0;
+
+private:
+    std::mutex mtx_;
+    bool failed_ = false;
+    std::exception_ptr error_;
+};
+
+//Bounded queue between two pipeline stages.
+//Pushers suspend while it is full, poppers suspend while it is empty, both are resumed
+//on the executor they suspended on. Items carry the sequence number given at the source,
+//an ordered queue releases them in that order.
+template <typename T>
+class StageQueue : public SequenceSource {
+public:
+    struct Item {
+        uint64_t seq;
+        T value;
+    };
+
+private:
+    struct Waiter {
+        std::coroutine_handle<> coroutine;
+        ExecutorInterface* executor;
+        size_t affinity;
+    };
+    //what to do once the lock is released
+    struct Wakeups {
+        std::vector<Waiter> waiters;
+        uint64_t released = 0;
+    };
+
+public:
+    class PushAwaiter {
+    public:
+        PushAwaiter(StageQueue& queue, std::vector<Item>&& items)
+            : queue_(queue)
+            , items_(std::move(items))
+        {
+        }
+        bool await_ready() { return queue_.try_push(*this); }
+        AwaitInfo await_info() const { return { "StageQueue::push" }; }
+        bool await_suspend(std::coroutine_handle<> coroutine)
+        {
+            auto* executor = get_current_executor();
+            waiter_ = Waiter { coroutine, executor, get_current_worker_index(executor) };
+            return queue_.park(*this);
+        }
+        //false if the queue was closed before all items got in
+        bool await_resume() { return !dropped_; }
+
+    private:
+        friend class StageQueue;
+        StageQueue& queue_;
+        std::vector<Item> items_;
+        size_t offset_ = 0;
+        bool dropped_ = false;
+        Waiter waiter_ {};
+    };
+
+    class PopAwaiter {
+    public:
+        PopAwaiter(StageQueue& queue, size_t max)
+            : queue_(queue)
+            , max_(std::max(max, size_t { 1 }))
+        {
+        }
+        bool await_ready() { return queue_.try_pop(*this); }
+        AwaitInfo await_info() const { return { "StageQueue::pop" }; }
+        bool await_suspend(std::coroutine_handle<> coroutine)
+        {
+            auto* executor = get_current_executor();
+            waiter_ = Waiter { coroutine, executor, get_current_worker_index(executor) };
+            return queue_.park(*this);
+        }
+        //empty once the queue is closed and drained
+        std::vector<Item> await_resume() { return std::move(batch_); }
+
+    private:
+        friend class StageQueue;
+        StageQueue& queue_;
+        const size_t max_;
+        std::vector<Item> batch_;
+        Waiter waiter_ {};
+    };
+
+public:
+    StageQueue(size_t capacity)
+        : capacity_(std::max(capacity, size_t { 1 }))
+    {
+    }
+    [[nodiscard]] PushAwaiter push(std::vector<Item>&& items) { return PushAwaiter { *this, std::move(items) }; }
+    [[nodiscard]] PopAwaiter pop(size_t max) { return PopAwaiter { *this, max }; }
+    //the source numbers the items it takes
+    void set_numbering() { numbering_ = true; }
+    //the numbering source of this ordered queue, kept at most 'capacity' items ahead of it
+    void set_ordered(std::shared_ptr<SequenceSource> source)
+    {
+        ordered_ = true;
+        source_ = std::move(source);
+    }
+    void set_window(size_t window) { window_ = window; }
+    size_t capacity() const { return capacity_; }
+    void release(uint64_t next) override
+    {
+        Wakeups ready;
+        {
+            std::lock_guard lock { mtx_ };
+            released_ = std::max(released_, next);
+            pump(ready);
+        }
+        wake(ready);
+    }
+    void close()
+    {
+        Wakeups ready;
+        {
+            std::lock_guard lock { mtx_ };
+            closed_ = true;
+            pump(ready);
+        }
+        wake(ready);
+    }
+    //the item 'seq' was lost on the way, an ordered queue stops waiting for it
+    void skip(uint64_t seq)
+    {
+        Wakeups ready;
+        {
+            std::lock_guard lock { mtx_ };
+            if (ordered_) {
+                skipped_.insert(seq);
+                release_in_order();
+                pump(ready);
+            }
+        }
+        wake(ready);
+    }
+    size_t size()
+    {
+        std::lock_guard lock { mtx_ };
+        return items_.size() + reorder_.size();
+    }
+
+private:
+    bool try_push(PushAwaiter& awaiter)
+    {
+        Wakeups ready;
+        bool done;
+        {
+            std::lock_guard lock { mtx_ };
+            fill(awaiter);
+            done = awaiter.dropped_ || awaiter.offset_ == awaiter.items_.size();
+            pump(ready);
+        }
+        wake(ready);
+        return done;
+    }
+    bool try_pop(PopAwaiter& awaiter)
+    {
+        Wakeups ready;
+        bool done;
+        {
+            std::lock_guard lock { mtx_ };
+            drain(awaiter);
+            done = !awaiter.batch_.empty() || closed_;
+            pump(ready);
+        }
+        wake(ready);
+        return done;
+    }
+    //second look under the lock before suspending, the other side may have moved meanwhile
+    bool park(PushAwaiter& awaiter)
+    {
+        Wakeups ready;
+        bool suspend;
+        {
+            std::lock_guard lock { mtx_ };
+            fill(awaiter);
+            suspend = !awaiter.dropped_ && awaiter.offset_ < awaiter.items_.size();
+            if (suspend) {
+                pushers_.push_back(&awaiter);
+            }
+            pump(ready);
+        }
+        wake(ready);
+        return suspend;
+    }
+    bool park(PopAwaiter& awaiter)
+    {
+        Wakeups ready;
+        bool suspend;
+        {
+            std::lock_guard lock { mtx_ };
+            drain(awaiter);
+            suspend = awaiter.batch_.empty() && !closed_;
+            if (suspend) {
+                poppers_.push_back(&awaiter);
+            }
+            pump(ready);
+        }
+        wake(ready);
+        return suspend;
+    }
+    void fill(PushAwaiter& awaiter)
+    {
+        if (closed_) {
+            awaiter.dropped_ = true;
+            return;
+        }
+        while (awaiter.offset_ < awaiter.items_.size() && has_room_for(awaiter.items_[awaiter.offset_])) {
+            accept(std::move(awaiter.items_[awaiter.offset_++]));
+        }
+    }
+    void drain(PopAwaiter& awaiter)
+    {
+        while (awaiter.batch_.size() < awaiter.max_ && !items_.empty()) {
+            awaiter.batch_.push_back(std::move(items_.front()));
+            items_.pop_front();
+        }
+    }
+    //Out of order items always get in, the source of the pipeline does not number items a window
+    //past the next one in order, so there are fewer of them than that window.
+    bool has_room_for(const Item& item) const
+    {
+        if (window_ != 0 && numbered_ >= released_ + window_) {
+            return false;
+        }
+        const uint64_t seq = numbering_ ? numbered_ : item.seq;
+        return items_.size() < capacity_ || (ordered_ && seq != next_seq_);
+    }
+    void accept(Item&& item)
+    {
+        if (numbering_) {
+            item.seq = numbered_++;
+        }
+        if (!ordered_) {
+            items_.push_back(std::move(item));
+            return;
+        }
+        reorder_.emplace(item.seq, std::move(item));
+        release_in_order();
+    }
+    //moves the items next in order out of the reorder buffer, past the lost ones
+    void release_in_order()
+    {
+        while (true) {
+            if (!reorder_.empty() && reorder_.begin()->first == next_seq_) {
+                items_.push_back(std::move(reorder_.begin()->second));
+                reorder_.erase(reorder_.begin());
+            } else if (!skipped_.empty() && *skipped_.begin() == next_seq_) {
+                skipped_.erase(skipped_.begin());
+            } else {
+                break;
+            }
+            next_seq_++;
+        }
+    }
+    //hand items to suspended poppers and room to suspended pushers until neither side can move
+    void pump(Wakeups& ready)
+    {
+        bool progress = true;
+        while (progress) {
+            progress = false;
+            while (!poppers_.empty() && (!items_.empty() || closed_)) {
+                PopAwaiter* popper = poppers_.front();
+                poppers_.pop_front();
+                drain(*popper);
+                ready.waiters.push_back(popper->waiter_);
+            }
+            while (!pushers_.empty()) {
+                PushAwaiter* pusher = pushers_.front();
+                const size_t offset = pusher->offset_;
+                fill(*pusher);
+                if (pusher->offset_ != offset) {
+                    progress = true;
+                }
+                if (!pusher->dropped_ && pusher->offset_ < pusher->items_.size()) {
+                    break;
+                }
+                pushers_.pop_front();
+                ready.waiters.push_back(pusher->waiter_);
+            }
+        }
+        if (source_ != nullptr && next_seq_ != reported_) {
+            reported_ = next_seq_;
+            ready.released = next_seq_;
+        }
+    }
+    void wake(Wakeups& ready)
+    {
+        for (auto& waiter : ready.waiters) {
+            resume_on(waiter.executor, waiter.coroutine, waiter.affinity);
+        }
+        if (ready.released != 0) {
+            source_->release(ready.released);
+        }
+    }
+
+private:
+    std::mutex mtx_;
+    const size_t capacity_;
+    bool ordered_ = false;
+    bool closed_ = false;
+    uint64_t next_seq_ = 0;
+    //source side: the next number to give, and how far the ordered tail got
+    bool numbering_ = false;
+    uint64_t numbered_ = 0;
+    size_t window_ = 0;
+    uint64_t released_ = 0;
+    //tail side: the source to tell, and what it was told last
+    std::shared_ptr<SequenceSource> source_;
+    uint64_t reported_ = 0;
+    std::deque<Item> items_;
+    std::map<uint64_t, Item> reorder_;
+    std::set<uint64_t> skipped_;
+    std::deque<PushAwaiter*> pushers_;
+    std::deque<PopAwaiter*> poppers_;
+};
+
+class StageBase {
+public:
+    StageBase(std::string name, StageOptions options)
+        : name_(std::move(name))
+        , options_(options)
+    {
+    }
+    virtual ~StageBase() { }
+    virtual void start(Context* ctx, std::shared_ptr<FailureSink> failures) = 0;
+    virtual size_t queue_depth() = 0;
+    StageStats stats()
+    {
+        using namespace std::chrono;
+        const auto processed = processed_.load(std::memory_order::relaxed);
+        const auto seconds = duration_cast<duration<double>>(steady_clock::now() - start_time_).count();
+        return StageStats {
+            .name = name_,
+            .parallelism = options_.parallelism,
+            .queue_depth = queue_depth(),
+            .processed = processed,
+            .throughput = seconds > 0 ? processed / seconds : 0.0,
+        };
+    }
+
+protected:
+    const std::string name_;
+    const StageOptions options_;
+    std::atomic<uint64_t> processed_ { 0 };
+    std::atomic<size_t> running_workers_ { 0 };
+    std::chrono::steady_clock::time_point start_time_;
+};
+
+template <typename In, typename Out, typename Fn>
+class Stage : public StageBase, public std::enable_shared_from_this<Stage<In, Out, Fn>> {
+public:
+    Stage(std::string name, StageOptions options, Fn fn, std::shared_ptr<StageQueue<In>> input, std::shared_ptr<StageQueue<Out>> output)
+        : StageBase(std::move(name), options)
+        , fn_(std::move(fn))
+        , input_(std::move(input))
+        , output_(std::move(output))
+    {
+    }
+    void start(Context* ctx, std::shared_ptr<FailureSink> failures) override
+    {
+        start_time_ = std::chrono::steady_clock::now();
+        const size_t workers = std::max(options_.parallelism, size_t { 1 });
+        running_workers_ = workers;
+        for (size_t i = 0; i < workers; i++) {
+            ctx->spawn([self = this->shared_from_this(), failures]() { return Stage::work(self, failures); });
+        }
+    }
+    size_t queue_depth() override
+    {
+        return input_->size();
+    }
+
+private:
+    //the last worker out closes the next stage's input, however it leaves
+    struct WorkerExit {
+        Stage& stage;
+        ~WorkerExit()
+        {
+            if (stage.running_workers_.fetch_sub(1, std::memory_order::acq_rel) == 1) {
+                stage.output_->close();
+            }
+        }
+    };
+
+    static Routine work(std::shared_ptr<Stage> self, std::shared_ptr<FailureSink> failures)
+    {
+        WorkerExit exit { *self };
+        while (true) {
+            auto batch = co_await self->input_->pop(self->options_.batch);
+            if (batch.empty()) {
+                break;
+            }
+            std::vector<typename StageQueue<Out>::Item> outputs;
+            outputs.reserve(batch.size());
+            for (auto& item : batch) {
+                try {
+                    outputs.push_back({ item.seq, self->fn_(std::move(item.value)) });
+                } catch (...) {
+                    failures->fail(item.seq, std::current_exception());
+                }
+            }
+            self->processed_.fetch_add(batch.size(), std::memory_order::relaxed);
+            co_await self->output_->push(std::move(outputs));
+        }
+    }
+
+private:
+    Fn fn_;
+    std::shared_ptr<StageQueue<In>> input_;
+    std::shared_ptr<StageQueue<Out>> output_;
+};
+
+//A stage failure drops the item and closes the pipeline's input, what the stages hold still
+//drains. Drops the skipped numbers at the ordered tail so it does not wait for them.
+template <typename In, typename Out>
+class PipelineFailures : public FailureSink {
+public:
+    PipelineFailures(std::shared_ptr<StageQueue<In>> head, std::shared_ptr<StageQueue<Out>> tail)
+        : head_(std::move(head))
+        , tail_(std::move(tail))
+    {
+    }
+
+protected:
+    void drop(uint64_t seq) override
+    {
+        tail_->skip(seq);
+        head_->close();
+    }
+
+private:
+    std::shared_ptr<StageQueue<In>> head_;
+    std::shared_ptr<StageQueue<Out>> tail_;
+};
+
+//Pops from the tail. The first exception a stage threw comes out once, ahead of the items or
+//in place of the end of the output.
+template <typename T>
+class PopBatchAwaiter {
+public:
+    PopBatchAwaiter(typename StageQueue<T>::PopAwaiter&& awaiter, FailureSink& failures)
+        : awaiter_(std::move(awaiter))
+        , failures_(failures)
+    {
+    }
+    bool await_ready()
+    {
+        error_ = failures_.take();
+        return error_ != nullptr || awaiter_.await_ready();
+    }
+    AwaitInfo await_info() const { return awaiter_.await_info(); }
+    bool await_suspend(std::coroutine_handle<> coroutine) { return awaiter_.await_suspend(coroutine); }
+    std::vector<typename StageQueue<T>::Item> await_resume()
+    {
+        if (error_ == nullptr) {
+            auto batch = awaiter_.await_resume();
+            if (!batch.empty()) {
+                return batch;
+            }
+            error_ = failures_.take();
+        }
+        if (error_ != nullptr) {
+            std::rethrow_exception(error_);
+        }
+        return {};
+    }
+
+private:
+    typename StageQueue<T>::PopAwaiter awaiter_;
+    FailureSink& failures_;
+    std::exception_ptr error_;
+};
+
+template <typename T>
+class PopOneAwaiter {
+public:
+    PopOneAwaiter(PopBatchAwaiter<T>&& awaiter)
+        : awaiter_(std::move(awaiter))
+    {
+    }
+    bool await_ready() { return awaiter_.await_ready(); }
+    AwaitInfo await_info() const { return awaiter_.await_info(); }
+    bool await_suspend(std::coroutine_handle<> coroutine) { return awaiter_.await_suspend(coroutine); }
+    std::optional<T> await_resume()
+    {
+        auto batch = awaiter_.await_resume();
+        if (batch.empty()) {
+            return std::nullopt;
+        }
+        return std::optional<T> { std::move(batch.front().value) };
+    }
+
+private:
+    PopBatchAwaiter<T> awaiter_;
+};
+
+} // namespace detail
+
+//recv -> decode -> transform -> encode -> send:
+//
+//  auto pipeline = bco::PipelineBuilder<Raw>(ctx)
+//      .stage("decode", { .parallelism = 4, .capacity = 256, .batch = 16 }, decode)
+//      .stage("transform", {}, transform)
+//      .build(bco::Ordering::Preserve);
+//  co_await pipeline->push(raw);      //suspends while the first queue is full
+//  auto out = co_await pipeline->pop(); //std::nullopt once closed and drained
+//
+//Stages are plain synchronous callables run by 'parallelism' Routines on the Context,
+//io belongs to the coroutines feeding and draining the pipeline. An item a stage throws on
+//is dropped and the pipeline takes no more input, pop() rethrows the first such exception.
+template <typename In, typename Out>
+class Pipeline {
+public:
+    Pipeline(std::shared_ptr<detail::StageQueue<In>> head, std::shared_ptr<detail::StageQueue<Out>> tail, std::vector<std::shared_ptr<detail::StageBase>> stages, std::shared_ptr<detail::FailureSink> failures)
+        : head_(std::move(head))
+        , tail_(std::move(tail))
+        , stages_(std::move(stages))
+        , failures_(std::move(failures))
+    {
+    }
+    ~Pipeline() { close(); }
+
+    [[nodiscard]] auto push(In value)
+    {
+        //numbered by the head queue once it takes it
+        std::vector<typename detail::StageQueue<In>::Item> items;
+        items.push_back({ 0, std::move(value) });
+        return head_->push(std::move(items));
+    }
+    [[nodiscard]] detail::PopOneAwaiter<Out> pop()
+    {
+        return detail::PopOneAwaiter<Out> { detail::PopBatchAwaiter<Out> { tail_->pop(1), *failures_ } };
+    }
+    [[nodiscard]] detail::PopBatchAwaiter<Out> pop_batch(size_t max)
+    {
+        return detail::PopBatchAwaiter<Out> { tail_->pop(max), *failures_ };
+    }
+    //no more input, the stages drain what they hold and then close the output
+    void close()
+    {
+        head_->close();
+    }
+    std::vector<StageStats> stats() const
+    {
+        std::vector<StageStats> result;
+        for (auto& stage : stages_) {
+            result.push_back(stage->stats());
+        }
+        return result;
+    }
+
+private:
+    std::shared_ptr<detail::StageQueue<In>> head_;
+    std::shared_ptr<detail::StageQueue<Out>> tail_;
+    std::vector<std::shared_ptr<detail::StageBase>> stages_;
+    std::shared_ptr<detail::FailureSink> failures_;
+};
+
+template <typename In, typename Out = In>
+class PipelineBuilder {
+    template <typename, typename>
+    friend class PipelineBuilder;
+
+public:
+    explicit PipelineBuilder(std::shared_ptr<Context> ctx, size_t capacity = 64) requires std::is_same_v<In, Out>
+        : ctx_(std::move(ctx))
+        , head_(std::make_shared<detail::StageQueue<In>>(capacity))
+        , tail_(head_)
+    {
+        head_->set_numbering();
+    }
+
+    template <typename Fn>
+    [[nodiscard]] auto stage(std::string name, StageOptions options, Fn fn) &&
+    {
+        using Next = std::invoke_result_t<Fn&, Out&&>;
+        auto output = std::make_shared<detail::StageQueue<Next>>(options.capacity);
+        stages_.push_back(std::make_shared<detail::Stage<Out, Next, Fn>>(std::move(name), options, std::move(fn), tail_, output));
+        return PipelineBuilder<In, Next> { std::move(ctx_), std::move(head_), std::move(output), std::move(stages_) };
+    }
+
+    [[nodiscard]] std::shared_ptr<Pipeline<In, Out>> build(Ordering ordering = Ordering::Unordered) &&
+    {
+        if (ordering == Ordering::Preserve) {
+            //a lone queue is in order already
+            if (stages_.empty()) {
+                tail_->set_ordered(nullptr);
+            } else {
+                head_->set_window(tail_->capacity());
+                tail_->set_ordered(head_);
+            }
+        }
+        auto failures = std::make_shared<detail::PipelineFailures<In, Out>>(head_, tail_);
+        for (auto& stage : stages_) {
+            stage->start(ctx_.get(), failures);
+        }
+        return std::make_shared<Pipeline<In, Out>>(std::move(head_), std::move(tail_), std::move(stages_), std::move(failures));
+    }
+
+private:
+    PipelineBuilder(std::shared_ptr<Context> ctx, std::shared_ptr<detail::StageQueue<In>> head, std::shared_ptr<detail::StageQueue<Out>> tail, std::vector<std::shared_ptr<detail::StageBase>> stages)
+        : ctx_(std::move(ctx))
+        , head_(std::move(head))
+        , tail_(std::move(tail))
+        , stages_(std::move(stages))
+    {
+    }
+
+private:
+    std::shared_ptr<Context> ctx_;
+    std::shared_ptr<detail::StageQueue<In>> head_;
+    std::shared_ptr<detail::StageQueue<Out>> tail_;
+    std::vector<std::shared_ptr<detail::StageBase>> stages_;
+};
+
+} // namespace bco
@@ -0,0 +1,613 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+
+#include <bco/utils.h>
+#include "task.h"
+
+namespace bco {
+
+namespace detail {
+
+//a coroutine suspended on one of the primitives below, in the frame of its awaiter
+struct SyncWaiter {
+    void park(std::coroutine_handle<> coroutine)
+    {
+        this->coroutine = coroutine;
+        executor = get_current_executor();
+        affinity = get_current_worker_index(executor);
+    }
+    void resume() { resume_on(executor, coroutine, affinity); }
+
+    SyncWaiter* next { nullptr };
+    std::coroutine_handle<> coroutine;
+    ExecutorInterface* executor { nullptr };
+    size_t affinity { kAnyWorker };
+};
+
+//waiters push themselves on a stack, this turns it into the order they came in
+inline SyncWaiter* reverse_waiters(SyncWaiter* stack)
+{
+    SyncWaiter* fifo = nullptr;
+    while (stack != nullptr) {
+        SyncWaiter* next = stack->next;
+        stack->next = fifo;
+        fifo = stack;
+        stack = next;
+    }
+    return fifo;
+}
+
+//resumes the list, a waiter may be gone once it is resumed
+inline void resume_waiters(SyncWaiter* waiters)
+{
+    while (waiters != nullptr) {
+        SyncWaiter* next = waiters->next;
+        waiters->resume();
+        waiters = next;
+    }
+}
+
+//FIFO of the coroutines a counter went negative for. A waiter decided to wait when it took the
+//count, a wake which comes before it is queued is kept for it.
+class WaitQueue {
+public:
+    //false if a wake came first
+    bool park(SyncWaiter* waiter)
+    {
+        std::lock_guard lock { mtx_ };
+        if (pending_ > 0) {
+            pending_--;
+            return false;
+        }
+        waiter->next = nullptr;
+        (tail_ != nullptr ? tail_->next : head_) = waiter;
+        tail_ = waiter;
+        return true;
+    }
+    void wake_one()
+    {
+        SyncWaiter* waiter;
+        {
+            std::lock_guard lock { mtx_ };
+            waiter = head_;
+            if (waiter == nullptr) {
+                pending_++;
+                return;
+            }
+            head_ = waiter->next;
+            if (head_ == nullptr) {
+                tail_ = nullptr;
+            }
+        }
+        waiter->resume();
+    }
+
+private:
+    std::mutex mtx_;
+    SyncWaiter* head_ { nullptr };
+    SyncWaiter* tail_ { nullptr };
+    size_t pending_ { 0 };
+};
+
+} // namespace detail
+
+//The primitives below suspend the coroutine instead of blocking the thread. Their fast paths are
+//a CAS, waiters are queued in their awaiters and resumed in FIFO order through the executor they
+//were suspended on, nothing is allocated.
+
+class AsyncMutex;
+
+//unlocks the mutex when it goes out of scope, see AsyncMutex::scoped_lock()
+class AsyncMutexLock {
+public:
+    explicit AsyncMutexLock(AsyncMutex& mutex)
+        : mutex_(&mutex)
+    {
+    }
+    AsyncMutexLock(AsyncMutexLock&& other) noexcept
+        : mutex_(std::exchange(other.mutex_, nullptr))
+    {
+    }
+    AsyncMutexLock& operator=(AsyncMutexLock&&) = delete;
+    ~AsyncMutexLock();
+
+private:
+    AsyncMutex* mutex_;
+};
+
+//    auto lock = co_await mutex.scoped_lock();
+//unlock() hands the mutex to the first waiter, which then owns it without racing newcomers.
+class AsyncMutex {
+public:
+    class LockAwaiter {
+    public:
+        explicit LockAwaiter(AsyncMutex& mutex)
+            : mutex_(mutex)
+        {
+        }
+        bool await_ready() { return mutex_.try_lock(); }
+        detail::AwaitInfo await_info() const { return { "AsyncMutex::lock" }; }
+        bool await_suspend(std::coroutine_handle<> coroutine)
+        {
+            waiter_.park(coroutine);
+            return mutex_.park(&waiter_);
+        }
+        void await_resume() { }
+
+    protected:
+        AsyncMutex& mutex_;
+        detail::SyncWaiter waiter_;
+    };
+
+    class ScopedLockAwaiter : public LockAwaiter {
+    public:
+        using LockAwaiter::LockAwaiter;
+        [[nodiscard]] AsyncMutexLock await_resume() { return AsyncMutexLock { mutex_ }; }
+    };
+
+    AsyncMutex() = default;
+    AsyncMutex(const AsyncMutex&) = delete;
+    AsyncMutex& operator=(const AsyncMutex&) = delete;
+    ~AsyncMutex() { assert(state_.load(std::memory_order::relaxed) <= kUnlocked && waiters_ == nullptr); }
+
+    bool try_lock()
+    {
+        uintptr_t state = kUnlocked;
+        return state_.compare_exchange_strong(state, kLocked, std::memory_order::acquire, std::memory_order::relaxed);
+    }
+    [[nodiscard]] LockAwaiter lock() { return LockAwaiter { *this }; }
+    [[nodiscard]] ScopedLockAwaiter scoped_lock() { return ScopedLockAwaiter { *this }; }
+    void unlock()
+    {
+        assert(state_.load(std::memory_order::relaxed) != kUnlocked);
+        detail::SyncWaiter* next = waiters_;
+        if (next == nullptr) {
+            uintptr_t state = kLocked;
+            if (state_.compare_exchange_strong(state, kUnlocked, std::memory_order::release, std::memory_order::relaxed)) {
+                return;
+            }
+            //waiters pushed themselves meanwhile, they queue up in the order they came in
+            next = detail::reverse_waiters(reinterpret_cast<detail::SyncWaiter*>(state_.exchange(kLocked, std::memory_order::acquire)));
+        }
+        waiters_ = next->next;
+        next->resume();
+    }
+
+private:
+    //locked without waiters, else unlocked or the stack of waiters pushed since the last unlock()
+    static constexpr uintptr_t kLocked = 0;
+    static constexpr uintptr_t kUnlocked = 1;
+
+    //false if it got the mutex meanwhile
+    bool park(detail::SyncWaiter* waiter)
+    {
+        uintptr_t state = state_.load(std::memory_order::relaxed);
+        while (true) {
+            if (state == kUnlocked) {
+                if (state_.compare_exchange_weak(state, kLocked, std::memory_order::acquire, std::memory_order::relaxed)) {
+                    return false;
+                }
+                continue;
+            }
+            waiter->next = reinterpret_cast<detail::SyncWaiter*>(state);
+            if (state_.compare_exchange_weak(state, reinterpret_cast<uintptr_t>(waiter), std::memory_order::release, std::memory_order::relaxed)) {
+                return true;
+            }
+        }
+    }
+
+private:
+    std::atomic<uintptr_t> state_ { kUnlocked };
+    //the waiters taken from the stack in order, only touched by the owner
+    detail::SyncWaiter* waiters_ { nullptr };
+};
+
+inline AsyncMutexLock::~AsyncMutexLock()
+{
+    if (mutex_ != nullptr) {
+        mutex_->unlock();
+    }
+}
+
+//Counting semaphore, e.g. to limit the calls in flight to a backend:
+//    co_await calls.acquire();
+//    auto result = co_await backend.call();
+//    calls.release();
+class Semaphore {
+public:
+    class AcquireAwaiter {
+    public:
+        explicit AcquireAwaiter(Semaphore& semaphore)
+            : semaphore_(semaphore)
+        {
+        }
+        //takes a unit, or its place in the queue
+        bool await_ready() { return semaphore_.count_.fetch_sub(1, std::memory_order::acquire) > 0; }
+        detail::AwaitInfo await_info() const { return { "Semaphore::acquire" }; }
+        bool await_suspend(std::coroutine_handle<> coroutine)
+        {
+            waiter_.park(coroutine);
+            return semaphore_.waiters_.park(&waiter_);
+        }
+        void await_resume() { }
+
+    private:
+        Semaphore& semaphore_;
+        detail::SyncWaiter waiter_;
+    };
+
+    explicit Semaphore(ptrdiff_t count)
+        : count_(count)
+    {
+    }
+    Semaphore(const Semaphore&) = delete;
+    Semaphore& operator=(const Semaphore&) = delete;
+
+    bool try_acquire()
+    {
+        ptrdiff_t count = count_.load(std::memory_order::relaxed);
+        while (count > 0) {
+            if (count_.compare_exchange_weak(count, count - 1, std::memory_order::acquire, std::memory_order::relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    [[nodiscard]] AcquireAwaiter acquire() { return AcquireAwaiter { *this }; }
+    void release(ptrdiff_t count = 1)
+    {
+        for (ptrdiff_t i = 0; i < count; i++) {
+            if (count_.fetch_add(1, std::memory_order::release) < 0) {
+                waiters_.wake_one();
+            }
+        }
+    }
+    //negative while coroutines wait
+    ptrdiff_t available() const { return count_.load(std::memory_order::relaxed); }
+
+private:
+    std::atomic<ptrdiff_t> count_;
+    detail::WaitQueue waiters_;
+};
+
+//Stays set until reset(), set() resumes all waiters.
+class ManualResetEvent {
+public:
+    class WaitAwaiter {
+    public:
+        explicit WaitAwaiter(ManualResetEvent& event)
+            : event_(event)
+        {
+        }
+        bool await_ready() const { return event_.is_set(); }
+        detail::AwaitInfo await_info() const { return { "ManualResetEvent::wait" }; }
+        bool await_suspend(std::coroutine_handle<> coroutine)
+        {
+            waiter_.park(coroutine);
+            return event_.park(&waiter_);
+        }
+        void await_resume() { }
+
+    private:
+        ManualResetEvent& event_;
+        detail::SyncWaiter waiter_;
+    };
+
+    explicit ManualResetEvent(bool set = false)
+        : state_(set ? this : nullptr)
+    {
+    }
+    ManualResetEvent(const ManualResetEvent&) = delete;
+    ManualResetEvent& operator=(const ManualResetEvent&) = delete;
+
+    bool is_set() const { return state_.load(std::memory_order::acquire) == this; }
+    void set()
+    {
+        void* state = state_.exchange(this, std::memory_order::acq_rel);
+        if (state != this) {
+            detail::resume_waiters(detail::reverse_waiters(static_cast<detail::SyncWaiter*>(state)));
+        }
+    }
+    void reset()
+    {
+        void* state = this;
+        state_.compare_exchange_strong(state, nullptr, std::memory_order::relaxed);
+    }
+    [[nodiscard]] WaitAwaiter wait() { return WaitAwaiter { *this }; }
+
+private:
+    //false if it was set meanwhile
+    bool park(detail::SyncWaiter* waiter)
+    {
+        void* state = state_.load(std::memory_order::acquire);
+        while (state != this) {
+            waiter->next = static_cast<detail::SyncWaiter*>(state);
+            if (state_.compare_exchange_weak(state, waiter, std::memory_order::release, std::memory_order::acquire)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    //'this' once set, else the stack of waiters
+    std::atomic<void*> state_;
+};
+
+//set() resumes one waiter, or lets the next wait() through if nobody waits.
+class AutoResetEvent {
+public:
+    class WaitAwaiter {
+    public:
+        explicit WaitAwaiter(AutoResetEvent& event)
+            : event_(event)
+        {
+        }
+        //consumes the event, or takes a place in the queue
+        bool await_ready()
+        {
+            ptrdiff_t state = event_.state_.load(std::memory_order::relaxed);
+            while (!event_.state_.compare_exchange_weak(state, state == 1 ? 0 : state - 1, std::memory_order::acquire, std::memory_order::relaxed)) {
+            }
+            return state == 1;
+        }
+        detail::AwaitInfo await_info() const { return { "AutoResetEvent::wait" }; }
+        bool await_suspend(std::coroutine_handle<> coroutine)
+        {
+            waiter_.park(coroutine);
+            return event_.waiters_.park(&waiter_);
+        }
+        void await_resume() { }
+
+    private:
+        AutoResetEvent& event_;
+        detail::SyncWaiter waiter_;
+    };
+
+    explicit AutoResetEvent(bool set = false)
+        : state_(set ? 1 : 0)
+    {
+    }
+    AutoResetEvent(const AutoResetEvent&) = delete;
+    AutoResetEvent& operator=(const AutoResetEvent&) = delete;
+
+    void set()
+    {
+        ptrdiff_t state = state_.load(std::memory_order::relaxed);
+        while (state != 1) {
+            if (state_.compare_exchange_weak(state, state + 1, std::memory_order::release, std::memory_order::relaxed)) {
+                if (state < 0) {
+                    waiters_.wake_one();
+                }
+                return;
+            }
+        }
+    }
+    void reset()
+    {
+        ptrdiff_t state = 1;
+        state_.compare_exchange_strong(state, 0, std::memory_order::relaxed);
+    }
+    [[nodiscard]] WaitAwaiter wait() { return WaitAwaiter { *this }; }
+
+private:
+    //1 while set, minus the number of waiters while not
+    std::atomic<ptrdiff_t> state_;
+    detail::WaitQueue waiters_;
+};
+
+//Reader-writer lock. Readers share it as long as no writer holds or waits for it, waiters get it
+//in the order they came, consecutive readers together.
+class RWLock {
+    struct Waiter : detail::SyncWaiter {
+        bool exclusive { false };
+    };
+
+public:
+    class LockAwaiter {
+    public:
+        LockAwaiter(RWLock& lock, bool exclusive)
+            : lock_(lock)
+        {
+            waiter_.exclusive = exclusive;
+        }
+        bool await_ready() { return waiter_.exclusive ? lock_.try_lock() : lock_.try_lock_shared(); }
+        detail::AwaitInfo await_info() const { return { waiter_.exclusive ? "RWLock::lock" : "RWLock::lock_shared" }; }
+        bool await_suspend(std::coroutine_handle<> coroutine)
+        {
+            waiter_.park(coroutine);
+            return lock_.park(&waiter_);
+        }
+        void await_resume() { }
+
+    private:
+        RWLock& lock_;
+        Waiter waiter_;
+    };
+
+    RWLock() = default;
+    RWLock(const RWLock&) = delete;
+    RWLock& operator=(const RWLock&) = delete;
+
+    bool try_lock()
+    {
+        uint64_t state = 0;
+        return state_.compare_exchange_strong(state, kWriter, std::memory_order::acquire, std::memory_order::relaxed);
+    }
+    bool try_lock_shared()
+    {
+        uint64_t state = state_.load(std::memory_order::relaxed);
+        while ((state & (kWriter | kWaiting)) == 0) {
+            if (state_.compare_exchange_weak(state, state + kReader, std::memory_order::acquire, std::memory_order::relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    [[nodiscard]] LockAwaiter lock() { return LockAwaiter { *this, true }; }
+    [[nodiscard]] LockAwaiter lock_shared() { return LockAwaiter { *this, false }; }
+    void unlock()
+    {
+        uint64_t state = kWriter;
+        if (state_.compare_exchange_strong(state, 0, std::memory_order::release, std::memory_order::relaxed)) {
+            return;
+        }
+        std::unique_lock lock { mtx_ };
+        state_.fetch_and(~kWriter, std::memory_order::acq_rel);
+        hand_over(lock);
+    }
+    void unlock_shared()
+    {
+        if (state_.fetch_sub(kReader, std::memory_order::acq_rel) - kReader == kWaiting) {
+            std::unique_lock lock { mtx_ };
+            hand_over(lock);
+        }
+    }
+
+private:
+    //readers are counted above the flags
+    static constexpr uint64_t kWriter = 1;
+    static constexpr uint64_t kWaiting = 2;
+    static constexpr uint64_t kReader = 4;
+
+    //false if it got the lock meanwhile
+    bool park(Waiter* waiter)
+    {
+        std::lock_guard lock { mtx_ };
+        //an unlock after this sees the flag and hands the lock over
+        uint64_t state = state_.fetch_or(kWaiting, std::memory_order::acq_rel) | kWaiting;
+        if (head_ == nullptr) {
+            while (waiter->exclusive ? state == kWaiting : (state & kWriter) == 0) {
+                const uint64_t locked = waiter->exclusive ? kWriter : (state & ~kWaiting) + kReader;
+                if (state_.compare_exchange_weak(state, locked, std::memory_order::acquire, std::memory_order::relaxed)) {
+                    return false;
+                }
+            }
+        }
+        waiter->next = nullptr;
+        (tail_ != nullptr ? tail_->next : head_) = waiter;
+        tail_ = waiter;
+        return true;
+    }
+    //the lock was released with waiters, the first writer or the first readers take it
+    void hand_over(std::unique_lock<std::mutex>& lock)
+    {
+        detail::SyncWaiter* granted = nullptr;
+        uint64_t state = state_.load(std::memory_order::relaxed);
+        while (true) {
+            if (head_ == nullptr) {
+                if (state_.compare_exchange_weak(state, state & ~kWaiting, std::memory_order::relaxed)) {
+                    break;
+                }
+                continue;
+            }
+            auto* first = static_cast<Waiter*>(head_);
+            auto* last = first;
+            uint64_t locked;
+            if (first->exclusive) {
+                //the readers left hand it over once they are done
+                if ((state & ~kWaiting) != 0) {
+                    break;
+                }
+                locked = kWriter;
+            } else {
+                if ((state & kWriter) != 0) {
+                    break;
+                }
+                locked = (state & ~kWaiting) + kReader;
+                while (last->next != nullptr && !static_cast<Waiter*>(last->next)->exclusive) {
+                    last = static_cast<Waiter*>(last->next);
+                    locked += kReader;
+                }
+            }
+            if (last->next != nullptr) {
+                locked |= kWaiting;
+            }
+            if (!state_.compare_exchange_weak(state, locked, std::memory_order::acq_rel, std::memory_order::relaxed)) {
+                continue;
+            }
+            granted = head_;
+            head_ = last->next;
+            if (head_ == nullptr) {
+                tail_ = nullptr;
+            }
+            last->next = nullptr;
+            break;
+        }
+        lock.unlock();
+        detail::resume_waiters(granted);
+    }
+
+private:
+    std::atomic<uint64_t> state_ { 0 };
+    std::mutex mtx_;
+    detail::SyncWaiter* head_ { nullptr };
+    detail::SyncWaiter* tail_ { nullptr };
+};
+
+//Opens once counted down to zero, for good.
+class Latch {
+public:
+    explicit Latch(ptrdiff_t count)
+        : count_(count)
+        , open_(count <= 0)
+    {
+    }
+
+    void count_down(ptrdiff_t n = 1)
+    {
+        if (count_.fetch_sub(n, std::memory_order::acq_rel) == n) {
+            open_.set();
+        }
+    }
+    bool try_wait() const { return open_.is_set(); }
+    [[nodiscard]] ManualResetEvent::WaitAwaiter wait() { return open_.wait(); }
+    [[nodiscard]] ManualResetEvent::WaitAwaiter arrive_and_wait(ptrdiff_t n = 1)
+    {
+        count_down(n);
+        return wait();
+    }
+
+private:
+    std::atomic<ptrdiff_t> count_;
+    ManualResetEvent open_;
+};
+
+//Reusable, a phase completes once all participants arrived and they all go on. A participant
+//arrives when it calls arrive_and_wait(), the last one of a phase does not suspend.
+class Barrier {
+public:
+    explicit Barrier(uint32_t participants)
+        : participants_(participants)
+    {
+        assert(participants > 0);
+    }
+
+    [[nodiscard]] ManualResetEvent::WaitAwaiter arrive_and_wait()
+    {
+        const uint64_t state = state_.fetch_add(1, std::memory_order::acq_rel);
+        const uint64_t phase = state >> 32;
+        ManualResetEvent& released = phases_[phase & 1];
+        if ((state & 0xffffffff) + 1 == participants_) {
+            //the participants of the phase before all arrived in this one, none still waits on it
+            phases_[(phase + 1) & 1].reset();
+            state_.store((phase + 1) << 32, std::memory_order::release);
+            released.set();
+        }
+        return released.wait();
+    }
+
+private:
+    const uint32_t participants_;
+    //the phase above the participants arrived in it
+    std::atomic<uint64_t> state_ { 0 };
+    ManualResetEvent phases_[2];
+};
+
+} // namespace bco
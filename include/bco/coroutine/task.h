@@ -1,13 +1,57 @@
 #pragma once
+#include <cassert>
 #include <coroutine>
+#include <exception>
 #include <functional>
 #include <memory>
 #include <optional>
+#include <type_traits>
+#include <utility>
+#include <bco/routine_registry.h>
 #include <bco/utils.h>
+#include "frame.h"
+#include "frame_pool.h"
+#include "local.h"
 #include "task.inl"
 
 namespace bco {
 
+namespace detail {
+
+//resume a suspended coroutine through the executor it was suspended on, or inline if there is none
+inline void resume_on(ExecutorInterface* executor, std::coroutine_handle<> coroutine, size_t affinity = kAnyWorker)
+{
+    if (executor == nullptr) {
+        coroutine.resume();
+        return;
+    }
+    executor->post(PriorityTask { Priority::Medium, [coroutine]() { coroutine.resume(); }, affinity });
+}
+
+//set by Context::spawn for the Routine it is creating, which then starts suspended
+extern constinit thread_local Context* spawning_context;
+
+//Sets one of the spawning_* thread locals for the lifetime of the scope. The previous value is
+//put back even if creating the routine throws, so a later unrelated coroutine does not pick it up.
+template <typename T>
+class SpawnScope {
+public:
+    SpawnScope(T*& slot, std::type_identity_t<T>* value)
+        : slot_(slot)
+        , saved_(std::exchange(slot, value))
+    {
+    }
+    SpawnScope(const SpawnScope&) = delete;
+    SpawnScope& operator=(const SpawnScope&) = delete;
+    ~SpawnScope() { slot_ = saved_; }
+
+private:
+    T*& slot_;
+    T* saved_;
+};
+
+} // namespace detail
+
 template <typename T = void>
 class Func;
 
@@ -33,10 +77,34 @@ class Routine : public std::suspend_never {
 public:
     class promise_type {
     public:
+        struct StartAwaiter {
+            promise_type* promise;
+            bool await_ready() const noexcept { return !promise->deferred_; }
+            void await_suspend(std::coroutine_handle<>) const noexcept
+            {
+                detail::trace_suspend(promise->frame_, { "not started" }, detail::awaiter_signature<StartAwaiter>());
+            }
+            void await_resume() const noexcept
+            {
+                detail::enter_frame(&promise->frame_, true);
+                detail::trace_resume(promise->frame_);
+            }
+        };
+
+#if BCO_FRAME_POOL
+        static void* operator new(size_t size) { return detail::allocate_frame(size); }
+        static void operator delete(void* frame) noexcept { detail::deallocate_frame(frame); }
+#endif
         Routine get_return_object();
-        std::suspend_never initial_suspend()
+        StartAwaiter initial_suspend()
         {
-            return {};
+            frame_.address = std::coroutine_handle<promise_type>::from_promise(*this).address();
+            frame_.stats = &stats_;
+            frame_.trace = &trace_;
+            frame_.locals = &locals_;
+            trace_.entries[0].function.store(*static_cast<void**>(frame_.address), std::memory_order::relaxed);
+            trace_.depth.store(1, std::memory_order::relaxed);
+            return StartAwaiter { this };
         }
         std::suspend_never final_suspend() noexcept;
         void unhandled_exception()
@@ -45,21 +113,39 @@ public:
         void return_void()
         {
         }
+        template <typename A>
+        auto await_transform(A&& awaitable)
+        {
+            return detail::track_await(std::forward<A>(awaitable), &frame_);
+        }
+        const RoutineStats& stats() const { return stats_; }
+        detail::CoroutineFrame& frame() { return frame_; }
+        CancellationToken cancellation_token() const { return frame_.cancellation; }
+        detail::LocalStorage* locals() { return &locals_; }
     private:
         std::weak_ptr<bco::Context> ctx_;
+        RoutineStats stats_;
+        detail::AsyncTrace trace_;
+        detail::CoroutineFrame frame_;
+        detail::LocalStorage locals_;
+        detail::RoutineNode node_;
+        bool deferred_ { false };
     };
     std::strong_ordering operator<=>(const Routine& other) const
     {
         return promise_ <=> other.promise_;
     }
+    const void* id() const { return promise_; }
+    const RoutineStats& stats() const { return promise_->stats(); }
 
 private:
     friend class promise_type;
+    friend class Context;
     Routine(promise_type* promise)
         : promise_(promise)
     {
     }
-
+    std::coroutine_handle<promise_type> handle() const { return std::coroutine_handle<promise_type>::from_promise(*promise_); }
 
 private:
     promise_type* promise_;
@@ -77,23 +163,30 @@ public:
         : ctx_(new SharedContext)
     {
     }
-    void set_result(T&& val) noexcept { ctx_->result_ = std::move(val); }
-    void set_result(const T& val) noexcept { ctx_->result_ = val; }
+    void set_result(T&& val) { ctx_->result_.emplace(std::move(val)); }
+    void set_result(const T& val) { ctx_->result_.emplace(val); }
+    //constructs the result in place
+    template <typename... Args>
+    void emplace_result(Args&&... args) { ctx_->result_.emplace(std::forward<Args>(args)...); }
     bool await_ready() const noexcept { return ctx_->result_.has_value(); }
     void await_suspend(std::coroutine_handle<> coroutine) noexcept
     {
         ctx_->caller_coroutine_ = coroutine;
     }
-    T await_resume() noexcept
+    //moves the result out, a Task is awaited once and only resumed with a result set
+    T await_resume()
     {
-        //return std::move(result_.value_or(detail::default_value<T>());
-        //return ctx_->result_.value_or(detail::default_value<T>());
-        return ctx_->result_.value_or(T {});
+        assert(ctx_->result_.has_value());
+        return std::move(*ctx_->result_);
     }
     void resume() { ctx_->caller_coroutine_.resume(); }
+    //what an async stack dump shows while a coroutine awaits this task, see detail::AwaitInfo
+    void set_await_info(const char* format, long long arg = 0) noexcept { info_ = { format, arg }; }
+    detail::AwaitInfo await_info() const noexcept { return info_; }
 
 protected:
     std::shared_ptr<SharedContext> ctx_;
+    detail::AwaitInfo info_;
 };
 
 template <>
@@ -120,9 +213,30 @@ public:
     }
     void await_resume() noexcept { }
     void resume() { ctx_->caller_coroutine_.resume(); }
+    //what an async stack dump shows while a coroutine awaits this task, see detail::AwaitInfo
+    void set_await_info(const char* format, long long arg = 0) noexcept { info_ = { format, arg }; }
+    detail::AwaitInfo await_info() const noexcept { return info_; }
 
 protected:
     std::shared_ptr<SharedContext> ctx_;
+    detail::AwaitInfo info_;
 };
 
+//token of the Routine or Func running on this thread, see with_cancellation()
+inline CancellationToken current_cancellation_token()
+{
+    auto* frame = detail::get_current_frame();
+    return frame != nullptr ? frame->cancellation : CancellationToken {};
+}
+
+//Names the Routine or Func running on this thread in async stack dumps, until it returns.
+//Only the pointer is kept, use a literal or a string that outlives the coroutine.
+inline void set_coroutine_label(const char* label)
+{
+    auto* frame = detail::get_current_frame();
+    if (frame != nullptr && frame->trace != nullptr && frame->depth < BCO_ASYNC_TRACE_DEPTH) {
+        frame->trace->entries[frame->depth].label.store(label, std::memory_order::relaxed);
+    }
+}
+
 } //namespace bco
\ No newline at end of file
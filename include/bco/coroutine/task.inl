@@ -4,6 +4,124 @@ namespace bco {
 
 namespace detail {
 
+template <typename A>
+decltype(auto) get_awaiter(A&& awaitable)
+{
+    if constexpr (requires { std::forward<A>(awaitable).operator co_await(); }) {
+        return std::forward<A>(awaitable).operator co_await();
+    } else if constexpr (requires { operator co_await(std::forward<A>(awaitable)); }) {
+        return operator co_await(std::forward<A>(awaitable));
+    } else {
+        return std::forward<A>(awaitable);
+    }
+}
+
+//Wraps every co_await of a Routine or Func to keep the current frame, the async trace and the
+//run time of the routine up to date, see frame.h and accounting.h.
+//The frame is left before the inner await_suspend() publishes the coroutine, because it may be
+//resumed on another thread before that returns.
+template <typename Awaiter>
+class TrackedAwaiter {
+public:
+    TrackedAwaiter(Awaiter&& awaiter, CoroutineFrame* frame)
+        : awaiter_(std::forward<Awaiter>(awaiter))
+        , frame_(frame)
+    {
+    }
+    bool await_ready() { return awaiter_.await_ready(); }
+    template <typename Promise>
+    auto await_suspend(std::coroutine_handle<Promise> coroutine)
+    {
+        using Result = decltype(awaiter_.await_suspend(coroutine));
+        suspended_ = true;
+        if constexpr (requires { awaiter_.await_info(); }) {
+            trace_suspend(*frame_, awaiter_.await_info(), awaiter_signature<std::remove_cvref_t<Awaiter>>());
+        } else {
+            trace_suspend(*frame_, {}, awaiter_signature<std::remove_cvref_t<Awaiter>>());
+        }
+        leave_frame(frame_);
+        if constexpr (std::is_void_v<Result>) {
+            awaiter_.await_suspend(coroutine);
+        } else if constexpr (std::is_same_v<Result, bool>) {
+            if (!awaiter_.await_suspend(coroutine)) {
+                suspended_ = false;
+                enter_frame(frame_, false);
+                trace_resume(*frame_);
+                return false;
+            }
+            return true;
+        } else {
+            return std::coroutine_handle<> { awaiter_.await_suspend(coroutine) };
+        }
+    }
+    decltype(auto) await_resume()
+    {
+        if (suspended_) {
+            enter_frame(frame_, true);
+            trace_resume(*frame_);
+        }
+        return awaiter_.await_resume();
+    }
+
+private:
+    Awaiter awaiter_;
+    CoroutineFrame* frame_;
+    bool suspended_ { false };
+};
+
+template <typename _PromiseT>
+class Awaitable;
+
+template <typename T>
+struct IsFuncAwaitable : std::false_type { };
+template <typename _PromiseT>
+struct IsFuncAwaitable<Awaitable<_PromiseT>> : std::true_type { };
+
+//awaiting a Func or a Generator stays in the same routine, their awaiters move the frames themselves
+template <typename A>
+auto track_await(A&& awaitable, CoroutineFrame* frame)
+{
+    using Awaiter = decltype(get_awaiter(std::forward<A>(awaitable)));
+    if constexpr (IsFuncAwaitable<std::remove_cvref_t<Awaiter>>::value) {
+        return get_awaiter(std::forward<A>(awaitable));
+    } else {
+        return TrackedAwaiter<Awaiter> { get_awaiter(std::forward<A>(awaitable)), frame };
+    }
+}
+
+//The frame of a Func or Generator resumed by 'caller' runs on top of it, with its stats, its
+//cancellation token and its locals, until unlink_frame().
+template <typename CallerPromise>
+void link_frame(CoroutineFrame& frame, void* address, std::coroutine_handle<CallerPromise> caller)
+{
+    frame.address = address;
+    if constexpr (requires { caller.promise().frame(); }) {
+        frame.parent = &caller.promise().frame();
+        frame.resumer = frame.parent->resumer;
+        frame.stats = frame.parent->stats;
+        frame.cancellation = frame.parent->cancellation;
+        frame.locals = frame.parent->locals;
+        push_trace(frame);
+    } else {
+        frame.resumer = get_current_frame();
+        frame.cancellation = cancellation_token_of(caller);
+        frame.locals = locals_of(caller);
+    }
+    set_current_frame(&frame);
+}
+
+//the frame finished or yielded, the caller goes on
+inline void unlink_frame(CoroutineFrame& frame)
+{
+    if (frame.parent != nullptr) {
+        pop_trace(frame);
+        frame.parent->resumer = frame.resumer;
+        set_current_frame(frame.parent);
+    } else {
+        set_current_frame(frame.resumer);
+    }
+}
+
 class PromiseTypeBase {
     struct FinalAwaitable {
         bool await_ready() noexcept { return false; }
@@ -11,9 +129,9 @@ class PromiseTypeBase {
         template <typename _PromiseT>
         std::coroutine_handle<void> await_suspend(std::coroutine_handle<_PromiseT> coroutine) noexcept
         {
-            auto caller_coroutine = coroutine.promise().caller_coroutine();
-            coroutine.destroy();
-            return caller_coroutine;
+            unlink_frame(coroutine.promise().frame());
+            //the frame is destroyed by Awaitable::await_resume() once the result is taken
+            return coroutine.promise().caller_coroutine();
         }
         void await_resume() noexcept { }
         void return_void() { }
@@ -21,6 +139,10 @@ class PromiseTypeBase {
 
 public:
     PromiseTypeBase() = default;
+#if BCO_FRAME_POOL
+    static void* operator new(size_t size) { return allocate_frame(size); }
+    static void operator delete(void* frame) noexcept { deallocate_frame(frame); }
+#endif
     //ִеcoroutineţͻִco_await initial_suspend()
     //𣬸coroutinecallerִco_await return_object
     //Աcoroutineʼִǰȡⲿcoroutine_handle
@@ -28,7 +150,7 @@ public:
     {
         return {};
     }
-    FinalAwaitable final_suspend()
+    FinalAwaitable final_suspend() noexcept
     {
         return {};
     }
@@ -36,16 +158,45 @@ public:
     {
         return caller_coroutine_;
     }
+    //kept for the awaiting coroutine, result() rethrows it
     void unhandled_exception()
     {
+        exception_ = std::current_exception();
     }
     void set_caller_coroutine(std::coroutine_handle<void> caller)
     {
         caller_coroutine_ = caller;
     }
+    CoroutineFrame& frame()
+    {
+        return frame_;
+    }
+    CancellationToken cancellation_token() const
+    {
+        return frame_.cancellation;
+    }
+    LocalStorage* locals() const
+    {
+        return frame_.locals;
+    }
+    template <typename A>
+    auto await_transform(A&& awaitable)
+    {
+        return track_await(std::forward<A>(awaitable), &frame_);
+    }
+
+protected:
+    void rethrow_exception()
+    {
+        if (exception_ != nullptr) {
+            std::rethrow_exception(std::exchange(exception_, nullptr));
+        }
+    }
 
 private:
     std::coroutine_handle<> caller_coroutine_;
+    CoroutineFrame frame_;
+    std::exception_ptr exception_;
 };
 
 template <template <typename> typename _TaskT, typename T>
@@ -62,27 +213,31 @@ public:
         return _TaskT<void> { std::coroutine_handle<PromiseType>::from_promise(*this) };
     }
     void return_void() { }
-    void result() { }
+    void result() { rethrow_exception(); }
 };
 
+//The value is constructed in place by co_return and moved out once by the awaiting coroutine,
+//T needs to be neither default constructible nor copyable.
 template <template <typename> typename _TaskT, typename T>
 class PromiseType : public PromiseTypeBase {
 public:
     _TaskT<T> get_return_object()
     {
-        return _TaskT<void> { std::coroutine_handle<PromiseType>::from_promise(*this) };
+        return _TaskT<T> { std::coroutine_handle<PromiseType>::from_promise(*this) };
     }
-    void return_value(T t)
+    template <typename U = T>
+    void return_value(U&& value)
     {
-        value_ = t;
+        value_.emplace(std::forward<U>(value));
     }
     T result()
     {
-        return value_;
+        rethrow_exception();
+        return std::move(*value_);
     }
 
 private:
-    T value_;
+    std::optional<T> value_;
 };
 
 template <typename _PromiseT>
@@ -96,14 +251,20 @@ public:
     {
         return false;
     }
-    decltype(auto) await_resume() noexcept
+    decltype(auto) await_resume()
     {
+        struct Destroy {
+            std::coroutine_handle<_PromiseT> coroutine;
+            ~Destroy() { coroutine.destroy(); }
+        } destroy { current_coroutine_ };
         return current_coroutine_.promise().result();
     }
     //coroutine_handle<Task>ƺҲ
-    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller_coroutine)
+    template <typename _CallerPromiseT>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<_CallerPromiseT> caller_coroutine)
     {
         current_coroutine_.promise().set_caller_coroutine(caller_coroutine);
+        link_frame(current_coroutine_.promise().frame(), current_coroutine_.address(), caller_coroutine);
         return current_coroutine_;
     }
 
@@ -0,0 +1,544 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <coroutine>
+#include <exception>
+#include <limits>
+#include <optional>
+#include <ranges>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "bco/cancellation.h"
+#include "frame_pool.h"
+#include "task.h"
+
+namespace bco {
+
+namespace detail {
+
+template <typename A>
+using await_result_t = decltype(get_awaiter(std::declval<A&>()).await_resume());
+
+template <typename T>
+using non_void_t = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+//Children of a when_all()/when_any() count down, the last one resumes the awaiting coroutine.
+//The awaiting coroutine holds one more count until all children are started. The first exception
+//a child throws is kept for the awaiting coroutine, which rethrows it once all of them arrived.
+class JoinCounter {
+public:
+    explicit JoinCounter(size_t children)
+        : pending_(children + 1)
+    {
+    }
+    void set_awaiting(std::coroutine_handle<> coroutine) { awaiting_ = coroutine; }
+    //a child finished, returns the coroutine it transfers to
+    std::coroutine_handle<> arrive() noexcept
+    {
+        if (pending_.fetch_sub(1, std::memory_order::acq_rel) == 1) {
+            return awaiting_;
+        }
+        return std::noop_coroutine();
+    }
+    //all children are started, false if they finished already
+    bool suspend() noexcept { return pending_.fetch_sub(1, std::memory_order::acq_rel) != 1; }
+    void fail(std::exception_ptr error) noexcept
+    {
+        if (!failed_.exchange(true, std::memory_order::acq_rel)) {
+            error_ = std::move(error);
+        }
+    }
+    void rethrow_if_failed()
+    {
+        if (error_ != nullptr) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+private:
+    std::atomic<size_t> pending_;
+    std::coroutine_handle<> awaiting_;
+    std::atomic<bool> failed_ { false };
+    std::exception_ptr error_;
+};
+
+//what a child of a when_all()/when_any() takes from the awaiting coroutine
+struct ChildScope {
+    CancellationToken token;
+    LocalStorage* locals { nullptr };
+};
+
+template <typename Promise>
+ChildScope child_scope_of(std::coroutine_handle<Promise> coroutine)
+{
+    return { cancellation_token_of(coroutine), locals_of(coroutine) };
+}
+
+//Coroutine awaiting one child of a when_all()/when_any(), it destroys itself once done. The child
+//takes its cancellation token, and a copy of its locals since the children run concurrently.
+class WhenChild {
+public:
+    class promise_type {
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> coroutine) noexcept
+            {
+                JoinCounter* counter = coroutine.promise().counter_;
+                coroutine.destroy();
+                return counter->arrive();
+            }
+            void await_resume() noexcept { }
+        };
+
+    public:
+        template <typename... Args>
+        promise_type(JoinCounter& counter, ChildScope scope, Args&...)
+            : counter_(&counter)
+            , token_(scope.token)
+        {
+            if (scope.locals != nullptr) {
+                locals_.inherit(*scope.locals);
+            }
+        }
+#if BCO_FRAME_POOL
+        static void* operator new(size_t size) { return allocate_frame(size); }
+        static void operator delete(void* frame) noexcept { deallocate_frame(frame); }
+#endif
+        WhenChild get_return_object() { return WhenChild { std::coroutine_handle<promise_type>::from_promise(*this) }; }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void return_void() { }
+        void unhandled_exception() { counter_->fail(std::current_exception()); }
+        CancellationToken cancellation_token() const { return token_; }
+        LocalStorage* locals() { return &locals_; }
+
+    private:
+        JoinCounter* counter_;
+        CancellationToken token_;
+        LocalStorage locals_;
+    };
+
+    //runs the child until it first suspends, the handle may be gone afterwards
+    void start() { coroutine_.resume(); }
+
+private:
+    explicit WhenChild(std::coroutine_handle<promise_type> coroutine)
+        : coroutine_(coroutine)
+    {
+    }
+    std::coroutine_handle<promise_type> coroutine_;
+};
+
+template <typename A, typename R>
+WhenChild await_into(JoinCounter&, ChildScope, A& awaitable, std::optional<R>& result)
+{
+    if constexpr (std::is_void_v<await_result_t<A>>) {
+        co_await awaitable;
+        result.emplace();
+    } else {
+        result.emplace(co_await awaitable);
+    }
+}
+
+//an exception takes part in the race like a result
+template <size_t I, typename Race, typename A>
+WhenChild race_child(JoinCounter&, ChildScope, Race& race, A& awaitable)
+{
+    try {
+        if constexpr (std::is_void_v<await_result_t<A>>) {
+            co_await awaitable;
+            race.template finish<I>(std::monostate {});
+        } else {
+            race.template finish<I>(co_await awaitable);
+        }
+    } catch (...) {
+        race.fail(std::current_exception());
+    }
+}
+
+template <typename Race, typename A>
+WhenChild race_child(JoinCounter&, ChildScope, Race& race, A& awaitable, size_t index)
+{
+    try {
+        if constexpr (std::is_void_v<await_result_t<A>>) {
+            co_await awaitable;
+            race.finish(index, std::monostate {});
+        } else {
+            race.finish(index, co_await awaitable);
+        }
+    } catch (...) {
+        race.fail(std::current_exception());
+    }
+}
+
+template <typename... A>
+class WhenAllAwaiter {
+public:
+    explicit WhenAllAwaiter(A&&... awaitables)
+        : awaitables_(std::forward<A>(awaitables)...)
+    {
+    }
+    WhenAllAwaiter(const WhenAllAwaiter&) = delete;
+    WhenAllAwaiter& operator=(const WhenAllAwaiter&) = delete;
+
+    bool await_ready() const noexcept { return sizeof...(A) == 0; }
+    template <typename Promise>
+    bool await_suspend(std::coroutine_handle<Promise> coroutine)
+    {
+        counter_.set_awaiting(coroutine);
+        start(child_scope_of(coroutine), std::index_sequence_for<A...> {});
+        return counter_.suspend();
+    }
+    std::tuple<non_void_t<await_result_t<A>>...> await_resume()
+    {
+        counter_.rethrow_if_failed();
+        return std::apply([](auto&... results) { return std::tuple<non_void_t<await_result_t<A>>...> { std::move(*results)... }; }, results_);
+    }
+
+private:
+    template <size_t... I>
+    void start(ChildScope scope, std::index_sequence<I...>)
+    {
+        (await_into(counter_, scope, std::get<I>(awaitables_), std::get<I>(results_)).start(), ...);
+    }
+
+private:
+    std::tuple<A...> awaitables_;
+    std::tuple<std::optional<non_void_t<await_result_t<A>>>...> results_;
+    JoinCounter counter_ { sizeof...(A) };
+};
+
+template <typename R>
+class WhenAllRangeAwaiter {
+    using Result = await_result_t<std::remove_reference_t<std::ranges::range_reference_t<R>>>;
+
+public:
+    explicit WhenAllRangeAwaiter(R&& range)
+        : range_(std::forward<R>(range))
+        , results_(static_cast<size_t>(std::ranges::distance(range_)))
+        , counter_(results_.size())
+    {
+    }
+    WhenAllRangeAwaiter(const WhenAllRangeAwaiter&) = delete;
+    WhenAllRangeAwaiter& operator=(const WhenAllRangeAwaiter&) = delete;
+
+    bool await_ready() const noexcept { return results_.empty(); }
+    template <typename Promise>
+    bool await_suspend(std::coroutine_handle<Promise> coroutine)
+    {
+        counter_.set_awaiting(coroutine);
+        const ChildScope scope = child_scope_of(coroutine);
+        size_t index = 0;
+        for (auto&& awaitable : range_) {
+            await_into(counter_, scope, awaitable, results_[index++]).start();
+        }
+        return counter_.suspend();
+    }
+    auto await_resume()
+    {
+        counter_.rethrow_if_failed();
+        if constexpr (!std::is_void_v<Result>) {
+            std::vector<Result> results;
+            results.reserve(results_.size());
+            for (auto& result : results_) {
+                results.push_back(std::move(*result));
+            }
+            return results;
+        }
+    }
+
+private:
+    R range_;
+    std::vector<std::optional<non_void_t<Result>>> results_;
+    JoinCounter counter_;
+};
+
+//what a when_any() without a disposer does with the results of the losers
+struct DropLoser {
+    template <typename V>
+    void operator()(V&&) const noexcept { }
+};
+
+//a loser which finished with a result, nothing to dispose of for a void one
+template <typename D, typename V>
+void dispose_loser(D& dispose, V&& value)
+{
+    if constexpr (!std::is_same_v<std::remove_cvref_t<V>, std::monostate>) {
+        dispose(std::forward<V>(value));
+    }
+}
+
+template <typename D, typename... A>
+class WhenAnyAwaiter {
+    static constexpr size_t kNoWinner = std::numeric_limits<size_t>::max();
+    static constexpr size_t kFailed = kNoWinner - 1;
+
+public:
+    using Result = std::variant<non_void_t<await_result_t<A>>...>;
+
+    explicit WhenAnyAwaiter(D dispose, A&&... awaitables)
+        : dispose_(std::move(dispose))
+        , awaitables_(std::forward<A>(awaitables)...)
+    {
+    }
+    WhenAnyAwaiter(const WhenAnyAwaiter&) = delete;
+    WhenAnyAwaiter& operator=(const WhenAnyAwaiter&) = delete;
+
+    bool await_ready() const noexcept { return false; }
+    template <typename Promise>
+    bool await_suspend(std::coroutine_handle<Promise> coroutine)
+    {
+        counter_.set_awaiting(coroutine);
+        losers_.emplace(cancellation_token_of(coroutine));
+        start(locals_of(coroutine), std::index_sequence_for<A...> {});
+        return counter_.suspend();
+    }
+    Result await_resume()
+    {
+        counter_.rethrow_if_failed();
+        return std::move(*result_);
+    }
+
+    template <size_t I, typename V>
+    void finish(V&& value)
+    {
+        size_t expected = kNoWinner;
+        if (winner_.compare_exchange_strong(expected, I, std::memory_order::acq_rel)) {
+            result_.emplace(std::in_place_index<I>, std::forward<V>(value));
+            losers_->cancel();
+        } else {
+            dispose_loser(dispose_, std::forward<V>(value));
+        }
+    }
+    //a loser's exception is dropped like its result
+    void fail(std::exception_ptr error)
+    {
+        size_t expected = kNoWinner;
+        if (winner_.compare_exchange_strong(expected, kFailed, std::memory_order::acq_rel)) {
+            counter_.fail(std::move(error));
+            losers_->cancel();
+        }
+    }
+
+private:
+    template <size_t... I>
+    void start(LocalStorage* locals, std::index_sequence<I...>)
+    {
+        (race_child<I>(counter_, { losers_->token(), locals }, *this, std::get<I>(awaitables_)).start(), ...);
+    }
+
+private:
+    D dispose_;
+    std::tuple<A...> awaitables_;
+    std::optional<Result> result_;
+    std::atomic<size_t> winner_ { kNoWinner };
+    JoinCounter counter_ { sizeof...(A) };
+    //cancelled by the winner, and with the awaiting coroutine
+    std::optional<CancellationSource> losers_;
+};
+
+template <typename D, typename R>
+class WhenAnyRangeAwaiter {
+    using Result = await_result_t<std::remove_reference_t<std::ranges::range_reference_t<R>>>;
+    static constexpr size_t kNoWinner = std::numeric_limits<size_t>::max();
+    static constexpr size_t kFailed = kNoWinner - 1;
+
+public:
+    WhenAnyRangeAwaiter(D dispose, R&& range)
+        : dispose_(std::move(dispose))
+        , range_(std::forward<R>(range))
+        , counter_(static_cast<size_t>(std::ranges::distance(range_)))
+    {
+        assert(std::ranges::distance(range_) > 0);
+    }
+    WhenAnyRangeAwaiter(const WhenAnyRangeAwaiter&) = delete;
+    WhenAnyRangeAwaiter& operator=(const WhenAnyRangeAwaiter&) = delete;
+
+    bool await_ready() const noexcept { return false; }
+    template <typename Promise>
+    bool await_suspend(std::coroutine_handle<Promise> coroutine)
+    {
+        counter_.set_awaiting(coroutine);
+        losers_.emplace(cancellation_token_of(coroutine));
+        LocalStorage* locals = locals_of(coroutine);
+        size_t index = 0;
+        for (auto&& awaitable : range_) {
+            race_child(counter_, { losers_->token(), locals }, *this, awaitable, index++).start();
+        }
+        return counter_.suspend();
+    }
+    //the index of the winner, and its result unless it is void
+    auto await_resume()
+    {
+        counter_.rethrow_if_failed();
+        const size_t winner = winner_.load(std::memory_order::relaxed);
+        if constexpr (std::is_void_v<Result>) {
+            return winner;
+        } else {
+            return std::pair<size_t, Result> { winner, std::move(*result_) };
+        }
+    }
+
+    template <typename V>
+    void finish(size_t index, V&& value)
+    {
+        size_t expected = kNoWinner;
+        if (winner_.compare_exchange_strong(expected, index, std::memory_order::acq_rel)) {
+            result_.emplace(std::forward<V>(value));
+            losers_->cancel();
+        } else {
+            dispose_loser(dispose_, std::forward<V>(value));
+        }
+    }
+    void fail(std::exception_ptr error)
+    {
+        size_t expected = kNoWinner;
+        if (winner_.compare_exchange_strong(expected, kFailed, std::memory_order::acq_rel)) {
+            counter_.fail(std::move(error));
+            losers_->cancel();
+        }
+    }
+
+private:
+    D dispose_;
+    R range_;
+    std::optional<non_void_t<Result>> result_;
+    std::atomic<size_t> winner_ { kNoWinner };
+    JoinCounter counter_;
+    std::optional<CancellationSource> losers_;
+};
+
+template <typename A>
+class WithCancellationAwaiter {
+    using Result = await_result_t<A>;
+    struct Cancel {
+        CancellationSource* source;
+        void operator()() const { source->cancel(); }
+    };
+
+public:
+    WithCancellationAwaiter(CancellationToken token, A&& awaitable)
+        : token_(token)
+        , awaitable_(std::forward<A>(awaitable))
+    {
+    }
+    WithCancellationAwaiter(const WithCancellationAwaiter&) = delete;
+    WithCancellationAwaiter& operator=(const WithCancellationAwaiter&) = delete;
+
+    bool await_ready() const noexcept { return false; }
+    template <typename Promise>
+    bool await_suspend(std::coroutine_handle<Promise> coroutine)
+    {
+        counter_.set_awaiting(coroutine);
+        source_.emplace(cancellation_token_of(coroutine));
+        callback_.emplace(token_, Cancel { &*source_ });
+        await_into(counter_, { source_->token(), locals_of(coroutine) }, awaitable_, result_).start();
+        return counter_.suspend();
+    }
+    Result await_resume()
+    {
+        callback_.reset();
+        counter_.rethrow_if_failed();
+        if constexpr (!std::is_void_v<Result>) {
+            return std::move(*result_);
+        }
+    }
+
+private:
+    CancellationToken token_;
+    A awaitable_;
+    std::optional<non_void_t<Result>> result_;
+    JoinCounter counter_ { 1 };
+    std::optional<CancellationSource> source_;
+    std::optional<CancellationCallback<Cancel>> callback_;
+};
+
+} // namespace detail
+
+//Awaits all awaitables concurrently, each one runs in a small coroutine of its own until it
+//suspends. Lvalues are awaited in place, rvalues are moved into the returned awaiter.
+//    auto [a, b] = co_await bco::when_all(fetch(shard_a), fetch(shard_b));
+//void results show up as std::monostate. If any of them throws, the first exception is rethrown
+//once all of them finished.
+template <typename... A>
+[[nodiscard]] auto when_all(A&&... awaitables)
+{
+    return detail::WhenAllAwaiter<A...> { std::forward<A>(awaitables)... };
+}
+
+//a std::vector of the results, in the order of the range, nothing for void results
+template <std::ranges::forward_range R>
+[[nodiscard]] auto when_all(R&& range)
+{
+    return detail::WhenAllRangeAwaiter<R> { std::forward<R>(range) };
+}
+
+//Takes the results of the when_any() losers which finished before they saw the cancellation.
+template <typename F>
+struct LoserDisposer {
+    F dispose;
+};
+
+template <typename F>
+[[nodiscard]] LoserDisposer<F> on_loser(F dispose)
+{
+    return { std::move(dispose) };
+}
+
+//The result of the first awaitable to finish, the index of the std::variant tells which one.
+//The others are cancelled through their tokens, and awaited before the awaiting coroutine
+//resumes, so nothing is left running on its frame.
+//An exception thrown first wins like a result, the others are cancelled and it is rethrown. The
+//exceptions of losers are dropped.
+//The losers' results, mostly -ECANCELED but possibly e.g. an accept() which got its connection
+//just before the cancellation, are destroyed, which leaks an accepted descriptor, unless an
+//on_loser() disposer is passed first. It is called with each of them as an rvalue, on the thread
+//of the loser and possibly concurrently with other losers:
+//    auto close = bco::on_loser([](auto&& accepted) {
+//        if (auto& socket = std::get<0>(accepted); socket.native_handle() >= 0) {
+//            socket.close();
+//        }
+//    });
+//    auto [index, accepted] = co_await bco::when_any(close, accepts);
+template <typename... A>
+requires(sizeof...(A) > 0)
+[[nodiscard]] auto when_any(A&&... awaitables)
+{
+    return detail::WhenAnyAwaiter<detail::DropLoser, A...> { {}, std::forward<A>(awaitables)... };
+}
+
+template <typename F, typename... A>
+requires(sizeof...(A) > 0)
+[[nodiscard]] auto when_any(LoserDisposer<F> disposer, A&&... awaitables)
+{
+    return detail::WhenAnyAwaiter<F, A...> { std::move(disposer.dispose), std::forward<A>(awaitables)... };
+}
+
+//{ index, result } of the first awaitable of a non-empty range to finish, the index alone if void
+template <std::ranges::forward_range R>
+[[nodiscard]] auto when_any(R&& range)
+{
+    return detail::WhenAnyRangeAwaiter<detail::DropLoser, R> { {}, std::forward<R>(range) };
+}
+
+template <typename F, std::ranges::forward_range R>
+[[nodiscard]] auto when_any(LoserDisposer<F> disposer, R&& range)
+{
+    return detail::WhenAnyRangeAwaiter<F, R> { std::move(disposer.dispose), std::forward<R>(range) };
+}
+
+//Awaits the awaitable with a token cancelled by 'token' as well as by the token of the awaiting
+//coroutine. The Funcs it awaits and the socket operations they start inherit it.
+//    bco::CancellationSource stop;
+//    int bytes = co_await bco::with_cancellation(stop.token(), socket.recv(buffer));
+template <typename A>
+[[nodiscard]] auto with_cancellation(CancellationToken token, A&& awaitable)
+{
+    return detail::WithCancellationAwaiter<A> { token, std::forward<A>(awaitable) };
+}
+
+} // namespace bco
@@ -1,5 +1,6 @@
 #pragma once
 #include <functional>
+#include <memory>
 #include <vector>
 #include <chrono>
 #include <bco/proactor.h>
@@ -14,11 +15,15 @@ public:
     virtual void post(PriorityTask task) = 0;
     virtual void post_delay(std::chrono::milliseconds duration, PriorityTask task) = 0;
     virtual void start() = 0;
-    virtual void set_proactor_task_getter(std::function<std::vector<PriorityTask>()> func) = 0;
+    virtual void set_proactor_task_getter(std::function<CompletionList()> func) = 0;
     virtual bool is_current_executor() = 0;
     virtual void set_context(std::weak_ptr<Context> ctx) = 0;
     virtual void wake() = 0;
     virtual bool is_running() = 0;
+    //stops the loops and joins the threads, tasks still queued are dropped. Idempotent
+    virtual void stop() = 0;
+    //number of tasks posted but not run yet, delayed tasks are not counted
+    virtual size_t pending_tasks() = 0;
 };
 
 } // namespace bco
@@ -25,11 +25,13 @@ public:
     void post(PriorityTask task) override;
     void post_delay(std::chrono::milliseconds duration, PriorityTask task) override;
     void start() override;
-    void set_proactor_task_getter(std::function<std::vector<PriorityTask>()> func) override;
+    void set_proactor_task_getter(std::function<CompletionList()> func) override;
     bool is_current_executor() override;
     void set_context(std::weak_ptr<Context> ctx) override;
     void wake() override;
     bool is_running() override;
+    void stop() override;
+    size_t pending_tasks() override;
 
 private:
     void main_loop();
@@ -39,6 +41,7 @@ private:
     void worker_sleep(const size_t worker_index);
     std::optional<PriorityTask> take_one();
     void request_proactor_task();
+    void dispatch(PriorityTask& task);
     size_t next_worker_index();
     std::tuple<std::vector<PriorityTask>, std::chrono::milliseconds> get_timeup_delay_tasks();
 
@@ -49,6 +52,8 @@ private:
         ~Worker();
         std::thread::id thread_id() const;
         void set_thread(std::thread&& thread);
+        void join();
+        size_t size();
         void sleep_for(std::chrono::milliseconds ms);
         void wake_up();
         void post(PriorityTask task);
@@ -71,7 +76,7 @@ private:
     WaitGroup wg_;
     std::weak_ptr<Context> ctx_;
 
-    std::function<std::vector<PriorityTask>()> get_proactor_task_;
+    std::function<CompletionList()> get_proactor_task_;
 
     //random
     std::mt19937 random_engine_;
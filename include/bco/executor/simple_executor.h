@@ -18,21 +18,23 @@ public:
     void post(PriorityTask task) override;
     void post_delay(std::chrono::milliseconds duration, PriorityTask task) override;
     void start() override;
-    void set_proactor_task_getter(std::function<std::vector<PriorityTask>()> func) override;
+    void set_proactor_task_getter(std::function<CompletionList()> func) override;
     bool is_current_executor();
     void set_context(std::weak_ptr<Context> ctx) override;
     void wake() override;
     bool is_running() override;
+    void stop() override;
+    size_t pending_tasks() override;
 
 private:
     void do_start();
     void wake_up();
     inline std::deque<PriorityTask> get_pending_tasks();
     inline std::tuple<std::vector<PriorityTask>, std::chrono::milliseconds> get_timeup_delay_tasks();
-    inline std::vector<PriorityTask> get_proactor_tasks();
+    inline CompletionList get_proactor_tasks();
 
 private:
-    std::function<std::vector<PriorityTask>()> get_proactor_task_;
+    std::function<CompletionList()> get_proactor_task_;
     std::deque<PriorityTask> tasks_;
     std::priority_queue<PriorityDelayTask> delay_tasks_;
     std::mutex mutex_;
@@ -43,7 +45,7 @@ private:
     std::thread thread_;
     bool started_ = false;
     std::weak_ptr<Context> ctx_;
-    bool stoped_ = false;
+    std::atomic<bool> stoped_ { false };
 };
 
 } //namespace bco
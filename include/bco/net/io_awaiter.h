@@ -0,0 +1,105 @@
+#pragma once
+#include <atomic>
+#include <cerrno>
+#include <coroutine>
+#include <optional>
+
+#include <bco/cancellation.h>
+#include <bco/coroutine/frame.h>
+#include <bco/net/proactor/io_completion.h>
+#include <bco/utils.h>
+
+namespace bco {
+
+namespace net {
+
+//Awaiter of one socket operation, which is also the completion the proactor pushes once the
+//operation is done. It lives in the frame of the suspended coroutine, so nothing is allocated or
+//reference counted between the proactor and the coroutine.
+//The operation is submitted when it is awaited, by 'int Derived::submit()' which returns what the
+//proactor returned; Derived::await_resume() makes the result out of the completion.
+//Without a token of its own it takes the one of the awaiting coroutine. Once that is cancelled,
+//'void Derived::cancel_submitted()' asks the proactor to complete the operation early, with
+//-ECANCELED unless it finished meanwhile.
+template <typename Derived>
+class IoAwaiter : public IoCompletion {
+    struct Cancel {
+        IoAwaiter* awaiter;
+        void operator()() const { static_cast<Derived*>(awaiter)->cancel_submitted(); }
+    };
+
+public:
+    explicit IoAwaiter(bco::detail::AwaitInfo info, CancellationToken token = {})
+        : IoCompletion(get_current_worker_index(get_current_executor()))
+        , info_(info)
+        , token_(token)
+    {
+    }
+    //movable until awaited, e.g. into when_all()
+    IoAwaiter(IoAwaiter&& other) noexcept
+        : IoCompletion(other.affinity())
+        , info_(other.info_)
+        , token_(other.token_)
+    {
+    }
+
+    bool await_ready() const noexcept { return false; }
+    template <typename Promise>
+    bool await_suspend(std::coroutine_handle<Promise> coroutine)
+    {
+        if (!token_.cancellable()) {
+            token_ = bco::detail::cancellation_token_of(coroutine);
+        }
+        if (token_.cancelled()) {
+            set_result(-ECANCELED);
+            return false;
+        }
+        coroutine_ = coroutine;
+        const bool cancellable = token_.cancellable();
+        cancellable_ = cancellable;
+        //the coroutine may be resumed on another thread before submit() returns, 'this' is gone then
+        //unless the operation is cancellable, run() waits for the callback to be registered
+        int ret = static_cast<Derived*>(this)->submit();
+        if (ret < 0) {
+            set_result(ret);
+            return false;
+        }
+        if (!cancellable) {
+            return true;
+        }
+        callback_.emplace(token_, Cancel { this });
+        if (arrived_.exchange(true, std::memory_order::acq_rel)) {
+            callback_.reset();
+            return false;
+        }
+        return true;
+    }
+    bco::detail::AwaitInfo await_info() const noexcept { return info_; }
+
+    void run() override
+    {
+        if (cancellable_) {
+            //await_suspend() resumes the coroutine
+            if (!arrived_.exchange(true, std::memory_order::acq_rel)) {
+                return;
+            }
+            //waits for a cancellation running on another thread
+            callback_.reset();
+        }
+        coroutine_.resume();
+    }
+    //the coroutine stays suspended, like with an operation that never completes
+    void discard() override { }
+
+private:
+    std::coroutine_handle<> coroutine_;
+    bco::detail::AwaitInfo info_;
+    CancellationToken token_;
+    bool cancellable_ { false };
+    std::atomic<bool> arrived_ { false };
+    std::optional<CancellationCallback<Cancel>> callback_;
+};
+
+} // namespace net
+
+} // namespace bco
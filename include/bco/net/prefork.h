@@ -0,0 +1,127 @@
+#pragma once
+#ifdef __linux__
+#include <netinet/in.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include <bco/net/address.h>
+#include <bco/net/tcp.h>
+#include <bco/net/udp.h>
+
+namespace bco {
+
+namespace net {
+
+//Array of counters in anonymous shared memory, created before fork() so the supervisor and
+//all the workers see the same values.
+class SharedCounters {
+public:
+    explicit SharedCounters(size_t count);
+    ~SharedCounters();
+    SharedCounters(const SharedCounters&) = delete;
+    SharedCounters& operator=(const SharedCounters&) = delete;
+
+    std::atomic<uint64_t>& operator[](size_t index) { return counters_[index]; }
+    size_t size() const { return size_; }
+
+private:
+    std::atomic<uint64_t>* counters_;
+    size_t size_;
+};
+
+//Runs N worker processes behind the same ports.
+//Every listener gets one SO_REUSEPORT socket per worker slot, all bound before the first fork,
+//so starting or restarting a worker costs a fork() and nothing else, and the kernel spreads the
+//connections across the workers. A crashed worker is forked again on the same slot and picks up
+//the connections queued on its socket in the meantime. A slot whose fork() failed is retried
+//after the restart delay, fork_failures() counts the failures.
+//    Supervisor supervisor { { .workers = 4, .counters = 1 } };
+//    auto http = supervisor.listen_tcp(Address { IPv4 { "0.0.0.0" }, 80 });
+//    supervisor.run([&](Supervisor::Worker& worker) {
+//        auto ctx = ...;
+//        auto socket = worker.tcp_listener(ctx->get_proactor<Epoll>(), http);
+//        ...
+//        return 0;
+//    });
+class Supervisor {
+public:
+    struct Options {
+        size_t workers = std::thread::hardware_concurrency();
+        size_t counters = 0;
+        //wait before forking a crashed worker again, keeps a crash loop from eating the machine
+        std::chrono::milliseconds restart_delay { 100 };
+    };
+
+    //what a worker process gets, only valid inside the worker
+    class Worker {
+    public:
+        size_t index() const { return index_; }
+        SharedCounters& counters() { return counters_; }
+        int listener_fd(size_t listener) const { return fds_[listener]; }
+        template <SocketProactor P>
+        TcpSocket<P> tcp_listener(P* proactor, size_t listener) const { return TcpSocket<P> { proactor, families_[listener], fds_[listener] }; }
+        template <SocketProactor P>
+        UdpSocket<P> udp_listener(P* proactor, size_t listener) const { return UdpSocket<P> { proactor, families_[listener], fds_[listener] }; }
+
+    private:
+        friend class Supervisor;
+        Worker(size_t index, SharedCounters& counters, std::vector<int> fds, std::vector<int> families);
+
+        size_t index_;
+        SharedCounters& counters_;
+        std::vector<int> fds_;
+        std::vector<int> families_;
+    };
+    //the return value is the exit code of the worker process
+    using WorkerMain = std::function<int(Worker&)>;
+
+    explicit Supervisor(const Options& options);
+    ~Supervisor();
+    Supervisor(const Supervisor&) = delete;
+    Supervisor& operator=(const Supervisor&) = delete;
+
+    //both return the listener index to use in the workers, throw NetworkException on failure
+    size_t listen_tcp(const Address& addr, int backlog = 1024);
+    size_t bind_udp(const Address& addr);
+
+    //Forks the workers and supervises them until stop(), then terminates them and returns.
+    //Call it before the process starts any thread, the workers create their Contexts themselves.
+    void run(WorkerMain main);
+    //async-signal-safe, so it can be called from a SIGTERM/SIGINT handler
+    void stop();
+
+    SharedCounters& counters() { return counters_; }
+    uint64_t restarts() const { return restarts_.load(std::memory_order::relaxed); }
+    uint64_t fork_failures() const { return fork_failures_.load(std::memory_order::relaxed); }
+
+private:
+    struct Listener {
+        int family;
+        //one socket per worker slot
+        std::vector<int> fds;
+    };
+    size_t add_listener(const Address& addr, int type, int backlog);
+    void spawn(size_t slot, const WorkerMain& main);
+    void terminate_all();
+
+private:
+    const Options options_;
+    SharedCounters counters_;
+    std::vector<Listener> listeners_;
+    std::vector<std::atomic<pid_t>> pids_;
+    std::atomic<bool> stopping_ { false };
+    std::atomic<uint64_t> restarts_ { 0 };
+    std::atomic<uint64_t> fork_failures_ { 0 };
+};
+
+} // namespace net
+
+} // namespace bco
+
+#endif // ifdef __linux__
@@ -3,6 +3,7 @@
 #include <netinet/in.h>
 #include <sys/epoll.h>
 
+#include <atomic>
 #include <functional>
 #include <map>
 #include <memory>
@@ -15,6 +16,7 @@
 #include <bco/buffer.h>
 #include <bco/executor.h>
 #include <bco/net/address.h>
+#include <bco/net/proactor/io_completion.h>
 #include <bco/proactor.h>
 
 namespace bco {
@@ -36,8 +38,14 @@ class Epoll : public ProactorInterface {
     friend Action& operator&=(Action& lhs, const Action& rhs);
     struct EpollItem {
         bco::Buffer buff;
-        std::function<void(int)> cb;
-        std::function<void(int, const sockaddr_storage&)> cb2;
+        //pushed when the operation completes
+        IoCompletion* completion;
+        uint64_t operation;
+    };
+    struct CancelRequest {
+        int fd;
+        IoCompletion* completion;
+        uint64_t operation;
     };
     struct EpollTask {
         epoll_event event;
@@ -51,32 +59,42 @@ public:
     ~Epoll() override;
 
     void start(ExecutorInterface* executor);
-    void stop();
+    void stop() override;
 
     int create(int domain, int type);
 
-    int recv(int s, bco::Buffer buff, std::function<void(int)> cb);
+    int recv(int s, bco::Buffer buff, IoCompletion* completion);
 
-    int recvfrom(int s, bco::Buffer buff, std::function<void(int, const sockaddr_storage&)> cb, void* optdata = nullptr);
+    int recvfrom(int s, bco::Buffer buff, IoCompletion* completion, void* optdata = nullptr);
 
-    int send(int s, bco::Buffer buff, std::function<void(int)> cb);
+    int send(int s, bco::Buffer buff, IoCompletion* completion);
     int send(int s, bco::Buffer buff);
 
     int sendto(int s, bco::Buffer buff, const sockaddr_storage& addr, void* optdata = nullptr);
 
-    int accept(int listen_fd, std::function<void(int, const sockaddr_storage&)> cb);
+    int accept(int listen_fd, IoCompletion* completion);
 
-    int connect(int s, const sockaddr_storage& addr, std::function<void(int)> cb);
+    int connect(int s, const sockaddr_storage& addr, IoCompletion* completion);
     int connect(int s, const sockaddr_storage& addr);
 
-    std::vector<PriorityTask> harvest() override;
+    //completes the operation with -ECANCELED unless it finished already
+    void cancel(int s, IoCompletion* completion);
+
+    CompletionList harvest() override;
+    void drain() override;
+    size_t inflight() override;
+    void cancel_all() override;
 
 private:
     std::map<int, EpollTask> get_pending_tasks();
+    std::vector<CancelRequest> get_cancel_requests();
+    void cancel_requested(const std::vector<CancelRequest>& requests);
+    //mtx_ held
+    uint64_t number(IoCompletion* completion);
     void submit_tasks(std::map<int, EpollTask>& pending_tasks);
     void do_io();
-    int send_sync(int s, bco::Buffer buff, std::function<void(int)> cb);
-    int send_async(int s, bco::Buffer buff, std::function<void(int)> cb);
+    int send_sync(int s, bco::Buffer buff, IoCompletion* completion);
+    int send_async(int s, bco::Buffer buff, IoCompletion* completion);
     void epoll_loop();
     int next_timeout();
     void on_io_event(const epoll_event& event);
@@ -85,6 +103,9 @@ private:
     void do_accept(EpollTask& task);
     void do_send(EpollTask& task);
     void on_connected(EpollTask& task);
+    void cancel_flying(bool accepts_only);
+    void complete(EpollItem& item, int result);
+    void complete(EpollItem& item, int result, const sockaddr_storage& addr);
 
 private:
     std::mutex mtx_;
@@ -92,8 +113,13 @@ private:
     int exit_fd_;
     std::map<int, EpollTask> pending_tasks_;
     std::map<int, EpollTask> flying_tasks_;
-    std::vector<PriorityTask> completed_task_;
+    std::vector<CancelRequest> cancel_requests_;
+    uint64_t operations_ { 0 };
+    CompletionQueue completions_;
     ExecutorInterface* io_executor_;
+    std::atomic<size_t> inflight_ { 0 };
+    std::atomic<bool> draining_ { false };
+    std::atomic<bool> cancelled_ { false };
 };
 
 inline Epoll::Action operator|(const Epoll::Action& lhs, const Epoll::Action& rhs)
@@ -0,0 +1,79 @@
+#pragma once
+#ifdef _WIN32
+#include <WinSock2.h>
+#else
+#include <sys/socket.h>
+#endif
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include <bco/completion_queue.h>
+
+namespace bco {
+
+namespace net {
+
+//Completion of a socket operation, the proactors keep a pointer to it while the operation is in
+//flight and push it to their CompletionQueue with the result.
+//The caller owns it until the proactor call returned 0, a negative error code leaves it unused.
+class IoCompletion : public CompletionNode {
+public:
+    explicit IoCompletion(size_t affinity)
+        : CompletionNode(affinity)
+    {
+    }
+
+    void set_result(int result) { result_ = result; }
+    void set_result(int result, const sockaddr_storage& addr)
+    {
+        result_ = result;
+        addr_ = addr;
+    }
+    //bytes transferred, the accepted descriptor or a negative error code
+    int result() const { return result_; }
+    //peer of accept and recvfrom
+    const sockaddr_storage& address() const { return addr_; }
+    //Numbered by the proactor when it takes the operation. A cancel request carries the number, so
+    //that a late one does not hit the next operation using a completion at the same address.
+    void set_operation(uint64_t operation) { operation_ = operation; }
+    uint64_t operation() const { return operation_; }
+
+private:
+    int result_ { 0 };
+    uint64_t operation_ { 0 };
+    sockaddr_storage addr_ {};
+};
+
+//IoCompletion calling a function, allocated per operation and freed once it ran
+class CallbackCompletion final : public IoCompletion {
+public:
+    CallbackCompletion(std::function<void(int)> cb, size_t affinity)
+        : IoCompletion(affinity)
+        , cb_(std::move(cb))
+    {
+    }
+    CallbackCompletion(std::function<void(int, const sockaddr_storage&)> cb, size_t affinity)
+        : IoCompletion(affinity)
+        , cb2_(std::move(cb))
+    {
+    }
+
+    void run() override
+    {
+        std::unique_ptr<CallbackCompletion> self { this };
+        if (cb_) {
+            cb_(result());
+        } else {
+            cb2_(result(), address());
+        }
+    }
+
+private:
+    std::function<void(int)> cb_;
+    std::function<void(int, const sockaddr_storage&)> cb2_;
+};
+
+} // namespace net
+
+} // namespace bco
@@ -9,10 +9,12 @@
 #include <mutex>
 #include <span>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include <bco/buffer.h>
 #include <bco/net/address.h>
+#include <bco/net/proactor/io_completion.h>
 #include <bco/proactor.h>
 
 namespace bco {
@@ -26,36 +28,44 @@ public:
     ~IOCP() override;
 
     void start();
-    void stop();
+    void stop() override;
 
     int create(int domain, int type);
 
-    int recv(int s, bco::Buffer buff, std::function<void(int)> cb);
+    int recv(int s, bco::Buffer buff, IoCompletion* completion);
 
-    int recvfrom(int s, bco::Buffer buff, std::function<void(int, const sockaddr_storage&)> cb, void* optdata = nullptr);
+    int recvfrom(int s, bco::Buffer buff, IoCompletion* completion, void* optdata = nullptr);
 
-    int send(int s, bco::Buffer buff, std::function<void(int)> cb);
+    int send(int s, bco::Buffer buff, IoCompletion* completion);
     int send(int s, bco::Buffer buff);
 
     int sendto(int s, bco::Buffer buff, const sockaddr_storage& addr, void* optdata = nullptr);
 
-    int accept(int listen_fd, std::function<void(int, const sockaddr_storage&)> cb);
+    int accept(int listen_fd, IoCompletion* completion);
 
-    int connect(int s, const sockaddr_storage& addr, std::function<void(int)> cb);
+    int connect(int s, const sockaddr_storage& addr, IoCompletion* completion);
     int connect(int s, const sockaddr_storage& addr);
 
-    std::vector<PriorityTask> harvest() override;
+    //completes the operation with -ECANCELED unless it finished already
+    void cancel(int s, IoCompletion* completion);
+
+    CompletionList harvest() override;
 
 private:
     void iocp_loop();
     DWORD next_timeout();
     void handle_overlap_success(WSAOVERLAPPED* overlapped, int bytes);
+    void handle_overlap_failure(WSAOVERLAPPED* overlapped, int error);
+    void track(IoCompletion* completion, WSAOVERLAPPED* overlapped);
+    void untrack(IoCompletion* completion);
 
 private:
-    std::mutex mtx_;
     std::thread harvest_thread_;
-    std::vector<PriorityTask> completed_tasks_;
+    CompletionQueue completions_;
     ::HANDLE complete_port_;
+    std::mutex mtx_;
+    //the operations in flight, for cancel()
+    std::unordered_map<IoCompletion*, WSAOVERLAPPED*> flying_;
 };
 
 } // namespace net
@@ -3,17 +3,21 @@
 #include <linux/io_uring.h>
 #include <netinet/in.h>
 
+#include <atomic>
 #include <chrono>
 #include <cstdint>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <optional>
+#include <vector>
 
 #include <bco/buffer.h>
 #include <bco/executor.h>
 #include <bco/net/address.h>
+#include <bco/net/proactor/io_completion.h>
 #include <bco/proactor.h>
+#include <bco/utils.h>
 
 namespace bco {
 
@@ -30,6 +34,17 @@ public:
         std::optional<uint32_t> queue_depth;
     };
 
+    //what the running kernel offers, see probe()
+    struct Support {
+        bool available = false;
+        //IORING_FEAT_* flags
+        uint32_t features = 0;
+        //every opcode IOUring submits is supported
+        bool opcodes = false;
+        //this process may set up an SQPOLL ring
+        bool sq_poll = false;
+    };
+
 private:
     struct SqRing {
         void* mmap_ptr;
@@ -62,35 +77,36 @@ private:
         int fd;
         Action action;
         bco::Buffer buff;
-        std::function<void(int)> cb;
-        std::function<void(int, const sockaddr_storage&)> cb2;
+        IoCompletion* completion;
         std::vector<::iovec> iovecs; // SQ Polling模式下，iovecs的生命周期由UringTask保证
+        ::msghdr hdr {};
         std::optional<sockaddr_storage> addr;
+        ::socklen_t addrlen { sizeof(sockaddr_storage) };
+        bool cancelling { false };
         //UringTask() = default;
-        UringTask(uint64_t _id, int _fd, Action _action, bco::Buffer _buff, std::function<void(int)> _cb)
+        UringTask(uint64_t _id, int _fd, Action _action, bco::Buffer _buff, IoCompletion* _completion)
             : id(_id)
             , fd(_fd)
             , action(_action)
             , buff(_buff)
-            , cb(_cb)
+            , completion(_completion)
         {
         }
-        UringTask(uint64_t _id, int _fd, Action _action, bco::Buffer _buff, std::function<void(int, const sockaddr_storage&)> _cb)
+        //the peer address is written into addr
+        UringTask(uint64_t _id, int _fd, Action _action, bco::Buffer _buff, IoCompletion* _completion, bool)
             : id(_id)
             , fd(_fd)
             , action(_action)
             , buff(_buff)
-            , cb2(_cb)
+            , completion(_completion)
+            , addr(sockaddr_storage {})
         {
         }
-        UringTask(uint64_t _id, int _fd, Action _action, bco::Buffer _buff, std::function<void(int, const sockaddr_storage&)> _cb, bool)
-            : id(_id)
-            , fd(_fd)
-            , action(_action)
-            , buff(_buff)
-            , cb2(_cb)
-            , addr(sockaddr_storage {})
+        //the completion is gone once pushed, a task destroyed before discards it
+        ~UringTask()
         {
+            if (completion != nullptr)
+                completion->discard();
         }
         UringTask(const UringTask&) = delete;
         UringTask& operator=(const UringTask&) = delete;
@@ -99,29 +115,39 @@ private:
     };
 
 public:
+    //throws NetworkException if the kernel lacks io_uring or one of the opcodes IOUring needs
     IOUring(const Params& params);
     ~IOUring() override;
 
     void start(ExecutorInterface* executor);
-    void stop();
+    void stop() override;
 
     int create(int domain, int type);
 
-    int recv(int s, bco::Buffer buff, std::function<void(int)> cb);
+    int recv(int s, bco::Buffer buff, IoCompletion* completion);
 
-    int recvfrom(int s, bco::Buffer buff, std::function<void(int, const sockaddr_storage&)> cb, void* optdata = nullptr);
+    int recvfrom(int s, bco::Buffer buff, IoCompletion* completion, void* optdata = nullptr);
 
-    int send(int s, bco::Buffer buff, std::function<void(int)> cb);
+    int send(int s, bco::Buffer buff, IoCompletion* completion);
     int send(int s, bco::Buffer buff);
 
     int sendto(int s, bco::Buffer buff, const sockaddr_storage& addr, void* optdata = nullptr);
 
-    int accept(int s, std::function<void(int, const sockaddr_storage&)> cb);
+    int accept(int s, IoCompletion* completion);
 
-    int connect(int s, const sockaddr_storage& addr, std::function<void(int)> cb);
+    int connect(int s, const sockaddr_storage& addr, IoCompletion* completion);
     int connect(int s, const sockaddr_storage& addr);
 
-    std::vector<PriorityTask> harvest() override;
+    //completes the operation with -ECANCELED unless it finished already
+    void cancel(int s, IoCompletion* completion);
+
+    //sets up throwaway rings to find out what io_uring supports
+    static Support probe();
+
+    CompletionList harvest() override;
+    void drain() override;
+    size_t inflight() override;
+    void cancel_all() override;
 
 private:
     void do_io();
@@ -131,23 +157,36 @@ private:
     void submit_rw(UringTask& task);
     void submit_connect(UringTask& task);
     void submit_accept(UringTask& task);
-    void submit_sqe(int32_t fd, uint8_t opcode, void* addr, uint64_t len, uint64_t user_data);
+    unsigned free_sqes() const;
+    void submit_sqe(int32_t fd, uint8_t opcode, void* addr, uint32_t len, uint64_t off, uint64_t user_data);
+    void refuse_tasks(std::map<uint64_t, UringTask>& tasks);
+    size_t cancel_flying_tasks();
+    size_t cancel_requested_tasks();
+    void submit_cancel(UringTask& task);
+    void complete(UringTask& task, int result);
     void handle_complete_tasks();
     void handle_complete_task(uint64_t id, const io_uring_cqe* cqe);
     uint8_t action_to_opcode(Action action);
-    void verify_kernel_version();
+    void verify_opcodes();
     void setup_io_uring(const Params& params);
     int _io_uring_setup(unsigned entries, struct io_uring_params* p);
     int _io_uring_enter(int ring_fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags);
 
 private:
-    int fd_;
+    int fd_ { -1 };
+    bool sq_poll_ { false };
     ExecutorInterface* executor_;
     std::atomic<uint64_t> lastest_task_id_ { 0 };
     std::map<uint64_t, UringTask> pending_tasks_;
     std::map<uint64_t, UringTask> flying_tasks_;
-    std::vector<PriorityTask> completed_task_;
+    //ids of the tasks to cancel
+    std::vector<uint64_t> cancel_requests_;
+    CompletionQueue completions_;
     std::mutex mutex_;
+    std::atomic<size_t> inflight_ { 0 };
+    std::atomic<bool> draining_ { false };
+    std::atomic<bool> cancelled_ { false };
+    std::atomic<bool> stopped_ { false };
     size_t sq_entries_ {};
     ::io_uring_sqe* sqes_ { nullptr };
     SqRing sq_ring_ {};
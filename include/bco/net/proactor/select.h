@@ -6,6 +6,7 @@
 #endif
 
 #include <array>
+#include <atomic>
 #include <functional>
 #include <map>
 #include <memory>
@@ -17,6 +18,7 @@
 #include <bco/executor.h>
 #include <bco/net/address.h>
 #include <bco/net/event.h>
+#include <bco/net/proactor/io_completion.h>
 #include <bco/proactor.h>
 
 namespace bco {
@@ -35,14 +37,19 @@ class Select : public ProactorInterface {
         int fd;
         Action action;
         bco::Buffer buff;
-        std::function<void(int)> cb;
-        std::function<void(int, const sockaddr_storage&)> cb2;
+        //pushed when the operation completes
+        IoCompletion* completion = nullptr;
+        uint64_t operation = 0;
         #ifdef _WIN32
         void* recvmsg_func = nullptr;
         #endif
         SelectTask() = default;
-        SelectTask(int _fd, Action _action, bco::Buffer _buff, std::function<void(int)> _cb);
-        SelectTask(int _fd, Action _action, bco::Buffer _buff, std::function<void(int, const sockaddr_storage&)> _cb);
+        SelectTask(int _fd, Action _action, bco::Buffer _buff, IoCompletion* _completion);
+    };
+    struct CancelRequest {
+        int fd;
+        IoCompletion* completion;
+        uint64_t operation;
     };
 
 public:
@@ -51,35 +58,47 @@ public:
 
     void start(ExecutorInterface* executor);
     void start(std::unique_ptr<ExecutorInterface>&& executor);
-    void stop();
+    void stop() override;
 
     int create(int domain, int type);
 
-    int recv(int s, bco::Buffer buff, std::function<void(int)> cb);
+    int recv(int s, bco::Buffer buff, IoCompletion* completion);
 
-    int recvfrom(int s, bco::Buffer buff, std::function<void(int, const sockaddr_storage&)> cb, void* optdata = nullptr);
+    int recvfrom(int s, bco::Buffer buff, IoCompletion* completion, void* optdata = nullptr);
 
-    int send(int s, bco::Buffer buff, std::function<void(int)> cb);
+    int send(int s, bco::Buffer buff, IoCompletion* completion);
     int send(int s, bco::Buffer buff);
 
     int sendto(int s, bco::Buffer buff, const sockaddr_storage& addr, void* optdata = nullptr);
 
-    int accept(int s, std::function<void(int, const sockaddr_storage&)> cb);
+    int accept(int s, IoCompletion* completion);
 
-    int connect(int s, const sockaddr_storage& addr, std::function<void(int)> cb);
+    int connect(int s, const sockaddr_storage& addr, IoCompletion* completion);
     int connect(int s, const sockaddr_storage& addr);
 
-    std::vector<PriorityTask> harvest() override;
+    //completes the operation with -ECANCELED unless it finished already
+    void cancel(int s, IoCompletion* completion);
+
+    CompletionList harvest() override;
+    void drain() override;
+    size_t inflight() override;
+    void cancel_all() override;
 
 private:
     void do_io();
-    int send_sync(int s, bco::Buffer buff, std::function<void(int)> cb);
-    int send_async(int s, bco::Buffer buff, std::function<void(int)> cb);
+    int send_sync(int s, bco::Buffer buff, IoCompletion* completion);
+    int send_async(int s, bco::Buffer buff, IoCompletion* completion);
     void do_accept(const SelectTask& task);
     void do_recv(const SelectTask& task);
     void do_recvfrom(const SelectTask& task);
     void do_send(const SelectTask& task);
     void on_connected(const SelectTask& task);
+    void cancel_pending(bool accepts_only);
+    void cancel_requested();
+    //mtx_ held
+    void number(SelectTask& task);
+    void complete(const SelectTask& task, int result);
+    void complete(const SelectTask& task, int result, const sockaddr_storage& addr);
     void on_io_event(const std::map<int, SelectTask>& tasks, const fd_set& fds);
     std::tuple<std::map<int, SelectTask>, std::map<int, SelectTask>> get_pending_io();
     static void prepare_fd_set(const std::map<int, SelectTask>& tasks, fd_set& fds);
@@ -93,7 +112,10 @@ private:
     int max_wfd_ {};
     std::map<int, SelectTask> pending_rfds_;
     std::map<int, SelectTask> pending_wfds_;
-    std::vector<PriorityTask> completed_task_;
+    std::vector<CancelRequest> cancel_requests_;
+    uint64_t operations_ { 0 };
+    CompletionQueue completions_;
+    std::atomic<size_t> completed_ { 0 };
     fd_set rfds_ {};
     fd_set wfds_ {};
     fd_set efds_ {};
@@ -102,6 +124,8 @@ private:
     std::unique_ptr<ExecutorInterface> io_executor_holder_;
     timeval timeout_;
     std::atomic<bool> polling_ { false };
+    std::atomic<bool> draining_ { false };
+    std::atomic<bool> cancelled_ { false };
 };
 
 } // namespace net
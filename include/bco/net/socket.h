@@ -10,6 +10,7 @@
 
 #include <bco/buffer.h>
 #include <bco/net/address.h>
+#include <bco/net/proactor/io_completion.h>
 #include <bco/proactor.h>
 
 namespace bco {
@@ -19,21 +20,20 @@ namespace net {
 template <typename T>
 concept SocketProactor = bco::Proactor<T>&& requires(T p, int fd, int domain, int type, uint32_t timeout_ms,
     const sockaddr_storage& addr, bco::Buffer buff, void* optdata,
-    std::function<void(int)> cb, int backlog,
-    std::function<void(int, const sockaddr_storage&)> cb2)
+    IoCompletion* completion, int backlog)
 {
     {
-        p.recv(fd, buff, cb)
+        p.recv(fd, buff, completion)
     }
     ->std::same_as<int>;
 
     {
-        p.recvfrom(fd, buff, cb2, optdata)
+        p.recvfrom(fd, buff, completion, optdata)
     }
     ->std::same_as<int>;
 
     {
-        p.send(fd, buff, cb)
+        p.send(fd, buff, completion)
     }
     ->std::same_as<int>;
 
@@ -48,12 +48,12 @@ concept SocketProactor = bco::Proactor<T>&& requires(T p, int fd, int domain, in
     ->std::same_as<int>;
 
     {
-        p.accept(fd, cb2)
+        p.accept(fd, completion)
     }
     ->std::same_as<int>;
 
     {
-        p.connect(fd, addr, cb)
+        p.connect(fd, addr, completion)
     }
     ->std::same_as<int>;
 
@@ -67,6 +67,11 @@ concept SocketProactor = bco::Proactor<T>&& requires(T p, int fd, int domain, in
     }
     ->std::same_as<int>;
 
+    {
+        p.cancel(fd, completion)
+    }
+    ->std::same_as<void>;
+
     //{
     //    p.bind(fd, addr)
     //}
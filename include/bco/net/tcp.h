@@ -1,6 +1,7 @@
 #pragma once
 #include <cassert>
 
+#include <bco/net/io_awaiter.h>
 #include <bco/net/socket.h>
 #include <bco/coroutine/task.h>
 
@@ -17,20 +18,75 @@ public:
         Both = 2,
     };
 
+    //bytes transferred or a negative error code
+    class RecvAwaiter : public IoAwaiter<RecvAwaiter> {
+    public:
+        RecvAwaiter(P* proactor, int fd, bco::Buffer buffer, CancellationToken token);
+        int submit();
+        void cancel_submitted() { proactor_->cancel(fd_, this); }
+        int await_resume() const noexcept { return this->result(); }
+
+    private:
+        P* proactor_;
+        int fd_;
+        bco::Buffer buffer_;
+    };
+    class SendAwaiter : public IoAwaiter<SendAwaiter> {
+    public:
+        SendAwaiter(P* proactor, int fd, bco::Buffer buffer, CancellationToken token);
+        int submit();
+        void cancel_submitted() { proactor_->cancel(fd_, this); }
+        int await_resume() const noexcept { return this->result(); }
+
+    private:
+        P* proactor_;
+        int fd_;
+        bco::Buffer buffer_;
+    };
+    class AcceptAwaiter : public IoAwaiter<AcceptAwaiter> {
+    public:
+        AcceptAwaiter(P* proactor, int family, int fd, CancellationToken token);
+        int submit();
+        void cancel_submitted() { proactor_->cancel(fd_, this); }
+        std::tuple<TcpSocket, Address> await_resume() const;
+
+    private:
+        P* proactor_;
+        int family_;
+        int fd_;
+    };
+    //0 or a negative error code
+    class ConnectAwaiter : public IoAwaiter<ConnectAwaiter> {
+    public:
+        ConnectAwaiter(P* proactor, int fd, const Address& addr, CancellationToken token);
+        int submit();
+        void cancel_submitted() { proactor_->cancel(fd_, this); }
+        int await_resume() const noexcept { return this->result() < 0 ? this->result() : 0; }
+
+    private:
+        P* proactor_;
+        int fd_;
+        sockaddr_storage addr_ {};
+    };
+
 public:
     static std::tuple<TcpSocket, int> create(P* proactor, int family);
 
     TcpSocket() = default;
     TcpSocket(P* proactor, int family, int fd = -1);
 
-    [[nodiscard]] Task<int> recv(bco::Buffer buffer);
-    [[nodiscard]] Task<int> send(bco::Buffer buffer);
-    [[nodiscard]] Task<std::tuple<TcpSocket<P>, Address>> accept();
-    [[nodiscard]] Task<int> connect(const Address& addr);
+    //The operations are submitted when awaited, their state lives in the awaiting coroutine.
+    //Without a token of their own, they are cancelled with the token of the awaiting coroutine.
+    [[nodiscard]] RecvAwaiter recv(bco::Buffer buffer, CancellationToken token = {});
+    [[nodiscard]] SendAwaiter send(bco::Buffer buffer, CancellationToken token = {});
+    [[nodiscard]] AcceptAwaiter accept(CancellationToken token = {});
+    [[nodiscard]] ConnectAwaiter connect(const Address& addr, CancellationToken token = {});
     int listen(int backlog);
     int bind(const Address& addr);
     void shutdown(Shutdown how);
     void close();
+    //the descriptor, or the negative error code of a failed accept()
+    int native_handle() const { return socket_; }
 
 private:
     P* proactor_;
@@ -1,4 +1,5 @@
 #pragma once
+#include <bco/net/io_awaiter.h>
 #include <bco/net/socket.h>
 #include <bco/coroutine/task.h>
 #include <bco/net/proactor/select.h>
@@ -40,24 +41,48 @@ protected:
 
 template <SocketProactor P>
 class UdpSocket : public detail::WinSpecFunc<P> {
+public:
+    //bytes received or a negative error code
+    class RecvAwaiter : public IoAwaiter<RecvAwaiter> {
+    public:
+        RecvAwaiter(P* proactor, int fd, bco::Buffer buffer, CancellationToken token);
+        int submit();
+        void cancel_submitted() { proactor_->cancel(fd_, this); }
+        int await_resume() const noexcept { return this->result(); }
+
+    private:
+        P* proactor_;
+        int fd_;
+        bco::Buffer buffer_;
+    };
+    class RecvfromAwaiter : public IoAwaiter<RecvfromAwaiter> {
+    public:
+        RecvfromAwaiter(P* proactor, int fd, bco::Buffer buffer, void* optdata, CancellationToken token);
+        int submit();
+        void cancel_submitted() { proactor_->cancel(fd_, this); }
+        std::tuple<int, Address> await_resume() const;
+
+    private:
+        P* proactor_;
+        int fd_;
+        bco::Buffer buffer_;
+        void* optdata_;
+    };
+
 public:
     static std::tuple<UdpSocket, int> create(P* proactor, int family);
 
     UdpSocket() = default;
     UdpSocket(P* proactor, int family, int fd = -1);
 
-    [[nodiscard]] Task<int> recv(bco::Buffer buffer);
-    [[nodiscard]] Task<std::tuple<int, Address>> recvfrom(bco::Buffer buffer);
+    [[nodiscard]] RecvAwaiter recv(bco::Buffer buffer, CancellationToken token = {});
+    [[nodiscard]] RecvfromAwaiter recvfrom(bco::Buffer buffer, CancellationToken token = {});
     int connect(const Address& addr);
     int send(bco::Buffer buffer);
     int sendto(bco::Buffer, const Address& addr);
     int bind(const Address& addr);
     void close();
 
-private:
-    [[nodiscard]] Task<std::tuple<int, Address>> recvfrom_normal(bco::Buffer buffer);
-    [[nodiscard]] Task<std::tuple<int, Address>> recvfrom_win(bco::Buffer buffer);
-
 private:
     P* proactor_;
     int family_;
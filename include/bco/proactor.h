@@ -2,6 +2,10 @@
 #include <vector>
 #include <functional>
 #include <chrono>
+#include <limits>
+
+#include <bco/accounting.h>
+#include <bco/completion_queue.h>
 
 namespace bco {
 
@@ -15,11 +19,27 @@ inline bool operator<(const Priority& left, const Priority& right)
     return static_cast<std::underlying_type_t<Priority>>(left) < static_cast<std::underlying_type_t<Priority>>(right);
 }
 
+//worker that should run the task, e.g. the one which issued the io operation
+constexpr size_t kAnyWorker = std::numeric_limits<size_t>::max();
+
 struct PriorityTask {
     Priority priority;
     std::function<void()> task;
-    void operator()() { task(); }
-    void run() { task(); }
+    size_t affinity = kAnyWorker;
+    //when the task became runnable, only stamped while routine accounting is enabled
+    uint64_t ready_at = 0;
+    void operator()() { run(); }
+    void run()
+    {
+        detail::set_task_ready_at(ready_at);
+        task();
+    }
+    void stamp()
+    {
+        if (routine_accounting_enabled()) {
+            ready_at = detail::steady_now_ns();
+        }
+    }
 };
 
 struct PriorityDelayTask : PriorityTask {
@@ -35,9 +55,10 @@ struct PriorityDelayTask : PriorityTask {
         , run_at(std::chrono::steady_clock::now() + delay)
     {
     }
+    //std::priority_queue keeps the greatest on top, that is the task due first
     bool operator<(const PriorityDelayTask& rhs) const
     {
-        return delay < rhs.delay;
+        return run_at > rhs.run_at;
     }
     std::chrono::milliseconds delay;
     std::chrono::time_point<std::chrono::steady_clock> run_at;
@@ -45,13 +66,22 @@ struct PriorityDelayTask : PriorityTask {
 
 template <typename T>
 concept Proactor = requires(T t) {
-    { t.harvest() } -> std::same_as<std::vector<PriorityTask>>;
+    { t.harvest() } -> std::same_as<CompletionList>;
 };
 
 class ProactorInterface {
 public:
     virtual ~ProactorInterface() {};
-    virtual std::vector<PriorityTask> harvest() { return {}; }
+    //completions since the last call, in the order the operations completed
+    virtual CompletionList harvest() { return {}; }
+    //shutdown support, see Context::shutdown()
+    //refuse new accepts and fail the pending ones with -ECANCELED, other operations keep going
+    virtual void drain() { }
+    //number of submitted operations whose completion has not been harvested yet
+    virtual size_t inflight() { return 0; }
+    //complete every in-flight operation with -ECANCELED
+    virtual void cancel_all() { }
+    virtual void stop() { }
 };
 
 } // namespace bco
@@ -0,0 +1,80 @@
+#pragma once
+#ifdef __linux__
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace bco {
+
+//Sampling CPU profiler that sees coroutines instead of the executor loop.
+//Every attached thread gets a SIGPROF timer on its own CPU clock. The handler records the chain
+//of Routine/Func frames running on the thread into a per thread ring, a collector thread folds
+//the rings into stacks. The output is the collapsed stack format of flamegraph.pl, inferno and
+//speedscope, one line per stack from the routine down to the innermost Func:
+//    Profiler profiler { {} };
+//    profiler.start();
+//    ...
+//    profiler.stop();
+//    std::ofstream out { "bco.folded" };
+//    profiler.write_collapsed(out);
+//Frames are named after the coroutine functions from the symbol tables of the loaded modules, a
+//stripped binary gives addresses. Executor threads attach themselves, other threads
+//running coroutines can call attach_current_thread(). Only one Profiler can run at a time.
+class Profiler {
+public:
+    struct Options {
+        std::chrono::microseconds interval { 1000 };
+        //count samples taken outside of any coroutine as "[executor]"
+        bool include_executor = false;
+    };
+
+    explicit Profiler(const Options& options);
+    ~Profiler();
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    //throws std::runtime_error if another Profiler is running or the timers can't be created
+    void start();
+    void stop();
+    bool is_running() const { return running_; }
+
+    //all samples collected so far, can be called while running
+    void write_collapsed(std::ostream& out);
+    std::string collapsed();
+    void clear();
+
+    uint64_t samples() const { return samples_.load(std::memory_order::relaxed); }
+    //samples lost because a ring was full
+    uint64_t dropped() const { return dropped_.load(std::memory_order::relaxed); }
+
+    //idempotent, the thread detaches itself when it exits
+    static void attach_current_thread();
+
+private:
+    void collect_loop();
+    void collect();
+
+private:
+    const Options options_;
+    std::atomic<bool> running_ { false };
+    std::thread collector_;
+    std::mutex collector_mtx_;
+    std::condition_variable collector_cv_;
+
+    std::mutex stacks_mtx_;
+    //innermost frame first
+    std::map<std::vector<void*>, uint64_t> stacks_;
+    std::atomic<uint64_t> samples_ { 0 };
+    std::atomic<uint64_t> dropped_ { 0 };
+};
+
+} // namespace bco
+
+#endif // ifdef __linux__
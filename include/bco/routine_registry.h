@@ -0,0 +1,73 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <bco/accounting.h>
+
+#ifndef BCO_ROUTINE_TRACKING
+#define BCO_ROUTINE_TRACKING 1
+#endif
+
+namespace bco {
+
+namespace detail {
+
+struct AsyncTrace;
+
+//Hook of a Routine in the registry of its Context, lives in the promise.
+struct RoutineNode {
+    RoutineNode* prev { nullptr };
+    RoutineNode* next { nullptr };
+    size_t shard { 0 };
+    bool linked { false };
+    //left at the epoch unless accounting was on when the routine started
+    std::chrono::steady_clock::time_point start_time;
+    const void* id { nullptr };
+    const RoutineStats* stats { nullptr };
+    const AsyncTrace* trace { nullptr };
+};
+
+//Live routines of a Context as intrusive lists, one per shard.
+//A thread always adds to the same shard, so on the MultithreadExecutor each worker has its own
+//lock and nothing is allocated. A routine finishing on another thread locks the shard it was
+//added to.
+class RoutineRegistry {
+public:
+    explicit RoutineRegistry(size_t shards = std::thread::hardware_concurrency());
+    RoutineRegistry(const RoutineRegistry&) = delete;
+    RoutineRegistry& operator=(const RoutineRegistry&) = delete;
+
+    void add(RoutineNode& node);
+    void remove(RoutineNode& node);
+    size_t size() const;
+    //locks one shard at a time, so it is not a snapshot
+    template <typename Func>
+    void for_each(Func&& func);
+
+private:
+    struct alignas(64) Shard {
+        std::mutex mtx;
+        RoutineNode* head { nullptr };
+        std::atomic<size_t> size { 0 };
+    };
+    const size_t mask_;
+    std::unique_ptr<Shard[]> shards_;
+};
+
+template <typename Func>
+void RoutineRegistry::for_each(Func&& func)
+{
+    for (size_t i = 0; i <= mask_; i++) {
+        std::lock_guard lock { shards_[i].mtx };
+        for (const RoutineNode* node = shards_[i].head; node != nullptr; node = node->next) {
+            func(*node);
+        }
+    }
+}
+
+} // namespace detail
+
+} // namespace bco
@@ -0,0 +1,111 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include <bco/context.h>
+#include <bco/net/proactor/select.h>
+#ifdef _WIN32
+#include <bco/net/proactor/iocp.h>
+#else
+#include <bco/net/proactor/epoll.h>
+#include <bco/net/proactor/iouring.h>
+#endif // _WIN32
+
+namespace bco {
+
+//A Context with the fastest proactor and executor this machine supports.
+//io_uring is used when the kernel has every opcode IOUring submits, epoll otherwise, IOCP on
+//Windows. Sockets are templates on the proactor, visit_proactor() hands out the one picked:
+//    auto runtime = bco::Runtime::Builder {}.build();
+//    runtime.start();
+//    runtime.visit_proactor([&](auto* proactor) {
+//        runtime.context()->spawn(&serve<std::remove_pointer_t<decltype(proactor)>>, proactor);
+//    });
+class Runtime {
+public:
+    enum class Backend {
+        IOUring,
+        Epoll,
+        Select,
+        IOCP,
+    };
+
+    struct Probe {
+        unsigned cpus = 1;
+#ifdef __linux__
+        net::IOUring::Support io_uring;
+#endif
+    };
+
+    class Builder {
+    public:
+        //0 runs one thread per CPU, 1 gives a SimpleExecutor
+        Builder& threads(size_t threads);
+        //skips the probing, build() throws if it can't be set up
+        Builder& backend(Backend backend);
+        //io_uring only, left out if the process is not allowed to
+        Builder& sq_poll(std::chrono::milliseconds idle_time);
+        Builder& queue_depth(uint32_t depth);
+        Runtime build();
+
+    private:
+        size_t threads_ = 0;
+        std::optional<Backend> backend_;
+        std::optional<std::chrono::milliseconds> sq_poll_;
+        std::optional<uint32_t> queue_depth_;
+    };
+
+    //starts the executor and the proactor
+    void start();
+    std::shared_ptr<Context> context() const { return ctx_; }
+
+    Backend backend() const { return backend_; }
+    size_t threads() const { return threads_; }
+    bool sq_poll() const { return sq_poll_; }
+    const Probe& probe() const { return probe_; }
+    //what was picked and why, e.g. "epoll (io_uring: required opcodes missing), simple executor"
+    std::string describe() const;
+
+    //calls func with the proactor, as a pointer to its concrete type
+    template <typename Func>
+    decltype(auto) visit_proactor(Func&& func);
+
+    static Probe probe_system();
+
+private:
+    Runtime() = default;
+
+private:
+    std::shared_ptr<Context> ctx_;
+    Backend backend_ = Backend::Select;
+    size_t threads_ = 1;
+    bool sq_poll_ = false;
+    Probe probe_;
+    //why a faster backend was not used
+    std::string fallback_reason_;
+};
+
+const char* to_string(Runtime::Backend backend);
+
+template <typename Func>
+decltype(auto) Runtime::visit_proactor(Func&& func)
+{
+    switch (backend_) {
+#ifdef _WIN32
+    case Backend::IOCP:
+        return func(ctx_->get_proactor<net::IOCP>());
+#else
+    case Backend::IOUring:
+        return func(ctx_->get_proactor<net::IOUring>());
+    case Backend::Epoll:
+        return func(ctx_->get_proactor<net::Epoll>());
+#endif // _WIN32
+    default:
+        return func(ctx_->get_proactor<net::Select>());
+    }
+}
+
+} // namespace bco
@@ -114,4 +114,9 @@ void set_current_thread_context(std::weak_ptr<Context> ctx);
 std::weak_ptr<Context> get_current_context();
 ExecutorInterface* get_current_executor();
 
+//index of the worker of 'executor' running on this thread, kAnyWorker if none. A worker of
+//another executor has no meaning for 'executor' and gives kAnyWorker too.
+void set_current_worker_index(const ExecutorInterface* executor, size_t index);
+size_t get_current_worker_index(const ExecutorInterface* executor);
+
 } // namespace bco
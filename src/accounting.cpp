@@ -0,0 +1,85 @@
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+#include <bco/accounting.h>
+
+namespace bco {
+
+namespace detail {
+
+std::atomic<bool> routine_accounting { false };
+constinit thread_local RoutineStats* running_slice { nullptr };
+
+namespace {
+
+thread_local uint64_t slice_start = 0;
+thread_local uint64_t task_ready_at = 0;
+
+uint64_t thread_cpu_now_ns()
+{
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    ::GetThreadTimes(::GetCurrentThread(), &creation, &exit, &kernel, &user);
+    auto to_ns = [](const FILETIME& t) { return ((uint64_t { t.dwHighDateTime } << 32) | t.dwLowDateTime) * 100; };
+    return to_ns(kernel) + to_ns(user);
+#else
+    ::timespec ts {};
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + static_cast<uint64_t>(ts.tv_nsec);
+#endif
+}
+
+} // namespace
+
+uint64_t steady_now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void set_task_ready_at(uint64_t ready_at)
+{
+    task_ready_at = ready_at;
+}
+
+void begin_slice_slow(RoutineStats* stats, bool resumed)
+{
+    if (running_slice == stats) {
+        return;
+    }
+    const uint64_t now = thread_cpu_now_ns();
+    if (running_slice != nullptr) {
+        running_slice->cpu_ns.fetch_add(now - slice_start, std::memory_order::relaxed);
+    }
+    running_slice = stats;
+    slice_start = now;
+    if (!resumed) {
+        return;
+    }
+    stats->resumes.fetch_add(1, std::memory_order::relaxed);
+    //only the first coroutine resumed by a task waited in the ready queue
+    if (task_ready_at != 0) {
+        stats->ready_wait_ns.fetch_add(steady_now_ns() - task_ready_at, std::memory_order::relaxed);
+        task_ready_at = 0;
+    }
+}
+
+void end_slice_slow(RoutineStats* stats)
+{
+    if (running_slice != stats) {
+        return;
+    }
+    stats->cpu_ns.fetch_add(thread_cpu_now_ns() - slice_start, std::memory_order::relaxed);
+    running_slice = nullptr;
+}
+
+} // namespace detail
+
+void enable_routine_accounting(bool enable)
+{
+    detail::routine_accounting = enable;
+}
+
+} // namespace bco
@@ -153,12 +153,12 @@ std::vector<std::span<uint8_t>> BufferBase::data(size_t start, size_t end)
         if (curr_pos >= end)
             break;
         if (curr_pos == start) {
-            slices.emplace_back(chunk.data(), chunk.size());
+            slices.emplace_back(chunk.data(), std::min(end - curr_pos, chunk.size()));
         } else if (curr_pos + chunk.size() <= start) {
             ;
         } else if (curr_pos < start && curr_pos + chunk.size() > start) {
             //Ƚ end  curr_pos + chunk.size()ĴСȡС
-            slices.emplace_back(chunk.data() + start - curr_pos, std::min(end - start, chunk.size() - start));
+            slices.emplace_back(chunk.data() + start - curr_pos, std::min(end - start, chunk.size() - (start - curr_pos)));
         } else if (curr_pos > start && curr_pos + chunk.size() <= end) {
             slices.emplace_back(chunk.data(), chunk.size());
         } else if (curr_pos > start && curr_pos + chunk.size() > end) {
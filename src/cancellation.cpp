@@ -0,0 +1,100 @@
+#include <bco/cancellation.h>
+
+namespace bco {
+
+CancellationSource::CancellationSource(CancellationToken parent)
+{
+    if (parent.source_ == nullptr) {
+        return;
+    }
+    parent_link_.self = this;
+    parent_link_.invoke = [](detail::CancellationNode* node) { static_cast<ParentLink*>(node)->self->cancel(); };
+    if (parent.source_->add(&parent_link_)) {
+        parent_link_.parent = parent.source_;
+    } else {
+        cancel();
+    }
+}
+
+CancellationSource::~CancellationSource()
+{
+    if (parent_link_.parent != nullptr) {
+        parent_link_.parent->remove(&parent_link_);
+    }
+}
+
+bool CancellationSource::cancel()
+{
+    std::unique_lock lock { mtx_ };
+    if (cancelled_.load(std::memory_order::relaxed)) {
+        return false;
+    }
+    cancelled_.store(true, std::memory_order::release);
+    running_thread_ = std::this_thread::get_id();
+    while (head_ != nullptr) {
+        detail::CancellationNode* node = head_;
+        head_ = node->next;
+        if (head_ != nullptr) {
+            head_->prev = nullptr;
+        }
+        node->prev = node->next = nullptr;
+        running_ = node;
+        bool destroyed = false;
+        node->destroyed = &destroyed;
+        lock.unlock();
+        node->invoke(node);
+        //a node destroyed by its own callback is not touched again
+        if (!destroyed) {
+            node->destroyed = nullptr;
+            node->done.store(true, std::memory_order::release);
+        }
+        lock.lock();
+        running_ = nullptr;
+    }
+    return true;
+}
+
+bool CancellationSource::add(detail::CancellationNode* node)
+{
+    std::lock_guard lock { mtx_ };
+    if (cancelled_.load(std::memory_order::relaxed)) {
+        return false;
+    }
+    node->prev = nullptr;
+    node->next = head_;
+    if (head_ != nullptr) {
+        head_->prev = node;
+    }
+    head_ = node;
+    return true;
+}
+
+void CancellationSource::remove(detail::CancellationNode* node)
+{
+    std::unique_lock lock { mtx_ };
+    if (node->prev != nullptr || head_ == node) {
+        if (node->prev != nullptr) {
+            node->prev->next = node->next;
+        } else {
+            head_ = node->next;
+        }
+        if (node->next != nullptr) {
+            node->next->prev = node->prev;
+        }
+        return;
+    }
+    if (running_ != node) {
+        //ran already
+        return;
+    }
+    if (running_thread_ == std::this_thread::get_id()) {
+        *node->destroyed = true;
+        return;
+    }
+    lock.unlock();
+    while (!node->done.load(std::memory_order::acquire)) {
+        std::this_thread::yield();
+    }
+}
+
+} // namespace bco
@@ -1,9 +1,75 @@
 #include <algorithm>
+#include <cstdio>
+#include <ostream>
+#include <sstream>
+#include <thread>
 
 #include <bco/context.h>
 
+#include "symbolizer.h"
+
 namespace bco {
 
+namespace {
+
+//copied under the registry lock, named after it is released
+struct StackSnapshot {
+    const void* id;
+    std::chrono::steady_clock::time_point start_time;
+    uint32_t depth;
+    void* functions[BCO_ASYNC_TRACE_DEPTH];
+    const char* labels[BCO_ASYNC_TRACE_DEPTH];
+    const char* await_format;
+    long long await_arg;
+    const char* await_type;
+};
+
+StackSnapshot take_snapshot(const detail::RoutineNode& node)
+{
+    const auto& trace = *node.trace;
+    StackSnapshot snapshot {};
+    snapshot.id = node.id;
+    snapshot.start_time = node.start_time;
+    snapshot.depth = trace.depth.load(std::memory_order::relaxed);
+    for (size_t i = 0; i < std::min<size_t>(snapshot.depth, BCO_ASYNC_TRACE_DEPTH); i++) {
+        snapshot.functions[i] = trace.entries[i].function.load(std::memory_order::relaxed);
+        snapshot.labels[i] = trace.entries[i].label.load(std::memory_order::relaxed);
+    }
+    snapshot.await_type = trace.await_type.load(std::memory_order::relaxed);
+    snapshot.await_format = trace.await_format.load(std::memory_order::relaxed);
+    snapshot.await_arg = trace.await_arg.load(std::memory_order::relaxed);
+    return snapshot;
+}
+
+std::string describe_await(const StackSnapshot& snapshot)
+{
+    if (snapshot.await_type == nullptr) {
+        return "running";
+    }
+    if (snapshot.await_format == nullptr) {
+        return detail::awaiter_name(snapshot.await_type);
+    }
+    char buff[256];
+    std::snprintf(buff, sizeof(buff), snapshot.await_format, snapshot.await_arg);
+    return buff;
+}
+
+} // namespace
+
+namespace detail {
+
+size_t next_proactor_slot()
+{
+    static std::atomic<size_t> next_slot { 0 };
+    size_t slot = next_slot.fetch_add(1, std::memory_order::relaxed);
+    if (slot >= kMaxProactorTypes) {
+        throw std::length_error { "too many proactor types, raise kMaxProactorTypes" };
+    }
+    return slot;
+}
+
+} // namespace detail
+
 Context::Context(std::unique_ptr<ExecutorInterface>&& executor)
     : executor_ { std::move(executor) }
 {
@@ -21,12 +87,22 @@ ExecutorInterface* Context::executor()
     return executor_.get();
 }
 
-std::vector<PriorityTask> Context::get_proactor_tasks()
+template <typename Func>
+void Context::for_each_proactor(Func&& func)
 {
-    std::vector<PriorityTask> tasks;
-    for (auto& [_, proactor] : proactors_) {
-        std::ranges::copy(proactor->harvest(), std::back_inserter(tasks));
+    for (auto& proactor : proactors_) {
+        if (proactor != nullptr) {
+            func(*proactor);
+        }
     }
+}
+
+CompletionList Context::get_proactor_tasks()
+{
+    CompletionList tasks;
+    for_each_proactor([&tasks](ProactorInterface& proactor) {
+        tasks.splice(proactor.harvest());
+    });
     return tasks;
 }
 
@@ -36,33 +112,148 @@ void Context::start()
     executor_->start();
 }
 
+bool Context::shutdown(std::chrono::steady_clock::time_point deadline, std::chrono::milliseconds cancel_grace)
+{
+    assert(!executor_->is_current_executor());
+    shutting_down_ = true;
+    //the grace comes out of the caller's time, the I/O is cancelled that much earlier
+    const auto cancel_at = std::max(Clock::now(), deadline - cancel_grace);
+    for_each_proactor([](ProactorInterface& proactor) { proactor.drain(); });
+    bool drained = wait_until(cancel_at, [this]() { return routines_size() == 0 && idle(); });
+    if (!drained) {
+        for_each_proactor([](ProactorInterface& proactor) { proactor.cancel_all(); });
+        wait_until(deadline, [this]() { return routines_size() == 0 && idle(); });
+    }
+    for_each_proactor([](ProactorInterface& proactor) { proactor.stop(); });
+    executor_->stop();
+    return drained;
+}
+
+bool Context::shutdown(std::chrono::milliseconds timeout, std::chrono::milliseconds cancel_grace)
+{
+    return shutdown(Clock::now() + timeout, cancel_grace);
+}
+
 void Context::spawn(std::function<Routine()>&& coroutine)
 {
-    executor_->post(PriorityTask { Priority::Medium, std::bind(&Context::spawn_aux, this, coroutine) });
+    //the routine is created on the executor, it takes a copy of the spawner's locals made now
+    std::shared_ptr<detail::LocalStorage> locals;
+    if (auto* current = detail::current_locals(); current != nullptr && !current->empty()) {
+        locals = std::make_shared<detail::LocalStorage>();
+        locals->inherit(*current);
+    }
+    executor_->post(PriorityTask { Priority::Medium, std::bind(&Context::spawn_aux, this, coroutine, std::move(locals)) });
 }
 
-void Context::add_routine(Routine routine)
+void Context::add_routine(detail::RoutineNode& node)
 {
-    std::lock_guard lock { mutex_ };
-    routines_.insert(RoutineInfo { routine, Clock::now() });
+    routines_.add(node);
 }
 
-void Context::del_routine(Routine routine)
+void Context::del_routine(detail::RoutineNode& node)
 {
-    std::lock_guard lock { mutex_ };
-    constexpr auto _time = TimePoint {};
-    routines_.erase(RoutineInfo { routine, _time });
+    routines_.remove(node);
+    if (shutting_down_) {
+        std::lock_guard lock { shutdown_mtx_ };
+        shutdown_cv_.notify_all();
+    }
 }
 
 size_t Context::routines_size()
 {
-    std::lock_guard lock { mutex_ };
     return routines_.size();
 }
 
-void Context::spawn_aux(std::function<Routine()> coroutine)
+void Context::set_routine_tracking(bool enable)
+{
+    routine_tracking_ = enable;
+}
+
+std::vector<RoutineUsage> Context::top_routines_by_cpu(size_t n)
+{
+    std::vector<RoutineUsage> usages;
+    routines_.for_each([&usages](const detail::RoutineNode& node) {
+        usages.push_back(RoutineUsage {
+            .id = node.id,
+            .start_time = node.start_time,
+            .cpu = std::chrono::nanoseconds { node.stats->cpu_ns.load(std::memory_order::relaxed) },
+            .resumes = node.stats->resumes.load(std::memory_order::relaxed),
+            .ready_wait = std::chrono::nanoseconds { node.stats->ready_wait_ns.load(std::memory_order::relaxed) } });
+    });
+    n = std::min(n, usages.size());
+    std::ranges::partial_sort(usages, usages.begin() + n, std::ranges::greater {}, &RoutineUsage::cpu);
+    usages.resize(n);
+    return usages;
+}
+
+void Context::dump_async_stacks(std::ostream& out)
+{
+    std::vector<StackSnapshot> snapshots;
+    routines_.for_each([&snapshots](const detail::RoutineNode& node) {
+        snapshots.push_back(take_snapshot(node));
+    });
+    std::ranges::sort(snapshots, {}, &StackSnapshot::start_time);
+
+    const auto now = Clock::now();
+    detail::Symbolizer symbolizer;
+    for (const auto& snapshot : snapshots) {
+        out << "routine " << snapshot.id << " age ";
+        if (snapshot.start_time != Clock::time_point {}) {
+            out << std::chrono::duration_cast<std::chrono::milliseconds>(now - snapshot.start_time).count() << "ms";
+        } else {
+            out << '?';
+        }
+        out << ": " << describe_await(snapshot) << '\n';
+        if (snapshot.depth > BCO_ASYNC_TRACE_DEPTH) {
+            out << "    ... " << snapshot.depth - BCO_ASYNC_TRACE_DEPTH << " frames not recorded\n";
+        }
+        const size_t recorded = std::min<size_t>(snapshot.depth, BCO_ASYNC_TRACE_DEPTH);
+        for (size_t i = recorded; i-- > 0;) {
+            out << "    #" << recorded - 1 - i << ' ' << symbolizer.name(snapshot.functions[i]);
+            if (snapshot.labels[i] != nullptr) {
+                out << " [" << snapshot.labels[i] << ']';
+            }
+            out << '\n';
+        }
+    }
+}
+
+std::string Context::async_stacks()
 {
+    std::ostringstream out;
+    dump_async_stacks(out);
+    return out.str();
+}
+
+void Context::spawn_aux(std::function<Routine()> coroutine, std::shared_ptr<detail::LocalStorage> locals)
+{
+    detail::SpawnScope scope { detail::spawning_locals, locals.get() };
     coroutine();
 }
 
+bool Context::idle()
+{
+    if (executor_->pending_tasks() != 0) {
+        return false;
+    }
+    return std::ranges::all_of(proactors_, [](auto& proactor) { return proactor == nullptr || proactor->inflight() == 0; });
+}
+
+//Routines wake it as they finish. Queued tasks and I/O have no such hook, they are looked at
+//again every kRecheck.
+template <typename Pred>
+bool Context::wait_until(std::chrono::steady_clock::time_point deadline, Pred pred)
+{
+    constexpr auto kRecheck = std::chrono::milliseconds { 10 };
+    std::unique_lock lock { shutdown_mtx_ };
+    while (!pred()) {
+        const auto now = Clock::now();
+        if (now >= deadline) {
+            return false;
+        }
+        shutdown_cv_.wait_until(lock, std::min(deadline, now + kRecheck));
+    }
+    return true;
+}
+
 } // namespace bco
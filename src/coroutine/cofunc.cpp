@@ -8,6 +8,7 @@ namespace detail {
 SwitchTask::SwitchTask(ExecutorInterface* executor)
     : executor_(executor)
 {
+    set_await_info("switch_to");
 }
 void SwitchTask::await_suspend(std::coroutine_handle<> coroutine) noexcept
 {
@@ -21,15 +22,53 @@ void SwitchTask::await_suspend(std::coroutine_handle<> coroutine) noexcept
 DelayTask::DelayTask(std::chrono::milliseconds duration)
         : duration_(duration)
     {
+        set_await_info("sleep_for %lldms", static_cast<long long>(duration.count()));
     }
-    void DelayTask::await_suspend(std::coroutine_handle<> coroutine) noexcept
+
+    DelayTask::DelayTask(DelayTask&& other) noexcept
+        : Task<>(other)
+        , duration_(other.duration_)
+    {
+    }
+
+    bool DelayTask::suspend(std::coroutine_handle<> coroutine, CancellationToken token)
     {
-        ctx_->caller_coroutine_ = coroutine;
-        get_current_executor()->post_delay(
+        if (token.cancelled()) {
+            return false;
+        }
+        timer_ = std::make_shared<Timer>();
+        timer_->coroutine = coroutine;
+        timer_->executor = get_current_executor();
+        timer_->affinity = get_current_worker_index(timer_->executor);
+        timer_->executor->post_delay(
             duration_,
             PriorityTask {
                 Priority::Medium,
-                std::bind(&DelayTask::resume, this) });
+                [timer = timer_]() { timer->fire(true); } });
+        if (token.cancellable()) {
+            callback_.emplace(token, Fire { timer_.get() });
+        }
+        //fired while the callback was registered, the coroutine goes on right away
+        if (timer_->suspended.exchange(true, std::memory_order::acq_rel)) {
+            callback_.reset();
+            return false;
+        }
+        return true;
+    }
+
+    void DelayTask::Timer::fire(bool on_executor)
+    {
+        if (fired.exchange(true, std::memory_order::acq_rel)) {
+            return;
+        }
+        if (!suspended.exchange(true, std::memory_order::acq_rel)) {
+            return;
+        }
+        if (on_executor) {
+            coroutine.resume();
+        } else {
+            resume_on(executor, coroutine, affinity);
+        }
     }
 
 }
@@ -72,6 +111,7 @@ void detail::ExpirableTask<T>::await_suspend(std::coroutine_handle<> coroutine)
         .task = [this, done]() {
             bool _done = false;
             if (done->compare_exchange_strong(_done, true)) {
+                this->set_result(std::nullopt);
                 this->resume();
             }
         },
@@ -107,6 +147,7 @@ void detail::ExpirableTaskAnyfunc<Callable>::await_suspend(std::coroutine_handle
         .task = [this, done]() {
             bool _done = false;
             if (done->compare_exchange_strong(_done, true)) {
+                this->set_result(std::nullopt);
                 this->resume();
             }
         },
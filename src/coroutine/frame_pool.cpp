@@ -0,0 +1,255 @@
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include <bco/coroutine/frame_pool.h>
+
+namespace bco {
+
+namespace detail {
+
+namespace {
+
+constexpr size_t kGranularity = FramePoolStats::kGranularity;
+constexpr size_t kSizeClasses = FramePoolStats::kSizeClasses;
+//blocks a thread keeps per size class, the others go back to the heap
+constexpr uint32_t kMaxCached = 256;
+//frames of another thread collected before they are handed back with one CAS
+constexpr uint32_t kRemoteBatch = 32;
+
+struct ThreadCache;
+
+//in front of every frame, the frame stays aligned like the blocks of operator new
+struct alignas(16) BlockHeader {
+    //null for frames from the heap
+    ThreadCache* owner;
+    uint32_t size_class;
+};
+
+//while the block is free, the frame area holds the link
+BlockHeader*& next_of(BlockHeader* block)
+{
+    return *reinterpret_cast<BlockHeader**>(block + 1);
+}
+
+//only written by the thread owning the cache, read by frame_pool_stats()
+class Counter {
+public:
+    void add() { value_.store(value_.load(std::memory_order::relaxed) + 1, std::memory_order::relaxed); }
+    uint64_t get() const { return value_.load(std::memory_order::relaxed); }
+
+private:
+    std::atomic<uint64_t> value_ { 0 };
+};
+
+//Free lists of one thread. Never deleted: frames it handed out may be freed after the thread
+//exited, it is then abandoned until another thread adopts it.
+struct ThreadCache {
+    BlockHeader* free[kSizeClasses] {};
+    uint32_t cached[kSizeClasses] {};
+    //frames of this cache freed on other threads
+    std::atomic<BlockHeader*> remote { nullptr };
+
+    //frames of 'pending_owner' freed on this thread, not handed back yet
+    ThreadCache* pending_owner { nullptr };
+    BlockHeader* pending_head { nullptr };
+    BlockHeader* pending_tail { nullptr };
+    uint32_t pending { 0 };
+
+    Counter allocations;
+    Counter hits;
+    Counter large;
+    Counter remote_frees;
+    Counter size_classes[kSizeClasses];
+};
+
+struct CacheRegistry {
+    std::mutex mtx;
+    std::vector<ThreadCache*> caches;
+    std::vector<ThreadCache*> abandoned;
+};
+
+//outlives the threads exiting after main()
+CacheRegistry& registry()
+{
+    static auto* registry = new CacheRegistry;
+    return *registry;
+}
+
+constinit thread_local ThreadCache* current_cache = nullptr;
+//set once the thread exits, later frames of the thread come from the heap
+constinit thread_local bool cache_released = false;
+
+void push_remote(ThreadCache& owner, BlockHeader* head, BlockHeader* tail)
+{
+    next_of(tail) = owner.remote.load(std::memory_order::relaxed);
+    while (!owner.remote.compare_exchange_weak(next_of(tail), head, std::memory_order::release, std::memory_order::relaxed)) {
+    }
+}
+
+void flush_pending(ThreadCache& cache)
+{
+    if (cache.pending == 0) {
+        return;
+    }
+    push_remote(*cache.pending_owner, cache.pending_head, cache.pending_tail);
+    cache.pending_owner = nullptr;
+    cache.pending_head = cache.pending_tail = nullptr;
+    cache.pending = 0;
+}
+
+void push_free(ThreadCache& cache, BlockHeader* block)
+{
+    const uint32_t size_class = block->size_class;
+    if (cache.cached[size_class] >= kMaxCached) {
+        ::operator delete(block);
+        return;
+    }
+    next_of(block) = cache.free[size_class];
+    cache.free[size_class] = block;
+    cache.cached[size_class]++;
+}
+
+//the frames other threads gave back go to the free lists
+void reclaim_remote(ThreadCache& cache)
+{
+    BlockHeader* block = cache.remote.exchange(nullptr, std::memory_order::acquire);
+    while (block != nullptr) {
+        BlockHeader* next = next_of(block);
+        push_free(cache, block);
+        block = next;
+    }
+}
+
+class CacheHolder {
+public:
+    ~CacheHolder()
+    {
+        ThreadCache* cache = std::exchange(current_cache, nullptr);
+        cache_released = true;
+        if (cache == nullptr) {
+            return;
+        }
+        flush_pending(*cache);
+        reclaim_remote(*cache);
+        for (size_t i = 0; i < kSizeClasses; i++) {
+            while (BlockHeader* block = cache->free[i]) {
+                cache->free[i] = next_of(block);
+                ::operator delete(block);
+            }
+            cache->cached[i] = 0;
+        }
+        auto& caches = registry();
+        std::lock_guard lock { caches.mtx };
+        caches.abandoned.push_back(cache);
+    }
+
+    bool armed { false };
+};
+
+thread_local CacheHolder holder;
+
+ThreadCache* get_cache()
+{
+    if (current_cache != nullptr || cache_released) {
+        return current_cache;
+    }
+    holder.armed = true;
+    auto& caches = registry();
+    std::lock_guard lock { caches.mtx };
+    if (!caches.abandoned.empty()) {
+        current_cache = caches.abandoned.back();
+        caches.abandoned.pop_back();
+    } else {
+        current_cache = new ThreadCache;
+        caches.caches.push_back(current_cache);
+    }
+    return current_cache;
+}
+
+} // namespace
+
+void* allocate_frame(size_t size)
+{
+    const size_t size_class = (size + sizeof(BlockHeader) - 1) / kGranularity;
+    ThreadCache* cache = get_cache();
+    if (cache == nullptr || size_class >= kSizeClasses) {
+        if (cache != nullptr) {
+            cache->allocations.add();
+            cache->large.add();
+        }
+        auto* block = static_cast<BlockHeader*>(::operator new(size + sizeof(BlockHeader)));
+        block->owner = nullptr;
+        return block + 1;
+    }
+
+    cache->allocations.add();
+    cache->size_classes[size_class].add();
+    if (cache->free[size_class] == nullptr && cache->remote.load(std::memory_order::relaxed) != nullptr) {
+        reclaim_remote(*cache);
+    }
+    BlockHeader* block = cache->free[size_class];
+    if (block != nullptr) {
+        cache->free[size_class] = next_of(block);
+        cache->cached[size_class]--;
+        cache->hits.add();
+    } else {
+        block = static_cast<BlockHeader*>(::operator new((size_class + 1) * kGranularity));
+        block->size_class = static_cast<uint32_t>(size_class);
+    }
+    block->owner = cache;
+    return block + 1;
+}
+
+void deallocate_frame(void* frame) noexcept
+{
+    auto* block = static_cast<BlockHeader*>(frame) - 1;
+    ThreadCache* owner = block->owner;
+    if (owner == nullptr) {
+        ::operator delete(block);
+        return;
+    }
+    ThreadCache* cache = get_cache();
+    if (owner == cache) {
+        push_free(*cache, block);
+        return;
+    }
+    if (cache == nullptr) {
+        push_remote(*owner, block, block);
+        return;
+    }
+    cache->remote_frees.add();
+    if (cache->pending_owner != owner) {
+        flush_pending(*cache);
+        cache->pending_owner = owner;
+        cache->pending_tail = block;
+    }
+    next_of(block) = cache->pending_head;
+    cache->pending_head = block;
+    if (++cache->pending >= kRemoteBatch) {
+        flush_pending(*cache);
+    }
+}
+
+} // namespace detail
+
+FramePoolStats frame_pool_stats()
+{
+    FramePoolStats stats;
+    auto& caches = detail::registry();
+    std::lock_guard lock { caches.mtx };
+    for (const auto* cache : caches.caches) {
+        stats.allocations += cache->allocations.get();
+        stats.hits += cache->hits.get();
+        stats.large += cache->large.get();
+        stats.remote_frees += cache->remote_frees.get();
+        for (size_t i = 0; i < FramePoolStats::kSizeClasses; i++) {
+            stats.size_classes[i] += cache->size_classes[i].get();
+        }
+    }
+    return stats;
+}
+
+} // namespace bco
@@ -0,0 +1,56 @@
+#include <atomic>
+
+#include <bco/coroutine/local.h>
+
+namespace bco {
+
+namespace detail {
+
+constinit thread_local const LocalStorage* spawning_locals { nullptr };
+
+LocalStorage::~LocalStorage()
+{
+    for (auto& slot : slots_) {
+        if (slot.value != nullptr) {
+            slot.type->destroy(slot.value);
+        }
+    }
+}
+
+void LocalStorage::set(size_t index, void* value, const LocalType* type)
+{
+    if (index >= slots_.size()) {
+        if (value == nullptr) {
+            return;
+        }
+        slots_.resize(index + 1);
+    }
+    auto& slot = slots_[index];
+    if (slot.value != nullptr) {
+        slot.type->destroy(slot.value);
+    }
+    slot.value = value;
+    slot.type = type;
+}
+
+void LocalStorage::inherit(const LocalStorage& parent)
+{
+    slots_.resize(parent.slots_.size());
+    for (size_t i = 0; i < parent.slots_.size(); i++) {
+        const auto& slot = parent.slots_[i];
+        if (slot.value != nullptr) {
+            slots_[i].value = slot.type->copy(slot.value);
+            slots_[i].type = slot.type;
+        }
+    }
+}
+
+size_t LocalStorage::next_index()
+{
+    static std::atomic<size_t> next { 0 };
+    return next.fetch_add(1, std::memory_order::relaxed);
+}
+
+} // namespace detail
+
+} // namespace bco
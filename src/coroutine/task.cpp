@@ -3,24 +3,45 @@
 
 namespace bco {
 
+namespace detail {
+
+constinit thread_local std::atomic<CoroutineFrame*> current_frame { nullptr };
+constinit thread_local Context* spawning_context { nullptr };
+
+} // namespace detail
+
 Routine Routine::promise_type::get_return_object()
 {
-    auto ctx = get_current_context().lock();
-    if (ctx == nullptr) {
-        return Routine { this };
-    } else {
-        //Ƚctx浽ctx_Ϊadd_routine()ֵӹȥ
+    Context* spawner = std::exchange(detail::spawning_context, nullptr);
+    deferred_ = spawner != nullptr;
+    //created by the spawner, or on the executor with what the spawner left
+    const detail::LocalStorage* inherited = std::exchange(detail::spawning_locals, nullptr);
+    if (inherited == nullptr) {
+        inherited = detail::current_locals();
+    }
+    if (inherited != nullptr) {
+        locals_.inherit(*inherited);
+    }
+#if BCO_ROUTINE_TRACKING
+    auto ctx = spawner != nullptr ? spawner->weak_from_this().lock() : get_current_context().lock();
+    if (ctx != nullptr && ctx->routine_tracking()) {
         ctx_ = ctx;
-        auto routine = Routine { this };
-        ctx->add_routine(routine);
-        return routine;
+        node_.id = this;
+        node_.stats = &stats_;
+        node_.trace = &trace_;
+        ctx->add_routine(node_);
     }
+#endif
+    return Routine { this };
 }
 
 std::suspend_never Routine::promise_type::final_suspend() noexcept
 {
-    if (auto ctx = ctx_.lock()) {
-        ctx->del_routine(Routine { this });
+    detail::leave_frame(&frame_);
+    if (node_.linked) {
+        if (auto ctx = ctx_.lock()) {
+            ctx->del_routine(node_);
+        }
     }
     return {};
 }
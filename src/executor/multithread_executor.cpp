@@ -2,6 +2,8 @@
 #include <ranges>
 #include <numeric>
 #include <bco/executor/multithread_executor.h>
+#include <bco/context.h>
+#include <bco/profiler.h>
 
 namespace bco {
 
@@ -17,17 +19,16 @@ MultithreadExecutor::MultithreadExecutor(uint32_t threads)
 
 MultithreadExecutor::~MultithreadExecutor()
 {
-    stoped_ = true;
-    //std::atomic_thread_fence(std::memory_order::memory_order_acquire);
-    cv_.notify_one();
-    for (auto& worker : workers_) {
-        worker.wake_up();
-    }
-    main_loop_thread_.join();
+    stop();
 }
 
 void MultithreadExecutor::post(PriorityTask task)
 {
+    task.stamp();
+    if (task.affinity < worker_size_) {
+        workers_[task.affinity].post(task);
+        return;
+    }
     auto it = thread_ids_.find(std::this_thread::get_id());
     if (it == thread_ids_.cend()) {
         std::lock_guard lock { mutex_ };
@@ -39,6 +40,9 @@ void MultithreadExecutor::post(PriorityTask task)
 
 void MultithreadExecutor::post_delay(std::chrono::milliseconds duration, PriorityTask task)
 {
+    if (task.affinity == kAnyWorker) {
+        task.affinity = get_current_worker_index(this);
+    }
     std::lock_guard lock { mutex_ };
     delay_tasks_.push({ duration, task });
 }
@@ -53,7 +57,7 @@ void MultithreadExecutor::start()
     wg_.wait();
 }
 
-void MultithreadExecutor::set_proactor_task_getter(std::function<std::vector<PriorityTask>()> func)
+void MultithreadExecutor::set_proactor_task_getter(std::function<CompletionList()> func)
 {
     get_proactor_task_ = func;
 }
@@ -78,6 +82,35 @@ bool MultithreadExecutor::is_running()
     return !stoped_;
 }
 
+void MultithreadExecutor::stop()
+{
+    stoped_ = true;
+    //std::atomic_thread_fence(std::memory_order::memory_order_acquire);
+    cv_.notify_one();
+    for (auto& worker : workers_) {
+        worker.wake_up();
+    }
+    if (main_loop_thread_.joinable()) {
+        main_loop_thread_.join();
+    }
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+size_t MultithreadExecutor::pending_tasks()
+{
+    size_t count = 0;
+    {
+        std::lock_guard lock { mutex_ };
+        count += global_tasks_.size();
+    }
+    for (auto& worker : workers_) {
+        count += worker.size();
+    }
+    return count;
+}
+
 void MultithreadExecutor::main_loop()
 {
     wg_.done();
@@ -90,16 +123,22 @@ void MultithreadExecutor::main_loop()
             continue;
         }
         for (auto&& task : delay_tasks) {
-            workers_[next_worker_index()].post(task);
+            dispatch(task);
         }
-        for (auto&& task : proactor_tasks) {
-            workers_[next_worker_index()].post(task);
+        while (auto node = proactor_tasks.pop_front()) {
+            PriorityTask task { Priority::Medium, [node] { node->run(); }, node->affinity() };
+            dispatch(task);
         }
     }
 }
 
 void MultithreadExecutor::worker_loop(const size_t worker_index)
 {
+    set_current_thread_context(ctx_);
+    set_current_worker_index(this, worker_index);
+#ifdef __linux__
+    Profiler::attach_current_thread();
+#endif
     wg_.done();
     while (!stoped_) {
         bool has_job = do_own_job(worker_index) || steal_and_do_job(worker_index);
@@ -180,6 +219,17 @@ void MultithreadExecutor::request_proactor_task()
     cv_.notify_one();
 }
 
+//send the task back to the worker which issued it, an idle worker will steal it if that one is busy
+void MultithreadExecutor::dispatch(PriorityTask& task)
+{
+    task.stamp();
+    if (task.affinity < worker_size_) {
+        workers_[task.affinity].post(std::move(task));
+    } else {
+        workers_[next_worker_index()].post(std::move(task));
+    }
+}
+
 size_t MultithreadExecutor::next_worker_index()
 {
     return random_dis_(random_engine_);
@@ -204,7 +254,20 @@ std::tuple<std::vector<PriorityTask>, std::chrono::milliseconds> MultithreadExec
 
 MultithreadExecutor::Worker::~Worker()
 {
-    thread_.join();
+    join();
+}
+
+void MultithreadExecutor::Worker::join()
+{
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+size_t MultithreadExecutor::Worker::size()
+{
+    std::lock_guard lock { mutex_ };
+    return tasks_.size();
 }
 
 std::thread::id MultithreadExecutor::Worker::thread_id() const
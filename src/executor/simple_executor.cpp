@@ -4,21 +4,18 @@
 #include <iostream>
 #include <bco/executor/simple_executor.h>
 #include <bco/context.h>
+#include <bco/profiler.h>
 
 namespace bco {
 
 SimpleExecutor::~SimpleExecutor()
 {
-    {
-        std::lock_guard lock { mutex_ };
-        stoped_ = true;
-    }
-    sleep_cv_.notify_one();
-    thread_.join();
+    stop();
 }
 
 void SimpleExecutor::post(PriorityTask task)
 {
+    task.stamp();
     {
         std::lock_guard<std::mutex> lock { mutex_ };
         tasks_.push_back(task);
@@ -47,6 +44,9 @@ void SimpleExecutor::do_start()
         started_ = true;
     }
     set_current_thread_context(ctx_);
+#ifdef __linux__
+    Profiler::attach_current_thread();
+#endif
     startup_cv_.notify_one();
 
     while (!stoped_) {
@@ -67,8 +67,10 @@ void SimpleExecutor::do_start()
         for (auto&& task : old_tasks) {
             task();
         }
-        for (auto&& task : proactor_tasks) {
-            task();
+        const uint64_t ready_at = routine_accounting_enabled() ? detail::steady_now_ns() : 0;
+        while (auto node = proactor_tasks.pop_front()) {
+            detail::set_task_ready_at(ready_at);
+            node->run();
         }
     }
 }
@@ -95,6 +97,7 @@ std::tuple<std::vector<PriorityTask>, std::chrono::milliseconds> SimpleExecutor:
     std::lock_guard lock { mutex_ };
     while (!delay_tasks_.empty() && delay_tasks_.top().run_at <= now) {
         tasks.push_back(delay_tasks_.top());
+        tasks.back().stamp();
         delay_tasks_.pop();
     }
     if (!delay_tasks_.empty()) {
@@ -104,16 +107,15 @@ std::tuple<std::vector<PriorityTask>, std::chrono::milliseconds> SimpleExecutor:
     }
 }
 
-inline std::vector<PriorityTask> SimpleExecutor::get_proactor_tasks()
+inline CompletionList SimpleExecutor::get_proactor_tasks()
 {
     if (get_proactor_task_ == nullptr) {
         return {};
-    } else {
-        return get_proactor_task_();
     }
+    return get_proactor_task_();
 }
 
-void SimpleExecutor::set_proactor_task_getter(std::function<std::vector<PriorityTask>()> func)
+void SimpleExecutor::set_proactor_task_getter(std::function<CompletionList()> func)
 {
     get_proactor_task_ = func;
 }
@@ -138,4 +140,23 @@ bool SimpleExecutor::is_running()
     return wakeup_.load(std::memory_order::relaxed);
 }
 
+void SimpleExecutor::stop()
+{
+    {
+        std::lock_guard lock { mutex_ };
+        stoped_ = true;
+        wakeup_ = true;
+    }
+    sleep_cv_.notify_one();
+    if (thread_.joinable() && !is_current_executor()) {
+        thread_.join();
+    }
+}
+
+size_t SimpleExecutor::pending_tasks()
+{
+    std::lock_guard lock { mutex_ };
+    return tasks_.size();
+}
+
 } //namespace bco
\ No newline at end of file
@@ -0,0 +1,212 @@
+#ifdef __linux__
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "../common.h"
+#include <bco/exception.h>
+#include <bco/net/prefork.h>
+
+namespace bco {
+
+namespace net {
+
+SharedCounters::SharedCounters(size_t count)
+    : counters_(nullptr)
+    , size_(count)
+{
+    if (size_ == 0) {
+        return;
+    }
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared counters must not need a lock");
+    void* ptr = ::mmap(nullptr, size_ * sizeof(std::atomic<uint64_t>), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        throw std::runtime_error { "mmap shared counters failed" };
+    }
+    counters_ = static_cast<std::atomic<uint64_t>*>(ptr);
+    for (size_t i = 0; i < size_; i++) {
+        new (&counters_[i]) std::atomic<uint64_t> { 0 };
+    }
+}
+
+SharedCounters::~SharedCounters()
+{
+    if (counters_ != nullptr) {
+        ::munmap(counters_, size_ * sizeof(std::atomic<uint64_t>));
+    }
+}
+
+Supervisor::Worker::Worker(size_t index, SharedCounters& counters, std::vector<int> fds, std::vector<int> families)
+    : index_(index)
+    , counters_(counters)
+    , fds_(std::move(fds))
+    , families_(std::move(families))
+{
+}
+
+Supervisor::Supervisor(const Options& options)
+    : options_ { std::max(options.workers, size_t { 1 }), options.counters, options.restart_delay }
+    , counters_(options.counters)
+    , pids_(options_.workers)
+{
+}
+
+Supervisor::~Supervisor()
+{
+    for (auto& listener : listeners_) {
+        for (int fd : listener.fds) {
+            close_socket(fd);
+        }
+    }
+}
+
+size_t Supervisor::listen_tcp(const Address& addr, int backlog)
+{
+    return add_listener(addr, SOCK_STREAM, backlog);
+}
+
+size_t Supervisor::bind_udp(const Address& addr)
+{
+    return add_listener(addr, SOCK_DGRAM, 0);
+}
+
+size_t Supervisor::add_listener(const Address& addr, int type, int backlog)
+{
+    Listener listener { addr.family(), {} };
+    sockaddr_storage storage {};
+    addr.to_storage(storage);
+    for (size_t slot = 0; slot < options_.workers; slot++) {
+        int fd = ::socket(addr.family(), type, 0);
+        if (fd < 0) {
+            std::ranges::for_each(listener.fds, close_socket);
+            throw NetworkException { "create listener socket failed" };
+        }
+        listener.fds.push_back(fd);
+        set_non_block(fd);
+        int on = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+            std::ranges::for_each(listener.fds, close_socket);
+            throw NetworkException { "SO_REUSEPORT is not supported" };
+        }
+        if (bind_socket(fd, storage) < 0 || (type == SOCK_STREAM && listen_socket(fd, backlog) < 0)) {
+            std::ranges::for_each(listener.fds, close_socket);
+            throw NetworkException { "bind or listen on listener socket failed" };
+        }
+    }
+    listeners_.push_back(std::move(listener));
+    return listeners_.size() - 1;
+}
+
+void Supervisor::run(WorkerMain main)
+{
+    for (size_t slot = 0; slot < options_.workers && !stopping_; slot++) {
+        spawn(slot, main);
+    }
+    while (!stopping_) {
+        //a slot whose fork() failed is tried again after the restart delay
+        const bool vacant = std::ranges::any_of(pids_, [](const std::atomic<pid_t>& p) { return p.load() == 0; });
+        int status {};
+        pid_t pid = ::waitpid(-1, &status, vacant ? WNOHANG : 0);
+        if (vacant && (pid == 0 || (pid < 0 && errno == ECHILD))) {
+            std::this_thread::sleep_for(options_.restart_delay);
+            for (size_t slot = 0; slot < pids_.size() && !stopping_; slot++) {
+                if (pids_[slot].load() == 0) {
+                    spawn(slot, main);
+                }
+            }
+            continue;
+        }
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        auto it = std::ranges::find_if(pids_, [pid](const std::atomic<pid_t>& p) { return p.load() == pid; });
+        if (it == pids_.end()) {
+            continue;
+        }
+        it->store(0);
+        if (stopping_) {
+            break;
+        }
+        restarts_.fetch_add(1, std::memory_order::relaxed);
+        std::this_thread::sleep_for(options_.restart_delay);
+        if (!stopping_) {
+            spawn(static_cast<size_t>(it - pids_.begin()), main);
+        }
+    }
+    terminate_all();
+}
+
+void Supervisor::stop()
+{
+    stopping_ = true;
+    for (auto& pid : pids_) {
+        pid_t p = pid.load();
+        if (p > 0) {
+            ::kill(p, SIGTERM);
+        }
+    }
+}
+
+void Supervisor::spawn(size_t slot, const WorkerMain& main)
+{
+    pid_t pid = ::fork();
+    if (pid < 0) {
+        //the slot stays vacant, run() tries it again
+        fork_failures_.fetch_add(1, std::memory_order::relaxed);
+        return;
+    }
+    if (pid > 0) {
+        pids_[slot] = pid;
+        //stop() may have missed this one
+        if (stopping_) {
+            ::kill(pid, SIGTERM);
+        }
+        return;
+    }
+    //worker: keep only the sockets of its own slot
+    std::vector<int> fds;
+    std::vector<int> families;
+    for (auto& listener : listeners_) {
+        for (size_t i = 0; i < listener.fds.size(); i++) {
+            if (i != slot) {
+                close_socket(listener.fds[i]);
+            }
+        }
+        fds.push_back(listener.fds[slot]);
+        families.push_back(listener.family);
+    }
+    Worker worker { slot, counters_, std::move(fds), std::move(families) };
+    //an exception must not unwind into run(), the worker would carry on as a second supervisor
+    int code = 1;
+    try {
+        code = main(worker);
+    } catch (...) {
+    }
+    ::_exit(code);
+}
+
+void Supervisor::terminate_all()
+{
+    stop();
+    for (auto& pid : pids_) {
+        pid_t p = pid.exchange(0);
+        if (p > 0) {
+            int status {};
+            while (::waitpid(p, &status, 0) < 0 && errno == EINTR) { }
+        }
+    }
+}
+
+} // namespace net
+
+} // namespace bco
+
+#endif // ifdef __linux__
@@ -8,6 +8,7 @@
 #include "../../common.h"
 #include <bco/exception.h>
 #include <bco/net/proactor/epoll.h>
+#include <bco/utils.h>
 
 namespace bco {
 
@@ -31,6 +32,16 @@ Epoll::Epoll()
 
 Epoll::~Epoll()
 {
+    //operations that never completed
+    for (auto* tasks : { &pending_tasks_, &flying_tasks_ }) {
+        for (auto& [_, task] : *tasks) {
+            for (auto* item : { &task.read, &task.write }) {
+                if (item->has_value() && (*item)->completion != nullptr) {
+                    (*item)->completion->discard();
+                }
+            }
+        }
+    }
 }
 
 int Epoll::create(int domain, int type)
@@ -52,81 +63,102 @@ void Epoll::start(ExecutorInterface* executor)
 
 void Epoll::stop()
 {
-    int buff {};
+    uint64_t buff { 1 };
     ::write(exit_fd_, &buff, sizeof(buff));
 }
 
-int Epoll::recv(int s, bco::Buffer buff, std::function<void(int)> cb)
+void Epoll::drain()
+{
+    draining_ = true;
+}
+
+size_t Epoll::inflight()
+{
+    return inflight_.load(std::memory_order::acquire);
+}
+
+void Epoll::cancel_all()
+{
+    cancelled_ = true;
+}
+
+int Epoll::recv(int s, bco::Buffer buff, IoCompletion* completion)
 {
     std::lock_guard lock { mtx_ };
     auto it = pending_tasks_.find(s);
     if (it != pending_tasks_.cend()) {
         it->second.event.events |= EPOLLIN;
         it->second.action |= Action::Recv;
-        it->second.read.emplace(buff, cb, nullptr);
+        it->second.read.emplace(buff, completion, number(completion));
     } else {
         EpollTask task {};
         task.event.data.fd = s;
         task.event.events = EPOLLIN; //level trigger
         task.action |= Action::Recv;
-        task.read.emplace(buff, cb, nullptr);
+        task.read.emplace(buff, completion, number(completion));
         pending_tasks_[s] = task;
     }
+    inflight_++;
     return 0;
 }
 
-int Epoll::recvfrom(int s, bco::Buffer buff, std::function<void(int, const sockaddr_storage&)> cb, void*)
+int Epoll::recvfrom(int s, bco::Buffer buff, IoCompletion* completion, void*)
 {
     std::lock_guard lock { mtx_ };
     auto it = pending_tasks_.find(s);
     if (it != pending_tasks_.cend()) {
         it->second.event.events |= EPOLLIN;
         it->second.action |= Action::Recvfrom;
-        it->second.read.emplace(buff, nullptr, cb);
+        it->second.read.emplace(buff, completion, number(completion));
     } else {
         EpollTask task {};
         task.event.data.fd = s;
         task.event.events = EPOLLIN; //level trigger
         task.action |= Action::Recvfrom;
-        task.read.emplace(buff, nullptr, cb);
+        task.read.emplace(buff, completion, number(completion));
         pending_tasks_[s] = task;
     }
+    inflight_++;
     return 0;
 }
 
-int Epoll::send(int s, bco::Buffer buff, std::function<void(int)> cb)
+int Epoll::send(int s, bco::Buffer buff, IoCompletion* completion)
 {
     if (io_executor_->is_current_executor()) {
-        return send_sync(s, buff, cb);
+        return send_sync(s, buff, completion);
     } else {
-        return send_async(s, buff, cb);
+        return send_async(s, buff, completion);
     }
 }
 
-int Epoll::accept(int s, std::function<void(int, const sockaddr_storage&)> cb)
+int Epoll::accept(int s, IoCompletion* completion)
 {
+    if (draining_)
+        return -ECANCELED;
     EpollTask task {};
     task.event.data.fd = s;
     task.event.events = EPOLLIN; //level trigger
     task.action |= Action::Accept;
-    task.read.emplace(std::span<std::byte> {}, nullptr, cb);
     std::lock_guard lock { mtx_ };
+    task.read.emplace(bco::Buffer {}, completion, number(completion));
     pending_tasks_[s] = task;
+    inflight_++;
     return 0;
 }
 
-int Epoll::connect(int s, const sockaddr_storage& addr, std::function<void(int)> cb)
+int Epoll::connect(int s, const sockaddr_storage& addr, IoCompletion* completion)
 {
     int ret = ::connect(s, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
-    if (ret < 0)
-        return ret;
+    if (ret < 0 && last_error() != EINPROGRESS)
+        return -last_error();
     EpollTask task {};
     task.event.data.fd = s;
     task.event.events = EPOLLOUT; //level triger
     task.action |= Action::Connect;
-    task.write.emplace(std::span<std::byte> {}, cb, nullptr);
     std::lock_guard lock { mtx_ };
+    task.write.emplace(bco::Buffer {}, completion, number(completion));
     pending_tasks_[s] = task;
+    inflight_++;
     return 0;
 }
 
@@ -135,6 +167,18 @@ int Epoll::connect(int s, const sockaddr_storage& addr)
     return ::connect(s, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
 }
 
+void Epoll::cancel(int s, IoCompletion* completion)
+{
+    std::lock_guard lock { mtx_ };
+    cancel_requests_.push_back({ s, completion, completion->operation() });
+}
+
+uint64_t Epoll::number(IoCompletion* completion)
+{
+    completion->set_operation(++operations_);
+    return operations_;
+}
+
 int Epoll::next_timeout()
 {
     return 1;
@@ -146,6 +190,36 @@ std::map<int, Epoll::EpollTask> Epoll::get_pending_tasks()
     return std::move(pending_tasks_);
 }
 
+std::vector<Epoll::CancelRequest> Epoll::get_cancel_requests()
+{
+    std::lock_guard lock { mtx_ };
+    return std::move(cancel_requests_);
+}
+
+//the operations were submitted before they were cancelled, they are flying or completed by now
+void Epoll::cancel_requested(const std::vector<CancelRequest>& requests)
+{
+    for (auto [fd, completion, operation] : requests) {
+        auto it = flying_tasks_.find(fd);
+        if (it == flying_tasks_.end()) {
+            continue;
+        }
+        auto& task = it->second;
+        uint32_t events = task.event.events;
+        if (task.read.has_value() && task.read->completion == completion && task.read->operation == operation) {
+            complete(task.read.value(), -ECANCELED);
+            events &= ~static_cast<uint32_t>(EPOLLIN);
+        } else if (task.write.has_value() && task.write->completion == completion && task.write->operation == operation) {
+            complete(task.write.value(), -ECANCELED);
+            events &= ~static_cast<uint32_t>(EPOLLOUT);
+        }
+        if (events != task.event.events) {
+            task.event.events = events;
+            ::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &task.event);
+        }
+    }
+}
+
 void Epoll::submit_tasks(std::map<int, Epoll::EpollTask>& pending_tasks)
 {
     //do some validation?
@@ -196,8 +270,17 @@ void Epoll::do_io()
 
     constexpr int kMaxEvents = 512;
     std::array<epoll_event, kMaxEvents> events;
+    //taken first, so the operations they cancel are among the tasks submitted below
+    auto cancel_requests = get_cancel_requests();
     auto pending_tasks = get_pending_tasks();
     submit_tasks(pending_tasks);
+    cancel_requested(cancel_requests);
+    //checked on every round, so operations submitted while shutting down are refused as well
+    if (cancelled_) {
+        cancel_flying(false);
+    } else if (draining_) {
+        cancel_flying(true);
+    }
     constexpr int timeout = 0;
     int count = epoll_wait(epoll_fd_, events.data(), events.size(), timeout);
     if (count < 0 && errno != EINTR) {
@@ -212,33 +295,38 @@ void Epoll::do_io()
     io_executor_->post_delay(1ms, bco::PriorityTask { .priority = Priority::Medium, .task = std::bind(&Epoll::do_io, this) });
 }
 
-int Epoll::send_sync(int s, bco::Buffer buff, std::function<void(int)> cb)
+int Epoll::send_sync(int s, bco::Buffer buff, IoCompletion* completion)
 {
     int bytes = syscall_sendv(s, buff);
-    if (bytes >= 0)
-        return bytes;
-    else if (last_error() == EAGAIN || last_error() == EWOULDBLOCK)
-        return send_async(s, buff, cb);
-    else
+    if (bytes >= 0) {
+        completion->set_result(bytes);
+        inflight_++;
+        completions_.push(completion);
+        return 0;
+    } else if (last_error() == EAGAIN || last_error() == EWOULDBLOCK) {
+        return send_async(s, buff, completion);
+    } else {
         return -last_error();
+    }
 }
 
-int Epoll::send_async(int s, bco::Buffer buff, std::function<void(int)> cb)
+int Epoll::send_async(int s, bco::Buffer buff, IoCompletion* completion)
 {
     std::lock_guard lock { mtx_ };
     auto it = pending_tasks_.find(s);
     if (it != pending_tasks_.cend()) {
         it->second.event.events |= EPOLLOUT;
         it->second.action |= Action::Send;
-        it->second.write.emplace(buff, cb, nullptr);
+        it->second.write.emplace(buff, completion, number(completion));
     } else {
         EpollTask task {};
         task.event.data.fd = s;
         task.event.events = EPOLLOUT; //level triger
         task.action |= Action::Send;
-        task.write.emplace(buff, cb, nullptr);
+        task.write.emplace(buff, completion, number(completion));
         pending_tasks_[s] = task;
     }
+    inflight_++;
     return 0;
 }
 
@@ -280,16 +368,14 @@ void Epoll::do_send(EpollTask& task)
     auto& ioitem = task.write.value();
     int bytes = syscall_sendv(task.event.data.fd, ioitem.buff);
     if (bytes >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
-        std::lock_guard lock { mtx_ };
         uint32_t epollout = EPOLLOUT;
         task.event.events &= ~epollout;
         int ret = ::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, task.event.data.fd, &(task.event));
         if (ret < 0) {
             //TODO: error handling
-            //completed_task_.push_back();
             return;
         }
-        completed_task_.push_back(PriorityTask { Priority::Medium, std::bind(ioitem.cb, bytes) });
+        complete(ioitem, bytes);
     }
 }
 
@@ -301,31 +387,27 @@ void Epoll::do_accept(EpollTask& task)
     int fd = ::accept(task.event.data.fd, reinterpret_cast<sockaddr*>(&addr), &len);
     if (fd >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
         set_non_block(fd);
-        std::lock_guard lock { mtx_ };
         uint32_t epollin = EPOLLIN;
         task.event.events &= ~epollin;
         int ret = ::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, task.event.data.fd, &(task.event));
         if (ret < 0) {
             //TODO: error handling
-            //completed_task_.push_back();
             return;
         }
-        completed_task_.push_back(PriorityTask { Priority::Medium, std::bind(ioitem.cb, fd) });
+        complete(ioitem, fd, addr);
     }
 }
 
 void Epoll::on_connected(EpollTask& task)
 {
-    std::lock_guard lock { mtx_ };
     uint32_t epollout = EPOLLOUT;
     task.event.events &= ~epollout;
     int ret = ::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, task.event.data.fd, &(task.event));
     if (ret < 0) {
         //TODO: error handling
-        //completed_task_.push_back();
         return;
     }
-    completed_task_.push_back(PriorityTask { Priority::Medium, std::bind(task.write.value().cb, static_cast<int>(task.event.data.fd)) });
+    complete(task.write.value(), static_cast<int>(task.event.data.fd));
 }
 
 void Epoll::do_recv(EpollTask& task)
@@ -333,16 +415,14 @@ void Epoll::do_recv(EpollTask& task)
     auto& ioitem = task.read.value();
     int bytes = syscall_recvv(task.event.data.fd, ioitem.buff);
     if (bytes >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
-        std::lock_guard lock { mtx_ };
         uint32_t epollin = EPOLLIN;
         task.event.events &= ~epollin;
         int ret = ::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, task.event.data.fd, &(task.event));
         if (ret < 0) {
             //TODO: error handling
-            //completed_task_.push_back();
             return;
         }
-        completed_task_.push_back(PriorityTask { Priority::Medium, std::bind(ioitem.cb, bytes) });
+        complete(ioitem, bytes);
     }
 }
 
@@ -353,23 +433,60 @@ void Epoll::do_recvfrom(EpollTask& task)
     socklen_t len = sizeof(addr);
     int bytes = syscall_recvmsg(task.event.data.fd, ioitem.buff, addr);
     if (bytes >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
-        std::lock_guard lock { mtx_ };
         uint32_t epollin = EPOLLIN;
         task.event.events &= ~epollin;
         int ret = ::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, task.event.data.fd, &(task.event));
         if (ret < 0) {
             //TODO: error handling
-            //completed_task_.push_back();
             return;
         }
-        completed_task_.push_back(PriorityTask { Priority::Medium, std::bind(ioitem.cb2, bytes, addr) });
+        complete(ioitem, bytes, addr);
     }
 }
 
-std::vector<PriorityTask> Epoll::harvest()
+void Epoll::cancel_flying(bool accepts_only)
 {
-    std::lock_guard lock { mtx_ };
-    return std::move(completed_task_);
+    for (auto& [fd, task] : flying_tasks_) {
+        const bool accepting = (task.action & Action::Accept) != Action::None;
+        uint32_t events = task.event.events;
+        if ((events & EPOLLIN) && task.read.has_value() && (accepting || !accepts_only)) {
+            complete(task.read.value(), -ECANCELED);
+            events &= ~static_cast<uint32_t>(EPOLLIN);
+        }
+        if ((events & EPOLLOUT) && task.write.has_value() && !accepts_only) {
+            complete(task.write.value(), -ECANCELED);
+            events &= ~static_cast<uint32_t>(EPOLLOUT);
+        }
+        if (events != task.event.events) {
+            task.event.events = events;
+            ::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &task.event);
+        }
+    }
+}
+
+void Epoll::complete(EpollItem& item, int result)
+{
+    if (item.completion == nullptr) {
+        return;
+    }
+    item.completion->set_result(result);
+    completions_.push(std::exchange(item.completion, nullptr));
+}
+
+void Epoll::complete(EpollItem& item, int result, const sockaddr_storage& addr)
+{
+    if (item.completion == nullptr) {
+        return;
+    }
+    item.completion->set_result(result, addr);
+    completions_.push(std::exchange(item.completion, nullptr));
+}
+
+CompletionList Epoll::harvest()
+{
+    auto completions = completions_.take_all();
+    inflight_ -= completions.size();
+    return completions;
 }
 
 } // namespace net
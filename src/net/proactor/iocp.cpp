@@ -16,6 +16,7 @@
 #include "bco/exception.h"
 #include <bco/executor.h>
 #include <bco/net/proactor/iocp.h>
+#include <bco/utils.h>
 
 namespace bco {
 
@@ -39,16 +40,19 @@ struct OverlapInfo {
     WSAOVERLAPPED overlapped;
     OverlapAction action;
     SOCKET sock;
-    std::function<void(int)> cb;
+    IoCompletion* completion = nullptr;
+    ~OverlapInfo()
+    {
+        if (completion != nullptr)
+            completion->discard();
+    }
 };
 
 struct AcceptOverlapInfo : OverlapInfo {
     std::array<uint8_t, kAcceptBuffLen> buff;
-    std::function<void(int, const sockaddr_storage&)> cb2;
 };
 
 struct RecvfromOverlapInfo : OverlapInfo {
-    std::function<void(int, const sockaddr_storage&)> cb2;
     sockaddr_storage addr;
     int len = sizeof(addr);
 };
@@ -87,11 +91,11 @@ void IOCP::stop()
     ::PostQueuedCompletionStatus(complete_port_, 0, kExitKey, nullptr);
 }
 
-int IOCP::recv(int s, bco::Buffer buff, std::function<void(int)> cb)
+int IOCP::recv(int s, bco::Buffer buff, IoCompletion* completion)
 {
     OverlapInfo* overlap_info = new OverlapInfo;
     overlap_info->action = OverlapAction::Recv;
-    overlap_info->cb = std::move(cb);
+    overlap_info->completion = completion;
     overlap_info->sock = s;
     ::SecureZeroMemory((PVOID)&overlap_info->overlapped, sizeof(WSAOVERLAPPED));
     auto slices = buff.data();
@@ -102,19 +106,24 @@ int IOCP::recv(int s, bco::Buffer buff, std::function<void(int)> cb)
     }
     DWORD flags = 0;
     DWORD bytes_transferred;
+    track(completion, &overlap_info->overlapped);
     int ret = ::WSARecv(s, wsabuf.data(), static_cast<DWORD>(wsabuf.size()), &bytes_transferred, &flags, &overlap_info->overlapped, nullptr);
     if (ret == SOCKET_ERROR) {
         int last_error = ::WSAGetLastError();
-        return last_error == WSA_IO_PENDING ? 0 : -last_error;
+        if (last_error == WSA_IO_PENDING) {
+            return 0;
+        }
+        untrack(completion);
+        return -last_error;
     }
     return 0;
 }
 
-int IOCP::recvfrom(int s, bco::Buffer buff, std::function<void(int, const sockaddr_storage&)> cb, void*)
+int IOCP::recvfrom(int s, bco::Buffer buff, IoCompletion* completion, void*)
 {
     RecvfromOverlapInfo* overlap_info = new RecvfromOverlapInfo;
     overlap_info->action = OverlapAction::Recvfrom;
-    overlap_info->cb2 = std::move(cb);
+    overlap_info->completion = completion;
     overlap_info->sock = s;
     ::SecureZeroMemory((PVOID)&overlap_info->overlapped, sizeof(WSAOVERLAPPED));
     auto slices = buff.data();
@@ -125,19 +134,24 @@ int IOCP::recvfrom(int s, bco::Buffer buff, std::function<void(int, const sockad
     }
     DWORD flags = 0;
     DWORD bytes_transferred;
+    track(completion, &overlap_info->overlapped);
     int ret = ::WSARecvFrom(s, wsabuf.data(), static_cast<DWORD>(wsabuf.size()), &bytes_transferred, &flags, reinterpret_cast<sockaddr*>(&overlap_info->addr), &overlap_info->len, &overlap_info->overlapped, nullptr);
     if (ret == SOCKET_ERROR) {
         int last_error = ::WSAGetLastError();
-        return last_error == WSA_IO_PENDING ? 0 : -last_error;
+        if (last_error == WSA_IO_PENDING) {
+            return 0;
+        }
+        untrack(completion);
+        return -last_error;
     }
     return 0;
 }
 
-int IOCP::send(int s, bco::Buffer buff, std::function<void(int length)> cb)
+int IOCP::send(int s, bco::Buffer buff, IoCompletion* completion)
 {
     OverlapInfo* overlap_info = new OverlapInfo;
     overlap_info->action = OverlapAction::Send;
-    overlap_info->cb = std::move(cb);
+    overlap_info->completion = completion;
     overlap_info->sock = s;
     ::SecureZeroMemory((PVOID)&overlap_info->overlapped, sizeof(WSAOVERLAPPED));
     auto slices = buff.data();
@@ -148,10 +162,15 @@ int IOCP::send(int s, bco::Buffer buff, std::function<void(int length)> cb)
     }
     DWORD flags = 0;
     DWORD bytes_transferred;
+    track(completion, &overlap_info->overlapped);
     int ret = ::WSASend(s, wsabuf.data(), static_cast<DWORD>(wsabuf.size()), &bytes_transferred, flags, &overlap_info->overlapped, nullptr);
     if (ret == SOCKET_ERROR) {
         int last_error = ::WSAGetLastError();
-        return last_error == WSA_IO_PENDING ? 0 : -last_error;
+        if (last_error == WSA_IO_PENDING) {
+            return 0;
+        }
+        untrack(completion);
+        return -last_error;
     }
     return 0;
 }
@@ -175,11 +194,11 @@ int IOCP::sendto(int s, bco::Buffer buff, const sockaddr_storage& addr, void*)
 }
 
 //only ipv4 now
-int IOCP::accept(int s, std::function<void(int, const sockaddr_storage&)> cb)
+int IOCP::accept(int s, IoCompletion* completion)
 {
     AcceptOverlapInfo* overlap_info = new AcceptOverlapInfo;
     overlap_info->action = OverlapAction::Accept;
-    overlap_info->cb2 = std::move(cb);
+    overlap_info->completion = completion;
     overlap_info->sock = ::socket(AF_INET, SOCK_STREAM, 0);
     if (overlap_info->sock == INVALID_SOCKET) {
         delete overlap_info;
@@ -187,9 +206,11 @@ int IOCP::accept(int s, std::function<void(int, const sockaddr_storage&)> cb)
     }
     ::SecureZeroMemory((PVOID)&overlap_info->overlapped, sizeof(WSAOVERLAPPED));
     DWORD bytes;
+    track(completion, &overlap_info->overlapped);
     bool success = ::AcceptEx(s, overlap_info->sock, overlap_info->buff.data(), 0, sizeof(SOCKADDR_IN) + 16, sizeof(SOCKADDR_IN) + 16, &bytes, &overlap_info->overlapped);
     int last_error = ::WSAGetLastError();
     if (!success && last_error != WSA_IO_PENDING) {
+        untrack(completion);
         return -last_error;
     }
     return 0;
@@ -207,11 +228,11 @@ LPFN_CONNECTEX GetConnectEx(SOCKET so)
     return fnConnectEx;
 }
 
-int IOCP::connect(int s, const sockaddr_storage& addr, std::function<void(int)> cb)
+int IOCP::connect(int s, const sockaddr_storage& addr, IoCompletion* completion)
 {
     OverlapInfo* overlap_info = new OverlapInfo;
     overlap_info->action = OverlapAction::Connect;
-    overlap_info->cb = std::move(cb);
+    overlap_info->completion = completion;
     overlap_info->sock = s;
     if (overlap_info->sock == INVALID_SOCKET) {
         delete overlap_info;
@@ -223,12 +244,16 @@ int IOCP::connect(int s, const sockaddr_storage& addr, std::function<void(int)>
     if (ConnectEx == nullptr) {
         return -::WSAGetLastError();
     }
+    track(completion, &overlap_info->overlapped);
     bool success = ConnectEx(overlap_info->sock, (SOCKADDR*)&addr, sizeof(addr), nullptr, 0, &bytes_sent, &overlap_info->overlapped);
     if (success || ::WSAGetLastError() == ERROR_IO_PENDING) {
         return 0;
     } else {
+        int last_error = ::WSAGetLastError();
+        untrack(completion);
+        overlap_info->completion = nullptr;
         delete overlap_info;
-        return -::WSAGetLastError();
+        return -last_error;
     }
 }
 
@@ -242,10 +267,31 @@ int IOCP::connect(int s, const sockaddr_storage& addr)
     }
 }
 
-std::vector<PriorityTask> net::IOCP::harvest()
+//CancelIoEx() makes the operation fail with ERROR_OPERATION_ABORTED, see handle_overlap_failure()
+void IOCP::cancel(int s, IoCompletion* completion)
 {
     std::lock_guard lock { mtx_ };
-    return std::move(completed_tasks_);
+    auto it = flying_.find(completion);
+    if (it != flying_.end()) {
+        ::CancelIoEx(reinterpret_cast<HANDLE>(static_cast<SOCKET>(s)), it->second);
+    }
+}
+
+void IOCP::track(IoCompletion* completion, WSAOVERLAPPED* overlapped)
+{
+    std::lock_guard lock { mtx_ };
+    flying_[completion] = overlapped;
+}
+
+void IOCP::untrack(IoCompletion* completion)
+{
+    std::lock_guard lock { mtx_ };
+    flying_.erase(completion);
+}
+
+CompletionList net::IOCP::harvest()
+{
+    return completions_.take_all();
 }
 
 void IOCP::iocp_loop()
@@ -269,9 +315,7 @@ void IOCP::iocp_loop()
                 break;
             }
         } else if (ret == 0 && overlapped != 0) {
-            auto err = ::WSAGetLastError();
-            (void)err;
-            //TODO: handler error
+            handle_overlap_failure(overlapped, ::WSAGetLastError());
         } else if (ret != 0 && overlapped == 0) {
             assert(false);
         } else if (ret != 0 && overlapped != 0) {
@@ -286,6 +330,7 @@ void IOCP::handle_overlap_success(WSAOVERLAPPED* overlapped, int bytes)
 {
     // TODO: error handling
     OverlapInfo* overlap_info = reinterpret_cast<OverlapInfo*>(overlapped);
+    untrack(overlap_info->completion);
     switch (overlap_info->action) {
     case OverlapAction::Accept: {
         AcceptOverlapInfo* accept_info = reinterpret_cast<AcceptOverlapInfo*>(overlapped);
@@ -301,33 +346,27 @@ void IOCP::handle_overlap_success(WSAOVERLAPPED* overlapped, int bytes)
                 addr = *reinterpret_cast<sockaddr_storage*>(remote);
             }
         }
-        {
-            std::lock_guard lock { mtx_ };
-            completed_tasks_.push_back(PriorityTask { Priority::Medium, std::bind(accept_info->cb2, static_cast<int>(overlap_info->sock), addr) });
-        }
+        accept_info->completion->set_result(static_cast<int>(overlap_info->sock), addr);
+        completions_.push(std::exchange(accept_info->completion, nullptr));
         delete accept_info;
         break;
     }
     case OverlapAction::Recv:
-    case OverlapAction::Send: {
-        std::lock_guard lock { mtx_ };
-        completed_tasks_.push_back(PriorityTask { Priority::Medium, std::bind(overlap_info->cb, bytes) });
-    }
+    case OverlapAction::Send:
+        overlap_info->completion->set_result(bytes);
+        completions_.push(std::exchange(overlap_info->completion, nullptr));
         delete overlap_info;
         break;
     case OverlapAction::Recvfrom: {
         RecvfromOverlapInfo* rf_info = reinterpret_cast<RecvfromOverlapInfo*>(overlapped);
-        {
-            std::lock_guard lock { mtx_ };
-            completed_tasks_.push_back(PriorityTask { Priority::Medium, std::bind(rf_info->cb2, bytes, rf_info->addr) });
-        }
+        rf_info->completion->set_result(bytes, rf_info->addr);
+        completions_.push(std::exchange(rf_info->completion, nullptr));
         delete rf_info;
         break;
     }
-    case OverlapAction::Connect: {
-        std::lock_guard lock { mtx_ };
-        completed_tasks_.push_back(PriorityTask { Priority::Medium, std::bind(overlap_info->cb, bytes) });
-    }
+    case OverlapAction::Connect:
+        overlap_info->completion->set_result(bytes);
+        completions_.push(std::exchange(overlap_info->completion, nullptr));
         delete overlap_info;
         break;
     default:
@@ -335,6 +374,27 @@ void IOCP::handle_overlap_success(WSAOVERLAPPED* overlapped, int bytes)
     }
 }
 
+void IOCP::handle_overlap_failure(WSAOVERLAPPED* overlapped, int error)
+{
+    OverlapInfo* overlap_info = reinterpret_cast<OverlapInfo*>(overlapped);
+    untrack(overlap_info->completion);
+    overlap_info->completion->set_result(error == ERROR_OPERATION_ABORTED ? -ECANCELED : -error);
+    completions_.push(std::exchange(overlap_info->completion, nullptr));
+    switch (overlap_info->action) {
+    case OverlapAction::Accept: {
+        AcceptOverlapInfo* accept_info = reinterpret_cast<AcceptOverlapInfo*>(overlapped);
+        ::closesocket(accept_info->sock);
+        delete accept_info;
+        break;
+    }
+    case OverlapAction::Recvfrom:
+        delete reinterpret_cast<RecvfromOverlapInfo*>(overlapped);
+        break;
+    default:
+        delete overlap_info;
+    }
+}
+
 DWORD IOCP::next_timeout()
 {
     return 10;
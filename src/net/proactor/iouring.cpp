@@ -1,14 +1,13 @@
 #ifdef __linux__
-#include <linux/version.h>
 #include <sys/mman.h>
 #include <sys/syscall.h>
-#include <sys/utsname.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <functional>
-#include <regex>
+#include <vector>
 
 #include "../../common.h"
 #include <bco/exception.h>
@@ -62,12 +61,60 @@ enum class Opcode : uint8_t {
     LAST,
 
 };
+
+//user_data of ASYNC_CANCEL requests, their completions are not found among the flying tasks
+constexpr uint64_t kCancelTag = uint64_t { 1 } << 63;
+
+constexpr Opcode kRequiredOpcodes[] = { Opcode::RECVMSG, Opcode::SENDMSG, Opcode::ACCEPT, Opcode::CONNECT, Opcode::ASYNC_CANCEL };
+
+//IORING_REGISTER_PROBE came with 5.6, older kernels fail it and count as unsupported
+bool supports_required_opcodes(int ring_fd)
+{
+    constexpr unsigned kMaxOps = 256;
+    std::vector<uint8_t> buff(sizeof(::io_uring_probe) + kMaxOps * sizeof(::io_uring_probe_op));
+    auto probe = reinterpret_cast<::io_uring_probe*>(buff.data());
+    if (::syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PROBE, probe, kMaxOps) < 0) {
+        return false;
+    }
+    for (Opcode opcode : kRequiredOpcodes) {
+        auto op = static_cast<uint8_t>(opcode);
+        if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+            return false;
+        }
+    }
+    return true;
+}
 } // namespace
 
 IOUring::IOUring(const Params& params)
 {
-    verify_kernel_version();
     setup_io_uring(params);
+    verify_opcodes();
+}
+
+IOUring::Support IOUring::probe()
+{
+    Support support;
+    ::io_uring_params params {};
+    int fd = static_cast<int>(::syscall(__NR_io_uring_setup, 2, &params));
+    if (fd < 0) {
+        return support;
+    }
+    support.available = true;
+    support.features = params.features;
+    support.opcodes = supports_required_opcodes(fd);
+    ::close(fd);
+
+    //unprivileged SQPOLL needs 5.11, before that CAP_SYS_ADMIN
+    params = ::io_uring_params {};
+    params.flags = IORING_SETUP_SQPOLL;
+    params.sq_thread_idle = 1;
+    fd = static_cast<int>(::syscall(__NR_io_uring_setup, 2, &params));
+    if (fd >= 0) {
+        support.sq_poll = true;
+        ::close(fd);
+    }
+    return support;
 }
 
 IOUring::~IOUring()
@@ -79,36 +126,29 @@ IOUring::~IOUring()
         ::munmap(cq_ring_.mmap_ptr, cq_ring_.ring_size);
     }
     ::munmap(sqes_, sq_entries_ * sizeof(::io_uring_sqe));
+    ::close(fd_);
 }
 
-void IOUring::verify_kernel_version()
+void IOUring::verify_opcodes()
 {
-    ::utsname name {};
-    int ret = ::uname(&name);
-    if (ret < 0) {
-        throw NetworkException { "get kernel version failed" };
-    }
-    std::string str = name.release;
-    std::regex pattern { "^([0-9]+?)\\.([0-9]+?)\\.([0-9]+?)" };
-    std::smatch sm;
-    if (!std::regex_match(str, sm, pattern)) {
-        throw NetworkException { "get kernel version failed" };
-    }
-    auto major = std::stoi(sm[1].str());
-    auto minor = std::stoi(sm[2].str());
-    if (KERNEL_VERSION(major, minor, 0) < KERNEL_VERSION(5, 5, 0)) {
-        throw NetworkException { "kernel version lower than 5.5" };
+    if (!supports_required_opcodes(fd_)) {
+        throw NetworkException { "io_uring lacks required opcodes" };
     }
 }
 
 void IOUring::setup_io_uring(const Params& init_params)
 {
-    constexpr uint32_t kDefaultDepth = 1;
+    constexpr uint32_t kDefaultDepth = 256;
     ::io_uring_params params;
     char* sq_ptr;
     char* cq_ptr;
 
     ::memset(&params, 0, sizeof(params));
+    if (init_params.sq_poll.has_value()) {
+        params.flags |= IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = static_cast<uint32_t>(init_params.sq_poll->idle_time.count());
+        sq_poll_ = true;
+    }
     fd_ = _io_uring_setup(init_params.queue_depth.value_or(kDefaultDepth), &params);
     if (fd_ < 0) {
         throw NetworkException { "create io_uring fd failed" };
@@ -125,6 +165,7 @@ void IOUring::setup_io_uring(const Params& init_params)
         throw NetworkException { "mmap failed" };
     }
     sq_ptr = static_cast<char*>(ptr);
+    sq_ring_.mmap_ptr = cq_ring_.mmap_ptr = ptr;
     //kernel 5.4
     if (params.features & IORING_FEAT_SINGLE_MMAP) {
         cq_ptr = sq_ptr;
@@ -134,6 +175,7 @@ void IOUring::setup_io_uring(const Params& init_params)
             throw NetworkException { "mmap failed" };
         }
         cq_ptr = static_cast<char*>(ptr);
+        cq_ring_.mmap_ptr = ptr;
     }
     sq_ring_.head = reinterpret_cast<unsigned*>(sq_ptr + params.sq_off.head);
     sq_ring_.tail = reinterpret_cast<unsigned*>(sq_ptr + params.sq_off.tail);
@@ -167,6 +209,22 @@ void IOUring::start(ExecutorInterface* executor)
 
 void IOUring::stop()
 {
+    stopped_ = true;
+}
+
+void IOUring::drain()
+{
+    draining_ = true;
+}
+
+size_t IOUring::inflight()
+{
+    return inflight_.load(std::memory_order::acquire);
+}
+
+void IOUring::cancel_all()
+{
+    cancelled_ = true;
 }
 
 int IOUring::create(int domain, int type)
@@ -178,25 +236,34 @@ int IOUring::create(int domain, int type)
     return static_cast<int>(fd);
 }
 
-int IOUring::recv(int s, bco::Buffer buff, std::function<void(int)> cb)
+int IOUring::recv(int s, bco::Buffer buff, IoCompletion* completion)
 {
     uint64_t id = lastest_task_id_.fetch_add(1);
+    completion->set_operation(id);
     std::lock_guard lock { mutex_ };
-    pending_tasks_.emplace(id, UringTask { id, s, Action::Recv, buff, cb });
+    pending_tasks_.emplace(std::piecewise_construct, std::forward_as_tuple(id), std::forward_as_tuple(id, s, Action::Recv, buff, completion));
+    inflight_++;
+    return 0;
 }
 
-int IOUring::recvfrom(int s, bco::Buffer buff, std::function<void(int, const sockaddr_storage&)> cb, void*)
+int IOUring::recvfrom(int s, bco::Buffer buff, IoCompletion* completion, void*)
 {
     uint64_t id = lastest_task_id_.fetch_add(1);
+    completion->set_operation(id);
     std::lock_guard lock { mutex_ };
-    pending_tasks_.emplace(id, UringTask { id, s, Action::Recvfrom, buff, cb, true });
+    pending_tasks_.emplace(std::piecewise_construct, std::forward_as_tuple(id), std::forward_as_tuple(id, s, Action::Recvfrom, buff, completion, true));
+    inflight_++;
+    return 0;
 }
 
-int IOUring::send(int s, bco::Buffer buff, std::function<void(int)> cb)
+int IOUring::send(int s, bco::Buffer buff, IoCompletion* completion)
 {
     uint64_t id = lastest_task_id_.fetch_add(1);
+    completion->set_operation(id);
     std::lock_guard lock { mutex_ };
-    pending_tasks_.emplace(id, UringTask { id, s, Action::Send, buff, cb });
+    pending_tasks_.emplace(std::piecewise_construct, std::forward_as_tuple(id), std::forward_as_tuple(id, s, Action::Send, buff, completion));
+    inflight_++;
+    return 0;
 }
 
 //需不需要加入iouring??
@@ -219,19 +286,27 @@ int IOUring::sendto(int s, bco::Buffer buff, const sockaddr_storage& addr, void*
         return bytes;
 }
 
-int IOUring::accept(int s, std::function<void(int, const sockaddr_storage&)> cb)
+int IOUring::accept(int s, IoCompletion* completion)
 {
+    if (draining_)
+        return -ECANCELED;
     uint64_t id = lastest_task_id_.fetch_add(1);
+    completion->set_operation(id);
     std::lock_guard lock { mutex_ };
-    pending_tasks_.emplace(id, UringTask { id, s, Action::Accept, bco::Buffer {}, cb, true });
+    pending_tasks_.emplace(std::piecewise_construct, std::forward_as_tuple(id), std::forward_as_tuple(id, s, Action::Accept, bco::Buffer {}, completion, true));
+    inflight_++;
+    return 0;
 }
 
-int IOUring::connect(int s, const sockaddr_storage& addr, std::function<void(int)> cb)
+int IOUring::connect(int s, const sockaddr_storage& addr, IoCompletion* completion)
 {
     uint64_t id = lastest_task_id_.fetch_add(1);
+    completion->set_operation(id);
     std::lock_guard lock { mutex_ };
-    pending_tasks_.emplace(id, UringTask { id, s, Action::Connect, bco::Buffer {}, cb });
-    pending_tasks_[id].addr = addr;
+    auto [it, _] = pending_tasks_.emplace(std::piecewise_construct, std::forward_as_tuple(id), std::forward_as_tuple(id, s, Action::Connect, bco::Buffer {}, completion));
+    it->second.addr = addr;
+    inflight_++;
+    return 0;
 }
 
 int IOUring::connect(int s, const sockaddr_storage& addr)
@@ -243,18 +318,29 @@ int IOUring::connect(int s, const sockaddr_storage& addr)
         return 0;
 }
 
-std::vector<PriorityTask> IOUring::harvest()
+void IOUring::cancel(int, IoCompletion* completion)
 {
     std::lock_guard lock { mutex_ };
-    return std::move(completed_task_);
+    cancel_requests_.push_back(completion->operation());
+}
+
+CompletionList IOUring::harvest()
+{
+    auto completions = completions_.take_all();
+    inflight_ -= completions.size();
+    return completions;
 }
 
 void IOUring::do_io()
 {
     assert(executor_->is_current_executor());
 
+    if (stopped_) {
+        return;
+    }
     handle_complete_tasks();
     auto pending_tasks = get_pending_tasks();
+    refuse_tasks(pending_tasks);
     submit_tasks(pending_tasks);
     handle_complete_tasks(); //有必要么
     using namespace std::chrono_literals;
@@ -270,16 +356,32 @@ std::map<uint64_t, IOUring::UringTask> IOUring::get_pending_tasks()
 void IOUring::submit_tasks(std::map<uint64_t, IOUring::UringTask>& tasks)
 {
     size_t ops = 0;
-    for (auto& it : tasks) {
-        //FIXME:如果sqe不够了，把剩下的tasks扔回pending tasks
-        submit_one_task(it.second);
-        ops++;
+    for (auto it = tasks.begin(); it != tasks.end() && free_sqes() > 0; ops++) {
+        submit_one_task(it->second);
+        flying_tasks_.insert(tasks.extract(it++));
     }
-    int ret = _io_uring_enter(fd_, ops, 0, 0);
+    if (!tasks.empty()) {
+        //the SQ ring is full, the rest goes next round
+        std::lock_guard lock { mutex_ };
+        pending_tasks_.merge(tasks);
+    }
+    ops += cancel_flying_tasks();
+    ops += cancel_requested_tasks();
+    if (ops == 0) {
+        return;
+    }
+    unsigned flags = 0;
+    if (sq_poll_) {
+        //the kernel thread picks up the entries by itself unless it went idle
+        if (!(std::atomic_ref { *sq_ring_.flags }.load(std::memory_order::acquire) & IORING_SQ_NEED_WAKEUP)) {
+            return;
+        }
+        flags |= IORING_ENTER_SQ_WAKEUP;
+    }
+    int ret = _io_uring_enter(fd_, static_cast<unsigned>(ops), 0, flags);
     if (ret < 0) {
         // TODO: error handling;
     }
-    flying_tasks_.insert(std::move(tasks.extract(tasks.begin())));
 }
 
 void IOUring::submit_one_task(IOUring::UringTask& task)
@@ -312,57 +414,60 @@ void IOUring::submit_rw(IOUring::UringTask& task)
     if (task.addr.has_value()) {
         addr = &task.addr.value();
     }
-    ::msghdr hdr {
-        .msg_name = addr == nullptr ? nullptr : reinterpret_cast<sockaddr*>(addr),
-        .msg_namelen = addr == nullptr ? 0 : sizeof(sockaddr_storage),
+    //read by the kernel when the operation is issued, which may be after io_uring_enter returned
+    task.hdr = ::msghdr {
+        .msg_name = addr,
+        .msg_namelen = addr == nullptr ? 0 : static_cast<::socklen_t>(sizeof(sockaddr_storage)),
         .msg_iov = task.iovecs.data(),
         .msg_iovlen = task.iovecs.size(),
         .msg_control = nullptr,
         .msg_controllen = 0,
         .msg_flags = 0,
     };
-    submit_sqe(task.fd, action_to_opcode(task.action), &hdr, sizeof(::msghdr), task.id);
+    submit_sqe(task.fd, action_to_opcode(task.action), &task.hdr, 1, 0, task.id);
 }
 
 void IOUring::submit_connect(IOUring::UringTask& task)
 {
-    submit_sqe(task.fd, action_to_opcode(task.action), &task.addr.value(), sizeof(sockaddr_storage), task.id);
+    //the address length goes in 'off'
+    submit_sqe(task.fd, action_to_opcode(task.action), &task.addr.value(), 0, sizeof(sockaddr_storage), task.id);
 }
 
 void IOUring::submit_accept(IOUring::UringTask& task)
 {
-    submit_sqe(task.fd, action_to_opcode(task.action), &task.addr.value(), sizeof(sockaddr_storage), task.id);
+    //'off' points to the address length
+    submit_sqe(task.fd, action_to_opcode(task.action), &task.addr.value(), 0, reinterpret_cast<uint64_t>(&task.addrlen), task.id);
 }
 
-void IOUring::submit_sqe(int32_t fd, uint8_t opcode, void* addr, uint64_t len, uint64_t user_data)
+unsigned IOUring::free_sqes() const
 {
-    unsigned next_tail = *sq_ring_.tail;
-    unsigned tail = next_tail;
-    next_tail++;
-    std::atomic_thread_fence(std::memory_order::release);
+    unsigned head = std::atomic_ref { *sq_ring_.head }.load(std::memory_order::acquire);
+    return *sq_ring_.ring_entries - (*sq_ring_.tail - head);
+}
+
+void IOUring::submit_sqe(int32_t fd, uint8_t opcode, void* addr, uint32_t len, uint64_t off, uint64_t user_data)
+{
+    unsigned tail = *sq_ring_.tail;
     unsigned index = tail & *sq_ring_.ring_mask;
     ::io_uring_sqe* sqe = sqes_ + index;
+    *sqe = ::io_uring_sqe {};
     sqe->fd = fd;
     sqe->flags = 0;
     sqe->opcode = opcode;
     sqe->addr = reinterpret_cast<decltype(sqe->addr)>(addr);
     sqe->len = len;
-    sqe->off = 0;
+    sqe->off = off;
     sqe->user_data = user_data;
     sq_ring_.array[index] = index;
-    tail = next_tail;
-    if (*sq_ring_.tail != tail) {
-        *sq_ring_.tail = tail;
-        std::atomic_thread_fence(std::memory_order::acquire);
-    }
+    //publishes the entry, an SQPOLL thread may pick it up right away
+    std::atomic_ref { *sq_ring_.tail }.store(tail + 1, std::memory_order::release);
 }
 
 void IOUring::handle_complete_tasks()
 {
     unsigned head = *cq_ring_.head;
     do {
-        std::atomic_thread_fence(std::memory_order::release);
-        if (head == *cq_ring_.tail) {
+        if (head == std::atomic_ref { *cq_ring_.tail }.load(std::memory_order::acquire)) {
             break;
         }
         auto cqe = &cq_ring_.cqes[head & *cq_ring_.ring_mask];
@@ -370,27 +475,111 @@ void IOUring::handle_complete_tasks()
         handle_complete_task(cqe->user_data, cqe);
         head++;
     } while (true);
+    std::atomic_ref { *cq_ring_.head }.store(head, std::memory_order::release);
 }
 
 void IOUring::handle_complete_task(uint64_t id, const io_uring_cqe* cqe)
 {
+    //completions of ASYNC_CANCEL requests carry kCancelTag and are not found here
     auto task = flying_tasks_.find(id);
     if (task == flying_tasks_.end()) {
         return;
     }
-    switch (task->second.action) {
-    case Action::Recv:
-    case Action::Send:
-    case Action::Connect:
-        completed_task_.push_back(PriorityTask { Priority::Medium, std::bind(task->second.cb, cqe->res) });
-        break;
-    case Action::Recvfrom:
-    case Action::Accept:
-        completed_task_.push_back(PriorityTask { Priority::Medium, std::bind(task->second.cb2, cqe->res, task->second.addr.value()) });
-        break;
-    default:
-        break;
+    complete(task->second, cqe->res);
+    flying_tasks_.erase(task);
+}
+
+void IOUring::complete(UringTask& task, int result)
+{
+    if (task.action == Action::Recvfrom || task.action == Action::Accept) {
+        task.completion->set_result(result, task.addr.value());
+    } else {
+        task.completion->set_result(result);
+    }
+    completions_.push(std::exchange(task.completion, nullptr));
+}
+
+//fail the tasks that are not allowed to start any more instead of submitting them
+void IOUring::refuse_tasks(std::map<uint64_t, UringTask>& tasks)
+{
+    if (!cancelled_ && !draining_) {
+        return;
+    }
+    for (auto it = tasks.begin(); it != tasks.end();) {
+        if (cancelled_ || it->second.action == Action::Accept) {
+            complete(it->second, -ECANCELED);
+            it = tasks.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+//the kernel completes the cancelled operations with -ECANCELED
+size_t IOUring::cancel_flying_tasks()
+{
+    if (!cancelled_ && !draining_) {
+        return 0;
     }
+    size_t ops = 0;
+    for (auto& [id, task] : flying_tasks_) {
+        if (task.cancelling || (!cancelled_ && task.action != Action::Accept)) {
+            continue;
+        }
+        if (free_sqes() == 0) {
+            break;
+        }
+        submit_cancel(task);
+        ops++;
+    }
+    return ops;
+}
+
+//operations cancelled through cancel(), the ones still pending never reach the kernel
+size_t IOUring::cancel_requested_tasks()
+{
+    std::vector<uint64_t> requests;
+    {
+        std::lock_guard lock { mutex_ };
+        requests.swap(cancel_requests_);
+    }
+    size_t ops = 0;
+    for (auto it = requests.begin(); it != requests.end();) {
+        auto flying = flying_tasks_.find(*it);
+        if (flying != flying_tasks_.end()) {
+            if (flying->second.cancelling) {
+                it = requests.erase(it);
+            } else if (free_sqes() > 0) {
+                submit_cancel(flying->second);
+                ops++;
+                it = requests.erase(it);
+            } else {
+                //tried again next round
+                ++it;
+            }
+            continue;
+        }
+        {
+            std::lock_guard lock { mutex_ };
+            auto pending = pending_tasks_.find(*it);
+            if (pending != pending_tasks_.end()) {
+                complete(pending->second, -ECANCELED);
+                pending_tasks_.erase(pending);
+            }
+        }
+        it = requests.erase(it);
+    }
+    if (!requests.empty()) {
+        std::lock_guard lock { mutex_ };
+        cancel_requests_.insert(cancel_requests_.end(), requests.begin(), requests.end());
+    }
+    return ops;
+}
+
+void IOUring::submit_cancel(UringTask& task)
+{
+    submit_sqe(-1, static_cast<uint8_t>(Opcode::ASYNC_CANCEL), reinterpret_cast<void*>(task.id), 0, 0, task.id | kCancelTag);
+    task.cancelling = true;
 }
 
 uint8_t IOUring::action_to_opcode(IOUring::Action action)
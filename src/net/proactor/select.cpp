@@ -4,36 +4,37 @@
 
 #include "../../common.h"
 #include <bco/net/proactor/select.h>
+#include <bco/utils.h>
 
 namespace bco {
 
 namespace net {
 
-Select::SelectTask::SelectTask(int _fd, Action _action, bco::Buffer _buff, std::function<void(int)> _cb)
+Select::SelectTask::SelectTask(int _fd, Action _action, bco::Buffer _buff, IoCompletion* _completion)
     : fd(_fd)
     , action(_action)
     , buff(_buff)
-    , cb(_cb)
-{
-}
-
-Select::SelectTask::SelectTask(int _fd, Action _action, bco::Buffer _buff, std::function<void(int, const sockaddr_storage&)> _cb)
-    : fd(_fd)
-    , action(_action)
-    , buff(_buff)
-    , cb2(_cb)
+    , completion(_completion)
 {
 }
 
 Select::Select()
 {
     max_rfd_ = std::max(stop_event_.fd(), wakeup_event_.fd());
-    pending_rfds_[stop_event_.fd()] = SelectTask { stop_event_.fd(), Action::Recv, bco::Buffer {}, std::function<void(int)> {} };
-    pending_rfds_[wakeup_event_.fd()] = SelectTask { wakeup_event_.fd(), Action::Recv, bco::Buffer {}, std::function<void(int)> {} };
+    pending_rfds_[stop_event_.fd()] = SelectTask { stop_event_.fd(), Action::Recv, bco::Buffer {}, nullptr };
+    pending_rfds_[wakeup_event_.fd()] = SelectTask { wakeup_event_.fd(), Action::Recv, bco::Buffer {}, nullptr };
 }
 
 Select::~Select()
 {
+    //operations that never completed
+    for (auto* tasks : { &pending_rfds_, &pending_wfds_ }) {
+        for (auto& [_, task] : *tasks) {
+            if (task.completion != nullptr) {
+                task.completion->discard();
+            }
+        }
+    }
 }
 
 int Select::create(int domain, int type)
@@ -67,30 +68,52 @@ void Select::stop()
     stop_event_.emit();
 }
 
-int Select::recv(int s, bco::Buffer buff, std::function<void(int length)> cb)
+void Select::drain()
+{
+    draining_ = true;
+    wake();
+}
+
+size_t Select::inflight()
+{
+    std::lock_guard lock { mtx_ };
+    //the stop and wakeup events are always watched
+    return pending_rfds_.size() - 2 + pending_wfds_.size() + completed_.load(std::memory_order::acquire);
+}
+
+void Select::cancel_all()
+{
+    cancelled_ = true;
+    wake();
+}
+
+int Select::recv(int s, bco::Buffer buff, IoCompletion* completion)
 {
     {
         std::lock_guard lock { mtx_ };
         if (s > max_rfd_)
             max_rfd_ = s;
-        pending_rfds_[s] = SelectTask { s, Action::Recv, buff, cb };
+        pending_rfds_[s] = SelectTask { s, Action::Recv, buff, completion };
+        number(pending_rfds_[s]);
     }
     io_executor_->wake();
     return 0;
 }
 
-int Select::recvfrom(int s, bco::Buffer buff, std::function<void(int, const sockaddr_storage&)> cb, void* optdata)
+int Select::recvfrom(int s, bco::Buffer buff, IoCompletion* completion, void* optdata)
 {
     {
         std::lock_guard lock { mtx_ };
         if (s > max_rfd_)
             max_rfd_ = s;
 #ifdef _WIN32
-        auto stask = SelectTask { s, Action::Recvfrom, buff, cb };
+        auto stask = SelectTask { s, Action::Recvfrom, buff, completion };
         stask.recvmsg_func = optdata;
+        number(stask);
         pending_rfds_[s] = stask;
 #else
-        pending_rfds_[s] = SelectTask { s, Action::Recvfrom, buff, cb };
+        pending_rfds_[s] = SelectTask { s, Action::Recvfrom, buff, completion };
+        number(pending_rfds_[s]);
 #endif // _WIN32
     }
     io_executor_->wake();
@@ -98,33 +121,36 @@ int Select::recvfrom(int s, bco::Buffer buff, std::function<void(int, const sock
 }
 
 //for tcp
-int Select::send(int s, bco::Buffer buff, std::function<void(int)> cb)
+int Select::send(int s, bco::Buffer buff, IoCompletion* completion)
 {
     if (io_executor_->is_current_executor()) {
-        return send_sync(s, buff, cb);
+        return send_sync(s, buff, completion);
     } else {
-        return send_async(s, buff, cb);
+        return send_async(s, buff, completion);
     }
 }
 
-int Select::send_sync(int s, bco::Buffer buff, std::function<void(int)> cb)
+int Select::send_sync(int s, bco::Buffer buff, IoCompletion* completion)
 {
     int bytes = syscall_sendv(s, buff);
-    if (bytes >= 0)
-        return bytes;
-    else if (last_error() == EAGAIN || last_error() == EWOULDBLOCK)
-        return send_async(s, buff, cb);
-    else
+    if (bytes >= 0) {
+        complete(SelectTask { s, Action::Send, buff, completion }, bytes);
+        return 0;
+    } else if (last_error() == EAGAIN || last_error() == EWOULDBLOCK) {
+        return send_async(s, buff, completion);
+    } else {
         return -last_error();
+    }
 }
 
-int Select::send_async(int s, bco::Buffer buff, std::function<void(int)> cb)
+int Select::send_async(int s, bco::Buffer buff, IoCompletion* completion)
 {
     {
         std::lock_guard lock { mtx_ };
         if (s > max_wfd_)
             max_wfd_ = s;
-        pending_wfds_[s] = SelectTask { s, Action::Send, buff, cb };
+        pending_wfds_[s] = SelectTask { s, Action::Send, buff, completion };
+        number(pending_wfds_[s]);
     }
     io_executor_->wake();
     return 0;
@@ -155,16 +181,21 @@ int Select::sendto(int s, bco::Buffer buff, const sockaddr_storage& addr, void*
 }
 
 //for tcp
-int Select::connect(int s, const sockaddr_storage& addr, std::function<void(int)> cb)
+int Select::connect(int s, const sockaddr_storage& addr, IoCompletion* completion)
 {
     int error = ::connect(s, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
-    if (error == -1)
+#ifdef _WIN32
+    if (error == -1 && last_error() != WSAEWOULDBLOCK)
+#else
+    if (error == -1 && last_error() != EINPROGRESS)
+#endif // _WIN32
         return -last_error();
     {
         std::lock_guard lock { mtx_ };
         if (s > max_wfd_)
             max_wfd_ = s;
-        pending_wfds_[s] = SelectTask { s, Action::Connect, bco::Buffer {}, cb };
+        pending_wfds_[s] = SelectTask { s, Action::Connect, bco::Buffer {}, completion };
+        number(pending_wfds_[s]);
     }
     io_executor_->wake();
     return 0;
@@ -180,18 +211,30 @@ int Select::connect(int s, const sockaddr_storage& addr)
         return 0;
 }
 
-int Select::accept(int s, std::function<void(int, const sockaddr_storage&)> cb)
+int Select::accept(int s, IoCompletion* completion)
 {
+    if (draining_)
+        return -ECANCELED;
     {
         std::lock_guard lock { mtx_ };
         if (s > max_rfd_)
             max_rfd_ = s;
-        pending_rfds_[s] = SelectTask { s, Action::Accept, bco::Buffer {}, cb };
+        pending_rfds_[s] = SelectTask { s, Action::Accept, bco::Buffer {}, completion };
+        number(pending_rfds_[s]);
     }
     io_executor_->wake();
     return 0;
 }
 
+void Select::cancel(int s, IoCompletion* completion)
+{
+    {
+        std::lock_guard lock { mtx_ };
+        cancel_requests_.push_back({ s, completion, completion->operation() });
+    }
+    wake();
+}
+
 void Select::on_io_event(const std::map<int, SelectTask>& tasks, const fd_set& fds)
 {
     for (auto& task : tasks) {
@@ -239,6 +282,12 @@ void Select::do_io()
 {
     assert(io_executor_->is_current_executor());
 
+    if (cancelled_) {
+        cancel_pending(false);
+    } else if (draining_) {
+        cancel_pending(true);
+    }
+    cancel_requested();
     auto [reading_fds, writing_fds] = get_pending_io();
     fd_set rfds, wfds;
     FD_ZERO(&rfds);
@@ -281,7 +330,7 @@ void Select::do_accept(const SelectTask& task)
         std::lock_guard lock { mtx_ };
         pending_rfds_.erase(task.fd);
         const int fd_or_errcode = fd != INVALID_SOCKET ? static_cast<int>(fd) : -last_error();
-        completed_task_.push_back(PriorityTask { Priority::Medium, std::bind(task.cb2, fd_or_errcode, addr) });
+        complete(task, fd_or_errcode, addr);
         return;
     }
 #else
@@ -290,7 +339,7 @@ void Select::do_accept(const SelectTask& task)
         std::lock_guard lock { mtx_ };
         pending_rfds_.erase(task.fd);
         const int fd_or_errcode = fd >= 0 ? fd : -last_error();
-        completed_task_.push_back(PriorityTask { Priority::Medium, std::bind(task.cb2, fd_or_errcode, addr) });
+        complete(task, fd_or_errcode, addr);
         return;
     }
 #endif // _WIN32
@@ -304,7 +353,7 @@ void Select::do_recv(const SelectTask& task)
         std::lock_guard lock { mtx_ };
         pending_rfds_.erase(task.fd);
         const int bytes_or_errcode = bytes >= 0 ? bytes : -last_error();
-        completed_task_.push_back(PriorityTask { Priority::Medium, std::bind(task.cb, bytes_or_errcode) });
+        complete(task, bytes_or_errcode);
         return;
     }
     //do nothing, it will try again
@@ -318,7 +367,7 @@ void Select::do_recvfrom(const SelectTask& task)
         std::lock_guard lock { mtx_ };
         pending_rfds_.erase(task.fd);
         const int bytes_or_errcode = bytes >= 0 ? bytes : -last_error();
-        completed_task_.push_back(PriorityTask { Priority::Medium, std::bind(task.cb2, bytes_or_errcode, addr) });
+        complete(task, bytes_or_errcode, addr);
         return;
     }
 }
@@ -330,7 +379,7 @@ void Select::do_send(const SelectTask& task)
         std::lock_guard lock { mtx_ };
         pending_wfds_.erase(task.fd);
         const int bytes_or_errcode = bytes >= 0 ? bytes : -last_error();
-        completed_task_.push_back(PriorityTask { Priority::Medium, std::bind(task.cb, bytes_or_errcode) });
+        complete(task, bytes_or_errcode);
         return;
     }
     //do nothing, it will try again
@@ -340,13 +389,71 @@ void Select::on_connected(const SelectTask& task)
 {
     std::lock_guard lock { mtx_ };
     pending_wfds_.erase(task.fd);
-    completed_task_.push_back(PriorityTask { Priority::Medium, std::bind(task.cb, task.fd) });
+    complete(task, task.fd);
+}
+
+void Select::cancel_pending(bool accepts_only)
+{
+    std::lock_guard lock { mtx_ };
+    for (auto it = pending_rfds_.begin(); it != pending_rfds_.end();) {
+        auto& task = it->second;
+        if (task.fd == stop_event_.fd() || task.fd == wakeup_event_.fd() || (accepts_only && task.action != Action::Accept)) {
+            ++it;
+            continue;
+        }
+        complete(task, -ECANCELED);
+        it = pending_rfds_.erase(it);
+    }
+    if (accepts_only) {
+        return;
+    }
+    for (auto& [_, task] : pending_wfds_) {
+        complete(task, -ECANCELED);
+    }
+    pending_wfds_.clear();
 }
 
-std::vector<PriorityTask> Select::harvest()
+//on the io thread, the operations being tried are not completed a second time
+void Select::cancel_requested()
 {
     std::lock_guard lock { mtx_ };
-    return std::move(completed_task_);
+    for (auto [fd, completion, operation] : cancel_requests_) {
+        for (auto* tasks : { &pending_rfds_, &pending_wfds_ }) {
+            auto it = tasks->find(fd);
+            if (it != tasks->end() && it->second.completion == completion && it->second.operation == operation) {
+                complete(it->second, -ECANCELED);
+                tasks->erase(it);
+            }
+        }
+    }
+    cancel_requests_.clear();
+}
+
+void Select::number(SelectTask& task)
+{
+    task.operation = ++operations_;
+    task.completion->set_operation(task.operation);
+}
+
+void Select::complete(const SelectTask& task, int result)
+{
+    task.completion->set_result(result);
+    completed_++;
+    completions_.push(task.completion);
+}
+
+void Select::complete(const SelectTask& task, int result, const sockaddr_storage& addr)
+{
+    task.completion->set_result(result, addr);
+    completed_++;
+    completions_.push(task.completion);
+}
+
+CompletionList Select::harvest()
+{
+    auto completions = completions_.take_all();
+    completed_ -= completions.size();
+    return completions;
 }
 
 void Select::wake()
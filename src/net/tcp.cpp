@@ -4,6 +4,7 @@
 #include <bco/net/proactor/iocp.h>
 #else
 #include <bco/net/proactor/epoll.h>
+#include <bco/net/proactor/iouring.h>
 #endif // _WIN32
 #include "../common.h"
 
@@ -16,6 +17,7 @@ template class TcpSocket<Select>;
 template class TcpSocket<IOCP>;
 #else
 template class TcpSocket<Epoll>;
+template class TcpSocket<IOUring>;
 #endif // _WIN32
 
 template <SocketProactor P>
@@ -37,71 +39,96 @@ TcpSocket<P>::TcpSocket(P* proactor, int family, int fd)
 }
 
 template <SocketProactor P>
-Task<int> TcpSocket<P>::recv(bco::Buffer buffer)
+TcpSocket<P>::RecvAwaiter::RecvAwaiter(P* proactor, int fd, bco::Buffer buffer, CancellationToken token)
+    : IoAwaiter<RecvAwaiter>({ "TcpSocket::recv fd=%lld", fd }, token)
+    , proactor_(proactor)
+    , fd_(fd)
+    , buffer_(buffer)
 {
-    Task<int> task;
-    int ret = proactor_->recv(socket_, buffer, [task](int bytes_or_errcode) mutable {
-        if (task.await_ready())
-            return;
-        task.set_result(bytes_or_errcode);
-        task.resume();
-    });
-    if (ret < 0) {
-        task.set_result(ret);
-    }
-    return task;
 }
 
 template <SocketProactor P>
-Task<int> TcpSocket<P>::send(bco::Buffer buffer)
+int TcpSocket<P>::RecvAwaiter::submit()
 {
-    Task<int> task;
-    int ret = proactor_->send(socket_, buffer, [task](int bytes_or_errcode) mutable {
-        if (task.await_ready())
-            return;
-        task.set_result(bytes_or_errcode);
-        task.resume();
-    });
-    if (ret < 0) {
-        task.set_result(ret);
-    }
-    return task;
+    return proactor_->recv(fd_, buffer_, this);
 }
 
 template <SocketProactor P>
-Task<std::tuple<TcpSocket<P>, Address>> TcpSocket<P>::accept()
+TcpSocket<P>::SendAwaiter::SendAwaiter(P* proactor, int fd, bco::Buffer buffer, CancellationToken token)
+    : IoAwaiter<SendAwaiter>({ "TcpSocket::send fd=%lld", fd }, token)
+    , proactor_(proactor)
+    , fd_(fd)
+    , buffer_(buffer)
 {
-    Task<std::tuple<TcpSocket<P>, Address>> task;
-    auto proactor = proactor_;
-    int ret = proactor_->accept(socket_, [task, proactor](int fd_or_errcode, const ::sockaddr_storage& address) mutable {
-        if (task.await_ready())
-            return;
-        TcpSocket s { proactor, address.ss_family, fd_or_errcode };
-        task.set_result(std::make_tuple(s, Address::from_storage(address)));
-        task.resume();
-    });
-    if (ret < 0) {
-        TcpSocket s{};
-        task.set_result(std::make_tuple(s, Address {}));
-    }
-    return task;
 }
 
 template <SocketProactor P>
-Task<int> TcpSocket<P>::connect(const Address& addr)
+int TcpSocket<P>::SendAwaiter::submit()
 {
-    Task<int> task;
-    sockaddr_storage storage {};
-    int ret = proactor_->connect(socket_, addr.to_storage(storage), [task](int fd) mutable {
-        //TODO: error handling
-        (void)fd;
-        task.set_result(0);
-        task.resume();
-    });
-    if (ret < 0) {
-        task.set_result(ret);
+    return proactor_->send(fd_, buffer_, this);
+}
+
+template <SocketProactor P>
+TcpSocket<P>::AcceptAwaiter::AcceptAwaiter(P* proactor, int family, int fd, CancellationToken token)
+    : IoAwaiter<AcceptAwaiter>({ "TcpSocket::accept fd=%lld", fd }, token)
+    , proactor_(proactor)
+    , family_(family)
+    , fd_(fd)
+{
+}
+
+template <SocketProactor P>
+int TcpSocket<P>::AcceptAwaiter::submit()
+{
+    return proactor_->accept(fd_, this);
+}
+
+template <SocketProactor P>
+std::tuple<TcpSocket<P>, Address> TcpSocket<P>::AcceptAwaiter::await_resume() const
+{
+    if (this->result() < 0) {
+        return { TcpSocket { proactor_, family_, this->result() }, Address {} };
     }
-    return task;
+    return { TcpSocket { proactor_, this->address().ss_family, this->result() }, Address::from_storage(this->address()) };
+}
+
+template <SocketProactor P>
+TcpSocket<P>::ConnectAwaiter::ConnectAwaiter(P* proactor, int fd, const Address& addr, CancellationToken token)
+    : IoAwaiter<ConnectAwaiter>({ "TcpSocket::connect fd=%lld", fd }, token)
+    , proactor_(proactor)
+    , fd_(fd)
+{
+    addr.to_storage(addr_);
+}
+
+template <SocketProactor P>
+int TcpSocket<P>::ConnectAwaiter::submit()
+{
+    return proactor_->connect(fd_, addr_, this);
+}
+
+template <SocketProactor P>
+typename TcpSocket<P>::RecvAwaiter TcpSocket<P>::recv(bco::Buffer buffer, CancellationToken token)
+{
+    return RecvAwaiter { proactor_, socket_, buffer, token };
+}
+
+template <SocketProactor P>
+typename TcpSocket<P>::SendAwaiter TcpSocket<P>::send(bco::Buffer buffer, CancellationToken token)
+{
+    return SendAwaiter { proactor_, socket_, buffer, token };
+}
+
+template <SocketProactor P>
+typename TcpSocket<P>::AcceptAwaiter TcpSocket<P>::accept(CancellationToken token)
+{
+    return AcceptAwaiter { proactor_, family_, socket_, token };
+}
+
+template <SocketProactor P>
+typename TcpSocket<P>::ConnectAwaiter TcpSocket<P>::connect(const Address& addr, CancellationToken token)
+{
+    return ConnectAwaiter { proactor_, socket_, addr, token };
 }
 
 template <SocketProactor P>
@@ -4,6 +4,7 @@
 #include <bco/net/proactor/iocp.h>
 #else
 #include <bco/net/proactor/epoll.h>
+#include <bco/net/proactor/iouring.h>
 #endif // _WIN32
 #include "../common.h"
 
@@ -17,6 +18,7 @@ template class UdpSocket<Select>;
 template class UdpSocket<IOCP>;
 #else
 template class UdpSocket<Epoll>;
+template class UdpSocket<IOUring>;
 #endif // _WIN32
 
 template <SocketProactor P>
@@ -55,63 +57,61 @@ UdpSocket<P>::UdpSocket(P* proactor, int family, int fd)
 }
 
 template <SocketProactor P>
-Task<int> UdpSocket<P>::recv(bco::Buffer buffer)
+UdpSocket<P>::RecvAwaiter::RecvAwaiter(P* proactor, int fd, bco::Buffer buffer, CancellationToken token)
+    : IoAwaiter<RecvAwaiter>({ "UdpSocket::recv fd=%lld", fd }, token)
+    , proactor_(proactor)
+    , fd_(fd)
+    , buffer_(buffer)
 {
-    Task<int> task;
-    int error = proactor_->recv(socket_, buffer, [task](int length) mutable {
-        if (task.await_ready())
-            return;
-        task.set_result(std::forward<int>(length));
-        task.resume();
-    });
-    if (error < 0) {
-        task.set_result(std::forward<int>(error));
-    }
-    return task;
 }
 
-//FIXME: support select
 template <SocketProactor P>
-Task<std::tuple<int, Address>> UdpSocket<P>::recvfrom(bco::Buffer buffer)
+int UdpSocket<P>::RecvAwaiter::submit()
 {
-    if constexpr (std::is_same<P, Select>::value) {
-        return recvfrom_win(buffer);
-    } else {
-        return recvfrom_normal(buffer);
-    }
+    return proactor_->recv(fd_, buffer_, this);
 }
 
+template <SocketProactor P>
+UdpSocket<P>::RecvfromAwaiter::RecvfromAwaiter(P* proactor, int fd, bco::Buffer buffer, void* optdata, CancellationToken token)
+    : IoAwaiter<RecvfromAwaiter>({ "UdpSocket::recvfrom fd=%lld", fd }, token)
+    , proactor_(proactor)
+    , fd_(fd)
+    , buffer_(buffer)
+    , optdata_(optdata)
+{
+}
+
+template <SocketProactor P>
+int UdpSocket<P>::RecvfromAwaiter::submit()
+{
+    return proactor_->recvfrom(fd_, buffer_, this, optdata_);
+}
 
 template <SocketProactor P>
-Task<std::tuple<int, Address>> UdpSocket<P>::recvfrom_normal(bco::Buffer buffer)
+std::tuple<int, Address> UdpSocket<P>::RecvfromAwaiter::await_resume() const
 {
-    Task<std::tuple<int, Address>> task;
-    auto error = proactor_->recvfrom(socket_, buffer, [task](int length, const sockaddr_storage& remote_addr) mutable {
-        if (task.await_ready())
-            return;
-        task.set_result(std::make_tuple(length, Address::from_storage(remote_addr)));
-        task.resume();
-    });
-    if (error < 0) {
-        task.set_result(std::make_tuple(error, Address {}));
+    if (this->result() < 0) {
+        return { this->result(), Address {} };
     }
-    return task;
+    return { this->result(), Address::from_storage(this->address()) };
 }
 
 template <SocketProactor P>
-Task<std::tuple<int, Address>> UdpSocket<P>::recvfrom_win(bco::Buffer buffer)
+typename UdpSocket<P>::RecvAwaiter UdpSocket<P>::recv(bco::Buffer buffer, CancellationToken token)
 {
-    Task<std::tuple<int, Address>> task;
-    auto error = proactor_->recvfrom(socket_, buffer, [task](int length, const sockaddr_storage& remote_addr) mutable {
-        if (task.await_ready())
-            return;
-        task.set_result(std::make_tuple(length, Address::from_storage(remote_addr)));
-        task.resume();
-    }, UdpSocket<P>::get_recvmsg_func());
-    if (error < 0) {
-        task.set_result(std::make_tuple(error, Address {}));
+    return RecvAwaiter { proactor_, socket_, buffer, token };
+}
+
+//Select on Windows receives through the WSARecvMsg of the socket
+template <SocketProactor P>
+typename UdpSocket<P>::RecvfromAwaiter UdpSocket<P>::recvfrom(bco::Buffer buffer, CancellationToken token)
+{
+#ifdef _WIN32
+    if constexpr (std::is_same<P, Select>::value) {
+        return RecvfromAwaiter { proactor_, socket_, buffer, UdpSocket<P>::get_recvmsg_func(), token };
     }
-    return task;
+#endif // _WIN32
+    return RecvfromAwaiter { proactor_, socket_, buffer, nullptr, token };
 }
 
 template <SocketProactor P>
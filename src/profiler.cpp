@@ -0,0 +1,317 @@
+#ifdef __linux__
+#include <pthread.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+#include <bco/coroutine/frame.h>
+#include <bco/profiler.h>
+
+#include "symbolizer.h"
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+namespace bco {
+
+namespace {
+
+constexpr size_t kMaxDepth = 32;
+constexpr size_t kRingSize = 512;
+
+struct Sample {
+    uint32_t depth;
+    void* frames[kMaxDepth];
+};
+
+//one per attached thread, the SIGPROF handler on that thread produces and the collector consumes
+struct ThreadSlot {
+    pid_t tid {};
+    clockid_t clock {};
+    timer_t timer {};
+    bool armed { false };
+    //allocated on the first start, before the timer can fire
+    std::unique_ptr<Sample[]> ring;
+    std::atomic<size_t> head { 0 };
+    std::atomic<size_t> tail { 0 };
+    std::atomic<uint64_t> dropped { 0 };
+};
+
+std::mutex registry_mtx;
+std::vector<ThreadSlot*> registry;
+Profiler* active = nullptr;
+std::chrono::microseconds active_interval {};
+bool handler_installed = false;
+
+std::atomic<bool> sampling { false };
+std::atomic<bool> sample_executor { false };
+thread_local std::atomic<ThreadSlot*> current_slot { nullptr };
+
+void record(ThreadSlot& slot)
+{
+    auto* frame = detail::get_current_frame();
+    if (frame == nullptr && !sample_executor.load(std::memory_order::relaxed)) {
+        return;
+    }
+    const size_t tail = slot.tail.load(std::memory_order::relaxed);
+    if (tail - slot.head.load(std::memory_order::acquire) >= kRingSize) {
+        slot.dropped.fetch_add(1, std::memory_order::relaxed);
+        return;
+    }
+    Sample& sample = slot.ring[tail % kRingSize];
+    uint32_t depth = 0;
+    for (; frame != nullptr && depth < kMaxDepth; frame = frame->parent) {
+        //GCC and Clang put the resume function pointer first in the coroutine frame
+        sample.frames[depth++] = frame->address != nullptr ? *static_cast<void**>(frame->address) : nullptr;
+    }
+    sample.depth = depth;
+    slot.tail.store(tail + 1, std::memory_order::release);
+}
+
+void on_sigprof(int, siginfo_t*, void*)
+{
+    const int saved_errno = errno;
+    ThreadSlot* slot = current_slot.load(std::memory_order::relaxed);
+    if (slot != nullptr && sampling.load(std::memory_order::relaxed)) {
+        record(*slot);
+    }
+    errno = saved_errno;
+}
+
+//registry_mtx held
+bool arm(ThreadSlot& slot)
+{
+    if (slot.armed) {
+        return true;
+    }
+    if (slot.ring == nullptr) {
+        slot.ring = std::make_unique<Sample[]>(kRingSize);
+    }
+    sigevent event {};
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGPROF;
+    event.sigev_notify_thread_id = slot.tid;
+    if (::timer_create(slot.clock, &event, &slot.timer) < 0) {
+        return false;
+    }
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(active_interval).count();
+    itimerspec spec {};
+    spec.it_interval.tv_sec = ns / 1000000000;
+    spec.it_interval.tv_nsec = ns % 1000000000;
+    spec.it_value = spec.it_interval;
+    if (::timer_settime(slot.timer, 0, &spec, nullptr) < 0) {
+        ::timer_delete(slot.timer);
+        return false;
+    }
+    slot.armed = true;
+    return true;
+}
+
+//registry_mtx held
+void disarm(ThreadSlot& slot)
+{
+    if (slot.armed) {
+        ::timer_delete(slot.timer);
+        slot.armed = false;
+    }
+}
+
+//detaches the thread when it exits
+class Attachment {
+public:
+    ~Attachment()
+    {
+        if (slot == nullptr) {
+            return;
+        }
+        current_slot.store(nullptr, std::memory_order::relaxed);
+        std::atomic_signal_fence(std::memory_order::seq_cst);
+        std::lock_guard lock { registry_mtx };
+        disarm(*slot);
+        std::erase(registry, slot.get());
+    }
+
+    std::unique_ptr<ThreadSlot> slot;
+};
+
+thread_local Attachment attachment;
+
+} // namespace
+
+Profiler::Profiler(const Options& options)
+    : options_ { std::max(options.interval, std::chrono::microseconds { 1 }), options.include_executor }
+{
+}
+
+Profiler::~Profiler()
+{
+    stop();
+}
+
+void Profiler::start()
+{
+    {
+        std::lock_guard lock { registry_mtx };
+        if (active != nullptr) {
+            throw std::runtime_error { "another Profiler is running" };
+        }
+        //stays installed after stop(), a SIGPROF still pending then must not kill the process
+        if (!handler_installed) {
+            struct sigaction action {};
+            action.sa_sigaction = on_sigprof;
+            action.sa_flags = SA_SIGINFO | SA_RESTART;
+            ::sigemptyset(&action.sa_mask);
+            if (::sigaction(SIGPROF, &action, nullptr) < 0) {
+                throw std::runtime_error { "install SIGPROF handler failed" };
+            }
+            handler_installed = true;
+        }
+        active = this;
+        active_interval = options_.interval;
+        sample_executor = options_.include_executor;
+        sampling = true;
+        for (auto* slot : registry) {
+            if (!arm(*slot)) {
+                sampling = false;
+                active = nullptr;
+                std::ranges::for_each(registry, [](ThreadSlot* s) { disarm(*s); });
+                throw std::runtime_error { "create profiling timer failed" };
+            }
+        }
+    }
+    running_ = true;
+    collector_ = std::thread { &Profiler::collect_loop, this };
+}
+
+void Profiler::stop()
+{
+    {
+        std::lock_guard lock { registry_mtx };
+        if (active != this) {
+            return;
+        }
+        std::ranges::for_each(registry, [](ThreadSlot* slot) { disarm(*slot); });
+        sampling = false;
+        active = nullptr;
+    }
+    {
+        std::lock_guard lock { collector_mtx_ };
+        running_ = false;
+    }
+    collector_cv_.notify_all();
+    collector_.join();
+    collect();
+}
+
+void Profiler::collect_loop()
+{
+    std::unique_lock lock { collector_mtx_ };
+    while (running_) {
+        collector_cv_.wait_for(lock, std::chrono::milliseconds { 50 }, [this]() { return !running_; });
+        lock.unlock();
+        collect();
+        lock.lock();
+    }
+}
+
+void Profiler::collect()
+{
+    std::vector<std::vector<void*>> batch;
+    {
+        std::lock_guard lock { registry_mtx };
+        for (auto* slot : registry) {
+            if (slot->ring == nullptr) {
+                continue;
+            }
+            size_t head = slot->head.load(std::memory_order::relaxed);
+            const size_t tail = slot->tail.load(std::memory_order::acquire);
+            for (; head != tail; head++) {
+                const Sample& sample = slot->ring[head % kRingSize];
+                batch.emplace_back(sample.frames, sample.frames + sample.depth);
+            }
+            slot->head.store(head, std::memory_order::release);
+            dropped_.fetch_add(slot->dropped.exchange(0, std::memory_order::relaxed), std::memory_order::relaxed);
+        }
+    }
+    std::lock_guard lock { stacks_mtx_ };
+    for (auto& stack : batch) {
+        stacks_[std::move(stack)]++;
+    }
+    samples_.fetch_add(batch.size(), std::memory_order::relaxed);
+}
+
+void Profiler::write_collapsed(std::ostream& out)
+{
+    if (running_) {
+        collect();
+    }
+    std::map<std::vector<void*>, uint64_t> stacks;
+    {
+        std::lock_guard lock { stacks_mtx_ };
+        stacks = stacks_;
+    }
+    //different resume functions of one coroutine fold into the same name
+    detail::Symbolizer symbolizer;
+    std::map<std::string, uint64_t> lines;
+    for (auto& [frames, count] : stacks) {
+        std::string line;
+        for (auto it = frames.rbegin(); it != frames.rend(); it++) {
+            if (!line.empty()) {
+                line += ';';
+            }
+            std::string name = symbolizer.name(*it);
+            std::ranges::replace(name, ';', ':');
+            line += name;
+        }
+        lines[line.empty() ? "[executor]" : line] += count;
+    }
+    for (auto& [line, count] : lines) {
+        out << line << ' ' << count << '\n';
+    }
+}
+
+std::string Profiler::collapsed()
+{
+    std::ostringstream out;
+    write_collapsed(out);
+    return out.str();
+}
+
+void Profiler::clear()
+{
+    std::lock_guard lock { stacks_mtx_ };
+    stacks_.clear();
+    samples_ = 0;
+    dropped_ = 0;
+}
+
+void Profiler::attach_current_thread()
+{
+    if (attachment.slot != nullptr) {
+        return;
+    }
+    auto slot = std::make_unique<ThreadSlot>();
+    slot->tid = static_cast<pid_t>(::syscall(SYS_gettid));
+    if (::pthread_getcpuclockid(::pthread_self(), &slot->clock) != 0) {
+        return;
+    }
+    std::lock_guard lock { registry_mtx };
+    registry.push_back(slot.get());
+    if (active != nullptr) {
+        arm(*slot);
+    }
+    current_slot.store(slot.get(), std::memory_order::relaxed);
+    attachment.slot = std::move(slot);
+}
+
+} // namespace bco
+
+#endif // ifdef __linux__
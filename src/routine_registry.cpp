@@ -0,0 +1,73 @@
+#include <algorithm>
+#include <bit>
+
+#include <bco/routine_registry.h>
+
+namespace bco {
+
+namespace detail {
+
+namespace {
+
+std::atomic<size_t> next_thread_slot { 0 };
+thread_local const size_t thread_slot = next_thread_slot.fetch_add(1, std::memory_order::relaxed);
+
+} // namespace
+
+RoutineRegistry::RoutineRegistry(size_t shards)
+    : mask_(std::bit_ceil(std::max(shards, size_t { 1 })) - 1)
+    , shards_(new Shard[mask_ + 1])
+{
+}
+
+void RoutineRegistry::add(RoutineNode& node)
+{
+    node.shard = thread_slot & mask_;
+    //a clock read per spawn is only paid for while someone looks at the result
+    if (routine_accounting_enabled()) {
+        node.start_time = std::chrono::steady_clock::now();
+    }
+    auto& shard = shards_[node.shard];
+    std::lock_guard lock { shard.mtx };
+    node.prev = nullptr;
+    node.next = shard.head;
+    if (shard.head != nullptr) {
+        shard.head->prev = &node;
+    }
+    shard.head = &node;
+    node.linked = true;
+    shard.size.store(shard.size.load(std::memory_order::relaxed) + 1, std::memory_order::relaxed);
+}
+
+void RoutineRegistry::remove(RoutineNode& node)
+{
+    auto& shard = shards_[node.shard];
+    std::lock_guard lock { shard.mtx };
+    if (!node.linked) {
+        return;
+    }
+    if (node.prev != nullptr) {
+        node.prev->next = node.next;
+    } else {
+        shard.head = node.next;
+    }
+    if (node.next != nullptr) {
+        node.next->prev = node.prev;
+    }
+    node.prev = node.next = nullptr;
+    node.linked = false;
+    shard.size.store(shard.size.load(std::memory_order::relaxed) - 1, std::memory_order::relaxed);
+}
+
+size_t RoutineRegistry::size() const
+{
+    size_t size = 0;
+    for (size_t i = 0; i <= mask_; i++) {
+        size += shards_[i].size.load(std::memory_order::relaxed);
+    }
+    return size;
+}
+
+} // namespace detail
+
+} // namespace bco
@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <thread>
+
+#include <bco/exception.h>
+#include <bco/executor/multithread_executor.h>
+#include <bco/executor/simple_executor.h>
+#include <bco/runtime.h>
+
+namespace bco {
+
+namespace {
+
+#ifdef __linux__
+std::unique_ptr<net::IOUring> make_io_uring(const Runtime::Probe& probe, std::optional<std::chrono::milliseconds> sq_poll, std::optional<uint32_t> queue_depth)
+{
+    net::IOUring::Params params { .sq_poll = std::nullopt, .queue_depth = queue_depth };
+    if (sq_poll.has_value() && probe.io_uring.sq_poll) {
+        params.sq_poll = net::IOUring::SQPoll { *sq_poll };
+    }
+    return std::make_unique<net::IOUring>(params);
+}
+#endif // __linux__
+
+} // namespace
+
+const char* to_string(Runtime::Backend backend)
+{
+    switch (backend) {
+    case Runtime::Backend::IOUring:
+        return "io_uring";
+    case Runtime::Backend::Epoll:
+        return "epoll";
+    case Runtime::Backend::Select:
+        return "select";
+    case Runtime::Backend::IOCP:
+        return "iocp";
+    default:
+        return "unknown";
+    }
+}
+
+Runtime::Builder& Runtime::Builder::threads(size_t threads)
+{
+    threads_ = threads;
+    return *this;
+}
+
+Runtime::Builder& Runtime::Builder::backend(Backend backend)
+{
+    backend_ = backend;
+    return *this;
+}
+
+Runtime::Builder& Runtime::Builder::sq_poll(std::chrono::milliseconds idle_time)
+{
+    sq_poll_ = idle_time;
+    return *this;
+}
+
+Runtime::Builder& Runtime::Builder::queue_depth(uint32_t depth)
+{
+    queue_depth_ = depth;
+    return *this;
+}
+
+Runtime::Probe Runtime::probe_system()
+{
+    Probe probe;
+    probe.cpus = std::max(std::thread::hardware_concurrency(), 1u);
+#ifdef __linux__
+    probe.io_uring = net::IOUring::probe();
+#endif
+    return probe;
+}
+
+Runtime Runtime::Builder::build()
+{
+    Runtime runtime;
+    runtime.probe_ = probe_system();
+    runtime.threads_ = threads_ != 0 ? threads_ : runtime.probe_.cpus;
+    std::unique_ptr<ExecutorInterface> executor;
+    if (runtime.threads_ == 1) {
+        executor = std::make_unique<SimpleExecutor>();
+    } else {
+        executor = std::make_unique<MultithreadExecutor>(static_cast<uint32_t>(runtime.threads_));
+    }
+    runtime.ctx_ = std::make_shared<Context>(std::move(executor));
+    auto& ctx = *runtime.ctx_;
+
+    if (backend_.has_value()) {
+        runtime.backend_ = *backend_;
+        switch (*backend_) {
+#ifdef _WIN32
+        case Backend::IOCP:
+            ctx.add_proactor(std::make_unique<net::IOCP>());
+            return runtime;
+#else
+        case Backend::IOUring:
+            ctx.add_proactor(make_io_uring(runtime.probe_, sq_poll_, queue_depth_));
+            runtime.sq_poll_ = sq_poll_.has_value() && runtime.probe_.io_uring.sq_poll;
+            return runtime;
+        case Backend::Epoll:
+            ctx.add_proactor(std::make_unique<net::Epoll>());
+            return runtime;
+#endif // _WIN32
+        case Backend::Select:
+            ctx.add_proactor(std::make_unique<net::Select>());
+            return runtime;
+        default:
+            throw NetworkException { std::string { to_string(*backend_) } + " is not available on this platform" };
+        }
+    }
+
+#ifdef _WIN32
+    runtime.backend_ = Backend::IOCP;
+    ctx.add_proactor(std::make_unique<net::IOCP>());
+#else
+    const auto& io_uring = runtime.probe_.io_uring;
+    if (!io_uring.available) {
+        runtime.fallback_reason_ = "io_uring: not available";
+    } else if (!io_uring.opcodes) {
+        runtime.fallback_reason_ = "io_uring: required opcodes missing";
+    } else {
+        try {
+            ctx.add_proactor(make_io_uring(runtime.probe_, sq_poll_, queue_depth_));
+            runtime.backend_ = Backend::IOUring;
+            runtime.sq_poll_ = sq_poll_.has_value() && io_uring.sq_poll;
+            return runtime;
+        } catch (const NetworkException& e) {
+            runtime.fallback_reason_ = std::string { "io_uring: " } + e.what();
+        }
+    }
+    runtime.backend_ = Backend::Epoll;
+    ctx.add_proactor(std::make_unique<net::Epoll>());
+#endif // _WIN32
+    return runtime;
+}
+
+void Runtime::start()
+{
+    ctx_->start();
+    visit_proactor([this](auto* proactor) {
+        if constexpr (requires { proactor->start(ctx_->executor()); }) {
+            proactor->start(ctx_->executor());
+        } else {
+            proactor->start();
+        }
+    });
+}
+
+std::string Runtime::describe() const
+{
+    std::string description = to_string(backend_);
+    if (sq_poll_) {
+        description += " with sqpoll";
+    }
+    if (!fallback_reason_.empty()) {
+        description += " (" + fallback_reason_ + ")";
+    }
+    if (threads_ == 1) {
+        description += ", simple executor";
+    } else {
+        description += ", multithread executor with " + std::to_string(threads_) + " threads";
+    }
+    return description;
+}
+
+} // namespace bco
@@ -0,0 +1,201 @@
+#ifdef __linux__
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // __linux__
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include "symbolizer.h"
+
+namespace bco {
+
+namespace detail {
+
+#ifdef __linux__
+//Function symbols of one loaded ELF module, read from the file because dladdr() only knows the
+//exported ones and the resume functions of coroutines are local symbols.
+class ModuleSymbols {
+public:
+    explicit ModuleSymbols(const char* path)
+    {
+        int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st {};
+        void* image = ::fstat(fd, &st) == 0 ? ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (image == MAP_FAILED) {
+            return;
+        }
+        load(static_cast<const char*>(image), static_cast<size_t>(st.st_size));
+        ::munmap(image, st.st_size);
+    }
+
+    //'address' relative to the load base for position independent modules
+    const char* find(uintptr_t address) const
+    {
+        auto it = std::ranges::upper_bound(symbols_, address, {}, &Symbol::begin);
+        if (it == symbols_.begin() || address >= std::prev(it)->end) {
+            return nullptr;
+        }
+        return std::prev(it)->name.c_str();
+    }
+    bool relative() const { return relative_; }
+
+private:
+    struct Symbol {
+        uintptr_t begin;
+        uintptr_t end;
+        std::string name;
+    };
+
+    void load(const char* image, size_t size)
+    {
+        const auto* header = reinterpret_cast<const ElfW(Ehdr)*>(image);
+        if (size < sizeof(*header) || std::memcmp(header->e_ident, ELFMAG, SELFMAG) != 0
+            || header->e_shoff + header->e_shnum * sizeof(ElfW(Shdr)) > size) {
+            return;
+        }
+        relative_ = header->e_type == ET_DYN;
+        const auto* sections = reinterpret_cast<const ElfW(Shdr)*>(image + header->e_shoff);
+        for (size_t i = 0; i < header->e_shnum; i++) {
+            const auto& section = sections[i];
+            if ((section.sh_type != SHT_SYMTAB && section.sh_type != SHT_DYNSYM) || section.sh_link >= header->e_shnum) {
+                continue;
+            }
+            const auto& strings = sections[section.sh_link];
+            if (section.sh_offset + section.sh_size > size || strings.sh_offset + strings.sh_size > size) {
+                continue;
+            }
+            const auto* symbols = reinterpret_cast<const ElfW(Sym)*>(image + section.sh_offset);
+            for (size_t j = 0; j < section.sh_size / sizeof(ElfW(Sym)); j++) {
+                const auto& symbol = symbols[j];
+                if (ELF64_ST_TYPE(symbol.st_info) != STT_FUNC || symbol.st_value == 0 || symbol.st_name >= strings.sh_size) {
+                    continue;
+                }
+                uintptr_t end = symbol.st_value + std::max<uintptr_t>(symbol.st_size, 1);
+                symbols_.push_back({ symbol.st_value, end, image + strings.sh_offset + symbol.st_name });
+            }
+        }
+        std::ranges::sort(symbols_, {}, &Symbol::begin);
+    }
+
+private:
+    std::vector<Symbol> symbols_;
+    bool relative_ { false };
+};
+
+#else
+class ModuleSymbols { };
+#endif // __linux__
+
+Symbolizer::Symbolizer() = default;
+
+Symbolizer::~Symbolizer() = default;
+
+const std::string& Symbolizer::name(void* address)
+{
+    auto [it, inserted] = names_.try_emplace(address);
+    if (inserted) {
+        it->second = lookup(address);
+    }
+    return it->second;
+}
+
+#ifdef __linux__
+std::string Symbolizer::lookup(void* address)
+{
+    if (address == nullptr) {
+        return "[unknown]";
+    }
+    Dl_info info {};
+    const char* symbol = nullptr;
+    if (::dladdr(address, &info) != 0 && info.dli_fname != nullptr) {
+        auto& module = modules_[info.dli_fname];
+        if (module == nullptr) {
+            module = std::make_unique<ModuleSymbols>(info.dli_fname);
+        }
+        auto base = module->relative() ? reinterpret_cast<uintptr_t>(info.dli_fbase) : 0;
+        symbol = module->find(reinterpret_cast<uintptr_t>(address) - base);
+        if (symbol == nullptr) {
+            symbol = info.dli_sname;
+        }
+    }
+    if (symbol == nullptr) {
+        char buff[32];
+        std::snprintf(buff, sizeof(buff), "[%p]", address);
+        return buff;
+    }
+    int status = 0;
+    std::unique_ptr<char, decltype(&std::free)> demangled { abi::__cxa_demangle(symbol, nullptr, nullptr, &status), &std::free };
+    std::string name = status == 0 ? demangled.get() : symbol;
+    //drop the "[clone .actor]" (GCC) and "(.resume)" (Clang) suffix of the resume function
+    for (const char* suffix : { " [clone .", " (.", ".actor", ".resume" }) {
+        if (auto pos = name.rfind(suffix); pos != std::string::npos && pos != 0) {
+            name.erase(pos);
+            break;
+        }
+    }
+    //GCC names the resume function f(f(args)::<mangled>.Frame*), keep f(args)
+    if (auto frame = name.find("::_Z"); frame != std::string::npos && name.ends_with(".Frame*)")) {
+        auto open = name.find('(');
+        name = name.substr(open + 1, frame - open - 1);
+    }
+    return name;
+}
+
+#else
+std::string Symbolizer::lookup(void* address)
+{
+    if (address == nullptr) {
+        return "[unknown]";
+    }
+    char buff[32];
+    std::snprintf(buff, sizeof(buff), "[%p]", address);
+    return buff;
+}
+#endif // __linux__
+
+std::string awaiter_name(const char* signature)
+{
+    std::string_view name { signature };
+#ifdef _MSC_VER
+    //const char *__cdecl bco::detail::awaiter_signature<class bco::Task<int>>(void)
+    auto begin = name.find("awaiter_signature<");
+    auto end = name.rfind(">(");
+    if (begin != std::string_view::npos && end != std::string_view::npos && end > begin) {
+        begin += std::strlen("awaiter_signature<");
+        name = name.substr(begin, end - begin);
+        for (std::string_view prefix : { "class ", "struct " }) {
+            if (name.starts_with(prefix)) {
+                name.remove_prefix(prefix.size());
+            }
+        }
+    }
+#else
+    //const char* bco::detail::awaiter_signature() [with Awaiter = bco::Task<int>] (GCC)
+    //const char *bco::detail::awaiter_signature() [Awaiter = bco::Task<int>] (Clang)
+    auto begin = name.find("Awaiter = ");
+    auto end = name.rfind(']');
+    if (begin != std::string_view::npos && end != std::string_view::npos && end > begin) {
+        begin += std::strlen("Awaiter = ");
+        name = name.substr(begin, end - begin);
+    }
+#endif
+    return std::string { name };
+}
+
+} // namespace detail
+
+} // namespace bco
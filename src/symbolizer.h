@@ -0,0 +1,37 @@
+#pragma once
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace bco {
+
+namespace detail {
+
+class ModuleSymbols;
+
+//Names code addresses after the functions they are in, the resume function of a coroutine after
+//the coroutine. Lookups are cached, use one per report.
+class Symbolizer {
+public:
+    Symbolizer();
+    ~Symbolizer();
+    Symbolizer(const Symbolizer&) = delete;
+    Symbolizer& operator=(const Symbolizer&) = delete;
+
+    const std::string& name(void* address);
+
+private:
+    std::string lookup(void* address);
+
+private:
+    std::unordered_map<void*, std::string> names_;
+    std::map<std::string, std::unique_ptr<ModuleSymbols>> modules_;
+};
+
+//type of the awaiter out of the signature of awaiter_signature<Awaiter>()
+std::string awaiter_name(const char* signature);
+
+} // namespace detail
+
+} // namespace bco
@@ -5,6 +5,8 @@
 namespace bco {
 
 thread_local std::weak_ptr<Context> current_thread_ctx;
+thread_local const ExecutorInterface* current_worker_executor = nullptr;
+thread_local size_t current_worker_index = kAnyWorker;
 
 std::weak_ptr<Context> get_current_context()
 {
@@ -25,5 +27,18 @@ ExecutorInterface* get_current_executor()
     return ctx->executor();
 }
 
-} // namespace bco
+void set_current_worker_index(const ExecutorInterface* executor, size_t index)
+{
+    current_worker_executor = executor;
+    current_worker_index = index;
+}
+
+size_t get_current_worker_index(const ExecutorInterface* executor)
+{
+    if (executor == nullptr || executor != current_worker_executor) {
+        return kAnyWorker;
+    }
+    return current_worker_index;
+}
 
+} // namespace bco
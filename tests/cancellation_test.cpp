@@ -0,0 +1,167 @@
+#include <atomic>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <doctest.h>
+
+#include <bco/cancellation.h>
+#include <bco/coroutine/cofunc.h>
+#include <bco/coroutine/when.h>
+#include <bco/net/tcp.h>
+#include <bco/runtime.h>
+
+#include "test_utils.h"
+
+namespace {
+
+using namespace bco::test;
+
+struct Outcome {
+    std::atomic<int> result { 0 };
+    std::atomic<int> errors { 0 };
+    std::chrono::milliseconds took { 0 };
+};
+
+bco::Routine sleep_cancellable(bco::CancellationToken token, Outcome* out)
+{
+    const auto start = std::chrono::steady_clock::now();
+    co_await bco::with_cancellation(token, bco::sleep_for(5s));
+    out->took = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    out->result = 1;
+}
+
+template <typename P>
+bco::Routine recv_cancellable(P* proactor, int fd, bco::CancellationToken token, Outcome* out)
+{
+    bco::net::TcpSocket<P> socket { proactor, AF_UNIX, fd };
+    out->result = co_await socket.recv(bco::Buffer { 64 }, token);
+}
+
+template <typename P>
+bco::Func<int> recv_byte(bco::net::TcpSocket<P>& socket)
+{
+    co_return co_await socket.recv(bco::Buffer { 1 });
+}
+
+//Races a recv which gets its data about when it is cancelled, then at once submits another one.
+//Both are awaited in a recv_byte() frame, which the frame pool mostly hands out at the same
+//address. The cancel request of the first must not hit the second.
+template <typename P>
+bco::Routine cancel_then_recv(P* proactor, int fd, int peer, int rounds, Outcome* out)
+{
+    bco::net::TcpSocket<P> socket { proactor, AF_UNIX, fd };
+    const char byte = 'x';
+    for (int i = 0; i < rounds; i++) {
+        if (::write(peer, &byte, 1) != 1) {
+            out->errors++;
+        }
+        //the recv may have taken the byte even if it lost
+        int lost = 0;
+        auto raced = co_await bco::when_any(bco::on_loser([&lost](int result) { lost = result; }), recv_byte(socket), bco::sleep_for(1ms));
+        if ((raced.index() == 0 || lost == 1) && ::write(peer, &byte, 1) != 1) {
+            out->errors++;
+        }
+        if (co_await recv_byte(socket) != 1) {
+            out->errors++;
+        }
+    }
+    out->result = 1;
+}
+
+//a connected pair of non-blocking stream sockets
+std::pair<int, int> socket_pair()
+{
+    int fds[2] = { -1, -1 };
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    for (int fd : fds) {
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+    return { fds[0], fds[1] };
+}
+
+template <typename Test>
+void for_each_backend(Test test)
+{
+    for (auto backend : { bco::Runtime::Backend::IOUring, bco::Runtime::Backend::Epoll, bco::Runtime::Backend::Select }) {
+        INFO(bco::to_string(backend));
+        std::optional<bco::Runtime> runtime;
+        try {
+            runtime.emplace(bco::Runtime::Builder {}.threads(2).backend(backend).build());
+        } catch (const std::exception&) {
+            MESSAGE("backend not available: ", bco::to_string(backend));
+            continue;
+        }
+        runtime->start();
+        test(*runtime);
+        runtime->context()->shutdown(1s);
+    }
+}
+
+} // namespace
+
+TEST_CASE("with_cancellation ends a sleep cancelled from another thread")
+{
+    auto ctx = make_context(2);
+    bco::CancellationSource source;
+    Outcome outcome;
+    ctx->spawn(&sleep_cancellable, source.token(), &outcome);
+
+    std::this_thread::sleep_for(20ms);
+    CHECK(outcome.result == 0);
+    source.cancel();
+    REQUIRE(finished(*ctx));
+    CHECK(outcome.result == 1);
+    CHECK(outcome.took < 1s);
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("with_cancellation of a cancelled token does not wait")
+{
+    auto ctx = make_context();
+    bco::CancellationSource source;
+    source.cancel();
+    Outcome outcome;
+    ctx->spawn(&sleep_cancellable, source.token(), &outcome);
+
+    REQUIRE(finished(*ctx));
+    CHECK(outcome.took < 1s);
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("a recv cancelled mid-await fails with -ECANCELED")
+{
+    for_each_backend([](bco::Runtime& runtime) {
+        auto [fd, peer] = socket_pair();
+        bco::CancellationSource source;
+        Outcome outcome;
+        runtime.visit_proactor([&](auto* proactor) {
+            runtime.context()->spawn(&recv_cancellable<std::remove_pointer_t<decltype(proactor)>>, proactor, fd, source.token(), &outcome);
+        });
+
+        std::this_thread::sleep_for(20ms);
+        CHECK(outcome.result == 0);
+        source.cancel();
+        REQUIRE(finished(*runtime.context()));
+        CHECK(outcome.result == -ECANCELED);
+        ::close(fd);
+        ::close(peer);
+    });
+}
+
+TEST_CASE("a cancel request does not hit the next operation on the socket")
+{
+    for_each_backend([](bco::Runtime& runtime) {
+        auto [fd, peer] = socket_pair();
+        Outcome outcome;
+        runtime.visit_proactor([&](auto* proactor) {
+            runtime.context()->spawn(&cancel_then_recv<std::remove_pointer_t<decltype(proactor)>>, proactor, fd, peer, 2000, &outcome);
+        });
+
+        REQUIRE(finished(*runtime.context(), 30s));
+        CHECK(outcome.result == 1);
+        CHECK(outcome.errors == 0);
+        ::close(fd);
+        ::close(peer);
+    });
+}
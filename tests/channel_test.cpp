@@ -0,0 +1,221 @@
+#include <atomic>
+#include <stdexcept>
+
+#include <doctest.h>
+
+#include <bco/coroutine/channel.h>
+#include <bco/coroutine/cofunc.h>
+#include <bco/coroutine/when.h>
+
+#include "test_utils.h"
+
+namespace {
+
+using namespace bco::test;
+
+bco::Routine send_all(bco::BoundedChannel<int>* channel, int from, int count, std::atomic<int>* sent)
+{
+    for (int i = from; i < from + count; i++) {
+        co_await channel->send(i);
+        sent->fetch_add(1);
+    }
+}
+
+bco::Routine recv_all(bco::BoundedChannel<int>* channel, int count, std::atomic<long>* sum)
+{
+    for (int i = 0; i < count; i++) {
+        sum->fetch_add(*co_await channel->recv());
+    }
+}
+
+struct Raced {
+    std::atomic<bool> done { false };
+    size_t index { 0 };
+    bool sent { false };
+    std::chrono::milliseconds took { 0 };
+};
+
+bco::Routine recv_or_timeout(bco::BoundedChannel<int>* channel, Raced* out)
+{
+    const auto start = std::chrono::steady_clock::now();
+    auto result = co_await bco::when_any(channel->recv(), bco::sleep_for(20ms));
+    out->took = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    out->index = result.index();
+    out->done = true;
+}
+
+bco::Routine send_or_timeout(bco::BoundedChannel<int>* channel, int value, Raced* out)
+{
+    const auto start = std::chrono::steady_clock::now();
+    auto result = co_await bco::when_any(channel->send(value), bco::sleep_for(20ms));
+    out->took = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    out->index = result.index();
+    out->sent = result.index() == 0 && std::get<0>(result);
+    out->done = true;
+}
+
+//receives with a short timeout each time, a value the losing recv took goes to the disposer
+bco::Routine recv_racing(bco::BoundedChannel<int>* channel, int count, std::atomic<long>* sum)
+{
+    std::atomic<int> received { 0 };
+    auto keep = bco::on_loser([&](std::optional<int>&& value) {
+        if (value) {
+            *sum += *value;
+            received++;
+        }
+    });
+    while (received < count) {
+        auto result = co_await bco::when_any(keep, channel->recv(), bco::sleep_for(1ms));
+        if (result.index() == 0) {
+            *sum += *std::get<0>(result);
+            received++;
+        }
+    }
+}
+
+} // namespace
+
+TEST_CASE("BoundedChannel rounds its capacity up to a power of two")
+{
+    CHECK(bco::BoundedChannel<int> { 2 }.capacity() == 2);
+    CHECK(bco::BoundedChannel<int> { 3 }.capacity() == 4);
+    CHECK(bco::BoundedChannel<int> { 1000 }.capacity() == 1024);
+    CHECK_THROWS_AS(bco::BoundedChannel<int> { 1 }, std::logic_error);
+    CHECK_THROWS_AS(bco::BoundedChannel<int> { 0 }, std::logic_error);
+}
+
+TEST_CASE("BoundedChannel try_send and try_recv stop at full and empty")
+{
+    bco::BoundedChannel<int> channel { 4 };
+    CHECK(!channel.try_recv().has_value());
+    for (int i = 0; i < 4; i++) {
+        int value = i;
+        CHECK(channel.try_send(value));
+    }
+    int value = 4;
+    CHECK(!channel.try_send(value));
+    CHECK(value == 4);
+    CHECK(channel.size() == 4);
+    for (int i = 0; i < 4; i++) {
+        CHECK(channel.try_recv() == i);
+    }
+    CHECK(!channel.try_recv().has_value());
+}
+
+TEST_CASE("BoundedChannel send suspends while full")
+{
+    auto ctx = make_context();
+    bco::BoundedChannel<int> channel { 2 };
+    std::atomic<int> sent { 0 };
+    ctx->spawn(&send_all, &channel, 0, 3, &sent);
+
+    REQUIRE(eventually([&]() { return sent == 2; }));
+    std::this_thread::sleep_for(20ms);
+    CHECK(sent == 2);
+    CHECK(channel.try_recv() == 0);
+    CHECK(finished(*ctx));
+    CHECK(sent == 3);
+    CHECK(channel.try_recv() == 1);
+    CHECK(channel.try_recv() == 2);
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("BoundedChannel recv suspends while empty")
+{
+    auto ctx = make_context();
+    bco::BoundedChannel<int> channel { 2 };
+    std::atomic<long> sum { 0 };
+    ctx->spawn(&recv_all, &channel, 1, &sum);
+
+    std::this_thread::sleep_for(20ms);
+    CHECK(ctx->routines_size() == 1);
+    int value = 42;
+    CHECK(channel.try_send(value));
+    CHECK(finished(*ctx));
+    CHECK(sum == 42);
+    CHECK(channel.size() == 0);
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("BoundedChannel delivers every value across threads")
+{
+    constexpr int kProducers = 4;
+    constexpr int kConsumers = 3;
+    constexpr int kPerProducer = 20000;
+    constexpr int kAll = kProducers * kPerProducer;
+
+    auto ctx = make_context(4);
+    bco::BoundedChannel<int> channel { 16 };
+    std::atomic<int> sent { 0 };
+    std::atomic<long> sum { 0 };
+    for (int c = 0; c < kConsumers; c++) {
+        const int count = kAll / kConsumers + (c < kAll % kConsumers ? 1 : 0);
+        ctx->spawn(&recv_all, &channel, count, &sum);
+    }
+    for (int p = 0; p < kProducers; p++) {
+        ctx->spawn(&send_all, &channel, p * kPerProducer, kPerProducer, &sent);
+    }
+
+    REQUIRE(finished(*ctx, 30s));
+    CHECK(sent == kAll);
+    CHECK(sum == long { kAll } * (kAll - 1) / 2);
+    CHECK(channel.size() == 0);
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("BoundedChannel recv loses to a timeout in when_any")
+{
+    auto ctx = make_context(2);
+    bco::BoundedChannel<int> channel { 2 };
+    Raced raced;
+    ctx->spawn(&recv_or_timeout, &channel, &raced);
+
+    REQUIRE(finished(*ctx));
+    REQUIRE(raced.done);
+    CHECK(raced.index == 1);
+    CHECK(raced.took < 1s);
+    //the cancelled recv is gone, a later value stays in the channel
+    int value = 7;
+    CHECK(channel.try_send(value));
+    CHECK(channel.try_recv() == 7);
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("BoundedChannel send loses to a timeout in when_any")
+{
+    auto ctx = make_context(2);
+    bco::BoundedChannel<int> channel { 2 };
+    for (int i = 0; i < 2; i++) {
+        int value = i;
+        REQUIRE(channel.try_send(value));
+    }
+    Raced raced;
+    ctx->spawn(&send_or_timeout, &channel, 9, &raced);
+
+    REQUIRE(finished(*ctx));
+    REQUIRE(raced.done);
+    CHECK(raced.index == 1);
+    CHECK(!raced.sent);
+    CHECK(raced.took < 1s);
+    CHECK(channel.try_recv() == 0);
+    CHECK(channel.try_recv() == 1);
+    CHECK(!channel.try_recv().has_value());
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("BoundedChannel loses no value to cancelled receivers")
+{
+    constexpr int kCount = 5000;
+
+    auto ctx = make_context(4);
+    bco::BoundedChannel<int> channel { 4 };
+    std::atomic<int> sent { 0 };
+    std::atomic<long> sum { 0 };
+    ctx->spawn(&recv_racing, &channel, kCount, &sum);
+    ctx->spawn(&send_all, &channel, 0, kCount, &sent);
+
+    REQUIRE(finished(*ctx, 30s));
+    CHECK(sent == kCount);
+    CHECK(sum == long { kCount } * (kCount - 1) / 2);
+    ctx->shutdown(1s);
+}
@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <doctest.h>
+
+#include <bco/coroutine/frame_pool.h>
+#include <bco/coroutine/task.h>
+
+#include "test_utils.h"
+
+#if BCO_FRAME_POOL
+
+namespace {
+
+using namespace bco::test;
+
+//a size class no coroutine of the tests allocates from
+constexpr size_t kFrameSize = 3000;
+
+bco::Routine empty_routine()
+{
+    co_return;
+}
+
+} // namespace
+
+TEST_CASE("frame pool reuses a freed frame on the same thread")
+{
+    const auto before = bco::frame_pool_stats();
+    void* frame = bco::detail::allocate_frame(kFrameSize);
+    bco::detail::deallocate_frame(frame);
+    void* again = bco::detail::allocate_frame(kFrameSize);
+    const auto after = bco::frame_pool_stats();
+    bco::detail::deallocate_frame(again);
+
+    CHECK(again == frame);
+    CHECK(after.allocations - before.allocations == 2);
+    CHECK(after.hits - before.hits >= 1);
+}
+
+TEST_CASE("frame pool serves frames above 4KiB from the heap")
+{
+    const auto before = bco::frame_pool_stats();
+    void* frame = bco::detail::allocate_frame(64 * 1024);
+    bco::detail::deallocate_frame(frame);
+    const auto after = bco::frame_pool_stats();
+
+    CHECK(after.large - before.large == 1);
+    CHECK(after.hits == before.hits);
+}
+
+TEST_CASE("frame pool hands frames freed on another thread back to their owner")
+{
+    constexpr size_t kFrames = 64;
+
+    std::vector<void*> frames;
+    for (size_t i = 0; i < kFrames; i++) {
+        frames.push_back(bco::detail::allocate_frame(kFrameSize));
+    }
+    const auto before = bco::frame_pool_stats();
+    //frees them in batches, the last one goes back when the thread exits
+    std::thread { [&frames]() {
+        for (void* frame : frames) {
+            bco::detail::deallocate_frame(frame);
+        }
+    } }.join();
+    const auto freed = bco::frame_pool_stats();
+
+    std::vector<void*> reused;
+    for (size_t i = 0; i < kFrames; i++) {
+        reused.push_back(bco::detail::allocate_frame(kFrameSize));
+    }
+    const auto after = bco::frame_pool_stats();
+    for (void* frame : reused) {
+        bco::detail::deallocate_frame(frame);
+    }
+
+    CHECK(freed.remote_frees - before.remote_frees == kFrames);
+    CHECK(after.hits - freed.hits == kFrames);
+    std::ranges::sort(frames);
+    std::ranges::sort(reused);
+    CHECK(reused == frames);
+}
+
+TEST_CASE("frame pool survives frames passed between threads which exit")
+{
+    constexpr size_t kThreads = 4;
+    constexpr size_t kRounds = 200;
+    constexpr size_t kFrames = 50;
+
+    //each thread allocates a batch and frees the batch its neighbour left in its slot
+    std::vector<std::atomic<std::vector<void*>*>> slots(kThreads);
+    for (auto& slot : slots) {
+        slot = nullptr;
+    }
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < kThreads; t++) {
+        threads.emplace_back([&slots, t]() {
+            for (size_t round = 0; round < kRounds; round++) {
+                auto* batch = new std::vector<void*>;
+                for (size_t i = 0; i < kFrames; i++) {
+                    batch->push_back(bco::detail::allocate_frame(64 + (i * 97) % 4000));
+                }
+                if (auto* left = slots[(t + 1) % kThreads].exchange(batch)) {
+                    for (void* frame : *left) {
+                        bco::detail::deallocate_frame(frame);
+                    }
+                    delete left;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    //the owners exited, their caches are adopted or the frames go back to the heap
+    for (auto& slot : slots) {
+        if (auto* left = slot.exchange(nullptr)) {
+            for (void* frame : *left) {
+                bco::detail::deallocate_frame(frame);
+            }
+            delete left;
+        }
+    }
+    CHECK(bco::frame_pool_stats().remote_frees > 0);
+}
+
+TEST_CASE("frame pool takes back the frames of routines finishing on other workers")
+{
+    auto ctx = make_context(4);
+    const auto before = bco::frame_pool_stats();
+    for (int i = 0; i < 10000; i++) {
+        ctx->spawn(&empty_routine);
+    }
+    REQUIRE(finished(*ctx, 30s));
+    ctx->shutdown(1s);
+    const auto after = bco::frame_pool_stats();
+
+    CHECK(after.allocations - before.allocations >= 10000);
+    CHECK(after.remote_frees > before.remote_frees);
+}
+
+#endif // BCO_FRAME_POOL
@@ -0,0 +1,83 @@
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+
+#include <doctest.h>
+
+#include <bco/coroutine/cofunc.h>
+
+#include "test_utils.h"
+
+namespace {
+
+using namespace bco::test;
+
+struct Caught {
+    std::atomic<bool> done { false };
+    int value { 0 };
+    int errors { 0 };
+};
+
+bco::Func<std::unique_ptr<int>> boxed(int value)
+{
+    co_await bco::switch_to(bco::get_current_executor());
+    co_return std::make_unique<int>(value);
+}
+
+bco::Func<int> fail_with_value(int value)
+{
+    co_await bco::switch_to(bco::get_current_executor());
+    if (value != 0) {
+        throw std::runtime_error("value");
+    }
+    co_return value;
+}
+
+bco::Func<> fail_without_value()
+{
+    co_await bco::switch_to(bco::get_current_executor());
+    throw std::runtime_error("void");
+}
+
+//a Func rethrowing what it awaited
+bco::Func<int> pass_on(int value)
+{
+    co_return co_await fail_with_value(value) + 1;
+}
+
+bco::Routine await_all(Caught* out)
+{
+    out->value = *co_await boxed(40);
+    try {
+        co_await fail_with_value(1);
+    } catch (const std::runtime_error&) {
+        out->errors++;
+    }
+    try {
+        co_await fail_without_value();
+    } catch (const std::runtime_error&) {
+        out->errors++;
+    }
+    try {
+        co_await pass_on(1);
+    } catch (const std::runtime_error&) {
+        out->errors++;
+    }
+    out->value += co_await pass_on(0) + 1;
+    out->done = true;
+}
+
+} // namespace
+
+TEST_CASE("Func returns move-only values and rethrows exceptions to the awaiting coroutine")
+{
+    auto ctx = make_context(2);
+    Caught caught;
+    ctx->spawn(&await_all, &caught);
+
+    REQUIRE(finished(*ctx));
+    REQUIRE(caught.done);
+    CHECK(caught.value == 42);
+    CHECK(caught.errors == 3);
+    ctx->shutdown(1s);
+}
@@ -0,0 +1,187 @@
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <doctest.h>
+
+#include <bco/coroutine/cofunc.h>
+#include <bco/coroutine/generator.h>
+
+#include "test_utils.h"
+
+namespace {
+
+using namespace bco::test;
+
+struct Consumed {
+    std::atomic<bool> done { false };
+    std::vector<int> values;
+    int errors { 0 };
+    bool ended { false };
+};
+
+bco::Generator<int> count_to(int count)
+{
+    for (int i = 0; i < count; i++) {
+        co_yield i;
+    }
+}
+
+bco::Generator<std::unique_ptr<int>> boxes(int count)
+{
+    for (int i = 0; i < count; i++) {
+        co_yield std::make_unique<int>(i);
+    }
+}
+
+bco::Func<int> twice(int value)
+{
+    co_await bco::switch_to(bco::get_current_executor());
+    co_return value * 2;
+}
+
+//suspends on the executor between the values
+bco::Generator<int> awaiting(int count)
+{
+    for (int i = 0; i < count; i++) {
+        co_await bco::sleep_for(1ms);
+        co_yield co_await twice(i);
+    }
+}
+
+bco::Generator<int> failing()
+{
+    co_yield 1;
+    throw std::runtime_error("generator");
+}
+
+//tells when its frame is destroyed
+struct Tracker {
+    std::atomic<int>* destroyed;
+    ~Tracker() { (*destroyed)++; }
+};
+
+bco::Generator<int> tracked(std::atomic<int>* destroyed)
+{
+    Tracker tracker { destroyed };
+    for (int i = 0;; i++) {
+        co_yield i;
+    }
+}
+
+bco::Routine consume(bco::Generator<int> generator, Consumed* out)
+{
+    while (auto* value = co_await generator.next()) {
+        out->values.push_back(*value);
+    }
+    //stays done
+    out->ended = co_await generator.next() == nullptr;
+    out->done = true;
+}
+
+bco::Routine consume_boxes(int count, Consumed* out)
+{
+    auto generator = boxes(count);
+    while (auto* box = co_await generator.next()) {
+        std::unique_ptr<int> taken = std::move(*box);
+        out->values.push_back(*taken);
+    }
+    out->done = true;
+}
+
+bco::Routine consume_failing(Consumed* out)
+{
+    auto generator = failing();
+    try {
+        while (auto* value = co_await generator.next()) {
+            out->values.push_back(*value);
+        }
+    } catch (const std::runtime_error&) {
+        out->errors++;
+    }
+    out->ended = co_await generator.next() == nullptr;
+    out->done = true;
+}
+
+bco::Routine take_and_drop(std::atomic<int>* destroyed, Consumed* out)
+{
+    {
+        auto generator = tracked(destroyed);
+        for (int i = 0; i < 3; i++) {
+            out->values.push_back(*co_await generator.next());
+        }
+    }
+    out->done = true;
+}
+
+} // namespace
+
+TEST_CASE("Generator yields its values in order, then nothing")
+{
+    auto ctx = make_context();
+    Consumed consumed;
+    ctx->spawn(&consume, count_to(5), &consumed);
+
+    REQUIRE(finished(*ctx));
+    REQUIRE(consumed.done);
+    CHECK(consumed.values == std::vector<int> { 0, 1, 2, 3, 4 });
+    CHECK(consumed.ended);
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("Generator of a move-only type")
+{
+    auto ctx = make_context();
+    Consumed consumed;
+    ctx->spawn(&consume_boxes, 3, &consumed);
+
+    REQUIRE(finished(*ctx));
+    REQUIRE(consumed.done);
+    CHECK(consumed.values == std::vector<int> { 0, 1, 2 });
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("Generator body awaits between its values")
+{
+    auto ctx = make_context(2);
+    Consumed consumed;
+    ctx->spawn(&consume, awaiting(20), &consumed);
+
+    REQUIRE(finished(*ctx));
+    REQUIRE(consumed.done);
+    REQUIRE(consumed.values.size() == 20);
+    for (int i = 0; i < 20; i++) {
+        CHECK(consumed.values[i] == i * 2);
+    }
+    CHECK(consumed.ended);
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("Generator next rethrows the exception of its body")
+{
+    auto ctx = make_context();
+    Consumed consumed;
+    ctx->spawn(&consume_failing, &consumed);
+
+    REQUIRE(finished(*ctx));
+    REQUIRE(consumed.done);
+    CHECK(consumed.values == std::vector<int> { 1 });
+    CHECK(consumed.errors == 1);
+    CHECK(consumed.ended);
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("Generator dropped at a co_yield destroys its frame")
+{
+    auto ctx = make_context();
+    std::atomic<int> destroyed { 0 };
+    Consumed consumed;
+    ctx->spawn(&take_and_drop, &destroyed, &consumed);
+
+    REQUIRE(finished(*ctx));
+    REQUIRE(consumed.done);
+    CHECK(consumed.values == std::vector<int> { 0, 1, 2 });
+    CHECK(destroyed == 1);
+    ctx->shutdown(1s);
+}
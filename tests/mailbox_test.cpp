@@ -0,0 +1,160 @@
+#include <atomic>
+#include <vector>
+
+#include <doctest.h>
+
+#include <bco/coroutine/mailbox.h>
+
+#include "test_utils.h"
+
+namespace {
+
+using namespace bco::test;
+
+bco::Routine send_all(bco::Mailbox<int>* mailbox, int count, std::atomic<int>* sent)
+{
+    for (int i = 0; i < count; i++) {
+        co_await mailbox->send(i);
+        sent->fetch_add(1);
+    }
+}
+
+//counts the values which did not come in the order they were sent
+bco::Routine recv_all(bco::Mailbox<int>* mailbox, int count, std::atomic<int>* received, std::atomic<int>* errors)
+{
+    int expected = 0;
+    while (expected < count) {
+        for (int value : co_await mailbox->recv(16)) {
+            if (value != expected) {
+                errors->fetch_add(1);
+            }
+            expected++;
+        }
+        received->store(expected);
+    }
+}
+
+bco::Routine grid_send(bco::MailboxGrid<int>* grid, size_t from, int count)
+{
+    for (int i = 0; i < count; i++) {
+        for (size_t to = 0; to < grid->size(); to++) {
+            if (to != from) {
+                co_await grid->send(from, to, static_cast<int>(from) * count + i);
+            }
+        }
+    }
+}
+
+//checks that the values of each sender come in order
+bco::Routine grid_recv(bco::MailboxGrid<int>* grid, size_t to, int count, std::atomic<int>* errors)
+{
+    std::vector<int> next(grid->size(), 0);
+    int left = static_cast<int>(grid->size() - 1) * count;
+    while (left > 0) {
+        for (int value : co_await grid->recv(to)) {
+            const size_t from = static_cast<size_t>(value / count);
+            if (from == to || value % count != next[from]) {
+                errors->fetch_add(1);
+            }
+            next[from] = value % count + 1;
+            left--;
+        }
+    }
+}
+
+} // namespace
+
+TEST_CASE("Mailbox try_send and try_recv stop at full and empty")
+{
+    bco::Mailbox<int> mailbox { 4 };
+    std::vector<int> out;
+    CHECK(mailbox.try_recv(out) == 0);
+    for (int i = 0; i < 4; i++) {
+        int value = i;
+        CHECK(mailbox.try_send(value));
+    }
+    int value = 4;
+    CHECK(!mailbox.try_send(value));
+    CHECK(mailbox.size() == 4);
+    CHECK(mailbox.try_recv(out, 3) == 3);
+    CHECK(mailbox.try_recv(out) == 1);
+    CHECK(out == std::vector<int> { 0, 1, 2, 3 });
+}
+
+TEST_CASE("Mailbox send suspends while full and recv while empty")
+{
+    auto ctx = make_context();
+    bco::Mailbox<int> mailbox { 2 };
+    std::atomic<int> sent { 0 };
+    ctx->spawn(&send_all, &mailbox, 3, &sent);
+
+    REQUIRE(eventually([&]() { return sent == 2; }));
+    std::this_thread::sleep_for(10ms);
+    CHECK(sent == 2);
+    std::vector<int> out;
+    CHECK(mailbox.try_recv(out, 1) == 1);
+    REQUIRE(finished(*ctx));
+    CHECK(sent == 3);
+
+    while (mailbox.try_recv(out) > 0) { }
+    CHECK(out == std::vector<int> { 0, 1, 2 });
+
+    bco::Mailbox<int> empty { 2 };
+    std::atomic<int> received { 0 };
+    std::atomic<int> errors { 0 };
+    ctx->spawn(&recv_all, &empty, 1, &received, &errors);
+    std::this_thread::sleep_for(10ms);
+    CHECK(received == 0);
+    int value = 0;
+    CHECK(empty.try_send(value));
+    REQUIRE(finished(*ctx));
+    CHECK(received == 1);
+    CHECK(errors == 0);
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("Mailbox keeps order between two contexts")
+{
+    constexpr int kCount = 100000;
+
+    auto sender = make_context();
+    auto receiver = make_context();
+    bco::Mailbox<int> mailbox { 64 };
+    std::atomic<int> sent { 0 };
+    std::atomic<int> received { 0 };
+    std::atomic<int> errors { 0 };
+    receiver->spawn(&recv_all, &mailbox, kCount, &received, &errors);
+    sender->spawn(&send_all, &mailbox, kCount, &sent);
+
+    REQUIRE(finished(*sender, 30s));
+    REQUIRE(finished(*receiver, 30s));
+    CHECK(sent == kCount);
+    CHECK(received == kCount);
+    CHECK(errors == 0);
+    CHECK(mailbox.size() == 0);
+    sender->shutdown(1s);
+    receiver->shutdown(1s);
+}
+
+TEST_CASE("MailboxGrid delivers between every pair of contexts")
+{
+    constexpr size_t kContexts = 3;
+    constexpr int kCount = 20000;
+
+    bco::MailboxGrid<int> grid { kContexts, 16 };
+    std::vector<std::shared_ptr<bco::Context>> contexts;
+    std::atomic<int> errors { 0 };
+    for (size_t i = 0; i < kContexts; i++) {
+        contexts.push_back(make_context());
+        contexts[i]->spawn(&grid_recv, &grid, i, kCount, &errors);
+        contexts[i]->spawn(&grid_send, &grid, i, kCount);
+    }
+
+    for (auto& ctx : contexts) {
+        REQUIRE(finished(*ctx, 30s));
+    }
+    CHECK(errors == 0);
+    for (auto& ctx : contexts) {
+        ctx->shutdown(1s);
+    }
+}
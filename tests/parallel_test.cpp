@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <doctest.h>
+
+#include <bco/coroutine/parallel.h>
+
+#include "test_utils.h"
+
+namespace {
+
+using namespace bco::test;
+
+struct Visits {
+    std::atomic<bool> done { false };
+    std::vector<std::atomic<int>> counts;
+    long sum { 0 };
+    std::string joined;
+};
+
+bco::Routine visit_all(std::vector<int>* values, size_t grain, Visits* out)
+{
+    co_await bco::parallel_for(*values, grain, [out](int value) { out->counts[value]++; });
+    out->sum = co_await bco::parallel_reduce(*values, grain, 0L);
+    out->done = true;
+}
+
+//concatenation is associative but not commutative, the chunks have to be joined in order
+bco::Routine join_strings(std::vector<std::string>* words, size_t grain, Visits* out)
+{
+    out->joined = co_await bco::parallel_reduce(*words, grain, std::string { ">" });
+    out->done = true;
+}
+
+bco::Routine sort_values(std::vector<int>* values, size_t grain, Visits* out)
+{
+    co_await bco::parallel_sort(*values, grain);
+    out->done = true;
+}
+
+std::vector<int> numbers(int count)
+{
+    std::vector<int> values(count);
+    std::iota(values.begin(), values.end(), 0);
+    return values;
+}
+
+} // namespace
+
+TEST_CASE("parallel_for and parallel_reduce over an empty range")
+{
+    auto ctx = make_context(2);
+    std::vector<int> values;
+    Visits visits;
+    visits.sum = -1;
+    ctx->spawn(&visit_all, &values, 16, &visits);
+
+    REQUIRE(finished(*ctx));
+    REQUIRE(visits.done);
+    CHECK(visits.sum == 0);
+
+    std::vector<std::string> words;
+    Visits joined;
+    ctx->spawn(&join_strings, &words, 16, &joined);
+    REQUIRE(finished(*ctx));
+    REQUIRE(joined.done);
+    CHECK(joined.joined == ">");
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("parallel_for and parallel_reduce with a grain larger than the range")
+{
+    constexpr int kCount = 10;
+
+    auto ctx = make_context(2);
+    auto values = numbers(kCount);
+    Visits visits;
+    visits.counts = std::vector<std::atomic<int>>(kCount);
+    ctx->spawn(&visit_all, &values, 100, &visits);
+
+    REQUIRE(finished(*ctx));
+    REQUIRE(visits.done);
+    for (auto& count : visits.counts) {
+        CHECK(count == 1);
+    }
+    CHECK(visits.sum == kCount * (kCount - 1) / 2);
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("parallel_reduce visits every element once and joins in order")
+{
+    constexpr int kCount = 100000;
+
+    auto ctx = make_context(4);
+    auto values = numbers(kCount);
+    Visits visits;
+    visits.counts = std::vector<std::atomic<int>>(kCount);
+    ctx->spawn(&visit_all, &values, 7, &visits);
+
+    REQUIRE(finished(*ctx, 30s));
+    REQUIRE(visits.done);
+    CHECK(std::ranges::all_of(visits.counts, [](auto& count) { return count == 1; }));
+    CHECK(visits.sum == long { kCount } * (kCount - 1) / 2);
+
+    std::vector<std::string> words;
+    std::string expected = ">";
+    for (int i = 0; i < 1000; i++) {
+        words.push_back(std::to_string(i) + ",");
+        expected += words.back();
+    }
+    Visits joined;
+    ctx->spawn(&join_strings, &words, 3, &joined);
+    REQUIRE(finished(*ctx));
+    REQUIRE(joined.done);
+    CHECK(joined.joined == expected);
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("parallel_sort sorts ranges which are not a multiple of the grain")
+{
+    auto ctx = make_context(4);
+    std::mt19937 random { 42 };
+    for (int count : { 0, 1, 999, 100003 }) {
+        INFO(count);
+        std::vector<int> values(count);
+        for (auto& value : values) {
+            value = static_cast<int>(random() % 1000);
+        }
+        auto expected = values;
+        std::ranges::sort(expected);
+        Visits visits;
+        ctx->spawn(&sort_values, &values, 1000, &visits);
+
+        REQUIRE(finished(*ctx, 30s));
+        REQUIRE(visits.done);
+        CHECK(values == expected);
+    }
+    ctx->shutdown(1s);
+}
@@ -0,0 +1,224 @@
+#include <atomic>
+#include <stdexcept>
+#include <string>
+
+#include <doctest.h>
+
+#include <bco/coroutine/pipeline.h>
+
+#include "test_utils.h"
+
+namespace {
+
+using namespace bco::test;
+
+using Numbers = bco::Pipeline<int, int>;
+
+struct Flow {
+    std::atomic<int> pushed { 0 };
+    std::atomic<int> popped { 0 };
+    //most items pushed but not popped yet
+    std::atomic<int> most_ahead { 0 };
+    std::atomic<int> out_of_order { 0 };
+    std::atomic<long> sum { 0 };
+    std::atomic<bool> refused { false };
+    std::atomic<int> failed { 0 };
+};
+
+bco::Routine produce(std::shared_ptr<Numbers> pipeline, int count, Flow* flow)
+{
+    for (int i = 0; i < count; i++) {
+        co_await pipeline->push(i);
+        const int ahead = flow->pushed.fetch_add(1) + 1 - flow->popped.load();
+        int most = flow->most_ahead.load();
+        while (ahead > most && !flow->most_ahead.compare_exchange_weak(most, ahead)) { }
+    }
+    pipeline->close();
+}
+
+bco::Routine consume(std::shared_ptr<Numbers> pipeline, Flow* flow)
+{
+    int expected = 0;
+    while (auto value = co_await pipeline->pop()) {
+        if (*value != expected * 2) {
+            flow->out_of_order++;
+        }
+        flow->sum += *value;
+        flow->popped++;
+        expected++;
+    }
+}
+
+bco::Routine push_after_close(std::shared_ptr<Numbers> pipeline, Flow* flow)
+{
+    pipeline->close();
+    flow->refused = !co_await pipeline->push(1);
+}
+
+//counts the exceptions pop() rethrows, the items must still come in order
+bco::Routine consume_failing(std::shared_ptr<Numbers> pipeline, Flow* flow)
+{
+    int last = -1;
+    while (true) {
+        try {
+            auto value = co_await pipeline->pop();
+            if (!value) {
+                break;
+            }
+            if (*value <= last) {
+                flow->out_of_order++;
+            }
+            last = *value;
+            flow->sum += *value;
+            flow->popped++;
+        } catch (const std::runtime_error&) {
+            flow->failed++;
+        }
+    }
+}
+
+//slows down the items picked by 'slow', after doubling them
+auto doubler(int slow_every, std::chrono::milliseconds delay)
+{
+    return [slow_every, delay](int value) {
+        if (slow_every != 0 && value % slow_every == 7) {
+            std::this_thread::sleep_for(delay);
+        }
+        return value * 2;
+    };
+}
+
+} // namespace
+
+TEST_CASE("ordered pipeline releases items in the order they were pushed")
+{
+    constexpr int kCount = 20000;
+
+    auto ctx = make_context(4);
+    auto pipeline = bco::PipelineBuilder<int>(ctx, 8)
+                        .stage("double", { .parallelism = 4, .capacity = 16, .batch = 4 }, doubler(997, 1ms))
+                        .stage("same", { .parallelism = 3, .capacity = 16, .batch = 8 }, [](int value) { return value; })
+                        .build(bco::Ordering::Preserve);
+    Flow flow;
+    ctx->spawn(&consume, pipeline, &flow);
+    ctx->spawn(&produce, pipeline, kCount, &flow);
+
+    REQUIRE(finished(*ctx, 30s));
+    CHECK(flow.popped == kCount);
+    CHECK(flow.out_of_order == 0);
+    CHECK(flow.sum == long { kCount } * (kCount - 1));
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("ordered pipeline does not run ahead of a slow item past its capacity")
+{
+    constexpr int kCount = 2000;
+    constexpr size_t kCapacity = 16;
+
+    auto ctx = make_context(4);
+    auto pipeline = bco::PipelineBuilder<int>(ctx, 8)
+                        .stage("double", { .parallelism = 4, .capacity = kCapacity, .batch = 1 }, doubler(500, 100ms))
+                        .build(bco::Ordering::Preserve);
+    Flow flow;
+    ctx->spawn(&consume, pipeline, &flow);
+    ctx->spawn(&produce, pipeline, kCount, &flow);
+
+    REQUIRE(finished(*ctx, 30s));
+    CHECK(flow.popped == kCount);
+    CHECK(flow.out_of_order == 0);
+    //the window numbered past the released items, and the released ones waiting for the consumer:
+    //a run of reordered items flushed behind the one in order takes the tail past its capacity
+    CHECK(flow.most_ahead <= static_cast<int>(3 * kCapacity));
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("unordered pipeline delivers every item")
+{
+    constexpr int kCount = 20000;
+
+    auto ctx = make_context(4);
+    auto pipeline = bco::PipelineBuilder<int>(ctx)
+                        .stage("double", { .parallelism = 4, .capacity = 8, .batch = 4 }, doubler(0, 0ms))
+                        .build();
+    Flow flow;
+    ctx->spawn(&consume, pipeline, &flow);
+    ctx->spawn(&produce, pipeline, kCount, &flow);
+
+    REQUIRE(finished(*ctx, 30s));
+    CHECK(flow.popped == kCount);
+    CHECK(flow.sum == long { kCount } * (kCount - 1));
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("pipeline push suspends while the stages are full")
+{
+    auto ctx = make_context(2);
+    std::atomic<bool> open { false };
+    auto pipeline = bco::PipelineBuilder<int>(ctx, 4)
+                        .stage("gate", { .parallelism = 1, .capacity = 4, .batch = 1 }, [&open](int value) {
+                            while (!open) {
+                                std::this_thread::sleep_for(1ms);
+                            }
+                            return value * 2;
+                        })
+                        .build();
+    Flow flow;
+    ctx->spawn(&produce, pipeline, 100, &flow);
+
+    std::this_thread::sleep_for(30ms);
+    //the head queue and the one item the gate holds
+    CHECK(flow.pushed <= 5);
+    open = true;
+    ctx->spawn(&consume, pipeline, &flow);
+    REQUIRE(finished(*ctx));
+    CHECK(flow.pushed == 100);
+    CHECK(flow.popped == 100);
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("pipeline close wakes a waiting pop and refuses pushes")
+{
+    auto ctx = make_context();
+    auto pipeline = bco::PipelineBuilder<int>(ctx)
+                        .stage("double", {}, doubler(0, 0ms))
+                        .build(bco::Ordering::Preserve);
+    Flow flow;
+    ctx->spawn(&consume, pipeline, &flow);
+
+    std::this_thread::sleep_for(10ms);
+    CHECK(ctx->routines_size() == 2);
+    ctx->spawn(&push_after_close, pipeline, &flow);
+    REQUIRE(finished(*ctx));
+    CHECK(flow.refused);
+    CHECK(flow.popped == 0);
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("ordered pipeline drops the item a stage throws on and pop rethrows it")
+{
+    constexpr int kCount = 1000;
+    constexpr int kBad = 13;
+
+    auto ctx = make_context(4);
+    auto pipeline = bco::PipelineBuilder<int>(ctx, 8)
+                        .stage("double", { .parallelism = 4, .capacity = 16, .batch = 4 }, [](int value) {
+                            if (value == kBad) {
+                                throw std::runtime_error("bad item");
+                            }
+                            return value * 2;
+                        })
+                        .stage("same", { .parallelism = 2, .capacity = 16, .batch = 2 }, [](int value) { return value; })
+                        .build(bco::Ordering::Preserve);
+    Flow flow;
+    ctx->spawn(&consume_failing, pipeline, &flow);
+    ctx->spawn(&produce, pipeline, kCount, &flow);
+
+    //the pipeline closes and drains instead of waiting for the lost item
+    REQUIRE(finished(*ctx, 30s));
+    CHECK(flow.failed == 1);
+    CHECK(flow.out_of_order == 0);
+    //everything pushed before it still comes out
+    CHECK(flow.popped >= kBad);
+    CHECK(flow.popped < kCount);
+    ctx->shutdown(1s);
+}
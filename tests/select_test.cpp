@@ -0,0 +1,146 @@
+#include <atomic>
+#include <string>
+
+#include <doctest.h>
+
+#include <bco/coroutine/channel.h>
+
+#include "test_utils.h"
+
+namespace {
+
+using namespace bco::test;
+
+struct Selected {
+    std::atomic<size_t> index { 99 };
+    int number { 0 };
+    std::string text;
+    std::chrono::milliseconds waited { 0 };
+};
+
+bco::Routine select_once(bco::BoundedChannel<int>* numbers, bco::BoundedChannel<std::string>* texts, Selected* out)
+{
+    const auto start = std::chrono::steady_clock::now();
+    auto result = co_await bco::select(numbers->recv_case(), texts->recv_case(), bco::timeout_case(50ms));
+    out->waited = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    if (result.index() == 0) {
+        out->number = std::get<0>(result);
+    } else if (result.index() == 1) {
+        out->text = std::get<1>(result);
+    }
+    out->index = result.index();
+}
+
+bco::Routine send_numbers(bco::BoundedChannel<int>* channel, int from, int count)
+{
+    for (int i = from; i < from + count; i++) {
+        co_await channel->send(i);
+    }
+}
+
+bco::Routine send_texts(bco::BoundedChannel<std::string>* channel, int count)
+{
+    for (int i = 0; i < count; i++) {
+        co_await channel->send(std::string(40, 'x'));
+    }
+}
+
+//selects until 'left' values were taken out of both channels by all selectors together
+bco::Routine select_loop(bco::BoundedChannel<int>* numbers, bco::BoundedChannel<std::string>* texts, std::atomic<int>* left, std::atomic<long>* sum)
+{
+    while (left->load() > 0) {
+        auto result = co_await bco::select(numbers->recv_case(), texts->recv_case(), bco::timeout_case(50ms));
+        if (result.index() == 0) {
+            sum->fetch_add(std::get<0>(result));
+            left->fetch_sub(1);
+        } else if (result.index() == 1) {
+            left->fetch_sub(1);
+        }
+    }
+}
+
+} // namespace
+
+TEST_CASE("select takes one value from the first ready case")
+{
+    auto ctx = make_context();
+    bco::BoundedChannel<int> numbers { 2 };
+    bco::BoundedChannel<std::string> texts { 2 };
+    int number = 7;
+    std::string text = "text";
+    REQUIRE(numbers.try_send(number));
+    REQUIRE(texts.try_send(text));
+    Selected selected;
+    ctx->spawn(&select_once, &numbers, &texts, &selected);
+
+    REQUIRE(finished(*ctx));
+    CHECK(selected.index == 0);
+    CHECK(selected.number == 7);
+    CHECK(numbers.size() == 0);
+    CHECK(texts.size() == 1);
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("select suspends until a case becomes ready")
+{
+    auto ctx = make_context();
+    bco::BoundedChannel<int> numbers { 2 };
+    bco::BoundedChannel<std::string> texts { 2 };
+    Selected selected;
+    ctx->spawn(&select_once, &numbers, &texts, &selected);
+
+    std::this_thread::sleep_for(10ms);
+    CHECK(selected.index == 99);
+    std::string text = "late";
+    REQUIRE(texts.try_send(text));
+    REQUIRE(finished(*ctx));
+    CHECK(selected.index == 1);
+    CHECK(selected.text == "late");
+    CHECK(selected.waited < 50ms);
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("select times out and withdraws from its channels")
+{
+    auto ctx = make_context();
+    bco::BoundedChannel<int> numbers { 2 };
+    bco::BoundedChannel<std::string> texts { 2 };
+    Selected selected;
+    ctx->spawn(&select_once, &numbers, &texts, &selected);
+
+    REQUIRE(finished(*ctx));
+    CHECK(selected.index == 2);
+    CHECK(selected.waited >= 50ms);
+    //nobody waits anymore, the value stays in the channel
+    int number = 3;
+    REQUIRE(numbers.try_send(number));
+    CHECK(numbers.size() == 1);
+    CHECK(numbers.try_recv() == 3);
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("select takes every value exactly once across threads")
+{
+    constexpr int kPerProducer = 20000;
+    constexpr int kNumbers = 2 * kPerProducer;
+    constexpr int kTexts = 1000;
+
+    auto ctx = make_context(4);
+    bco::BoundedChannel<int> numbers { 8 };
+    bco::BoundedChannel<std::string> texts { 4 };
+    std::atomic<int> left { kNumbers + kTexts };
+    std::atomic<long> sum { 0 };
+    ctx->spawn(&select_loop, &numbers, &texts, &left, &sum);
+    ctx->spawn(&select_loop, &numbers, &texts, &left, &sum);
+    ctx->spawn(&select_loop, &numbers, &texts, &left, &sum);
+    ctx->spawn(&send_texts, &texts, kTexts);
+    ctx->spawn(&send_numbers, &numbers, 0, kPerProducer);
+    ctx->spawn(&send_numbers, &numbers, kPerProducer, kPerProducer);
+
+    REQUIRE(finished(*ctx, 30s));
+    CHECK(left == 0);
+    CHECK(sum == long { kNumbers } * (kNumbers - 1) / 2);
+    CHECK(numbers.size() == 0);
+    CHECK(texts.size() == 0);
+    ctx->shutdown(1s);
+}
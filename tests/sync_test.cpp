@@ -0,0 +1,284 @@
+#include <atomic>
+
+#include <doctest.h>
+
+#include <bco/coroutine/sync.h>
+
+#include "test_utils.h"
+
+namespace {
+
+using namespace bco::test;
+
+//tracks how many coroutines are inside a section at once
+struct Section {
+    std::atomic<int> inside { 0 };
+    std::atomic<int> most { 0 };
+    long counter { 0 };
+
+    void enter()
+    {
+        const int now = inside.fetch_add(1) + 1;
+        int most_now = most.load();
+        while (now > most_now && !most.compare_exchange_weak(most_now, now)) { }
+    }
+    void leave() { inside.fetch_sub(1); }
+};
+
+struct Yield {
+    bool await_ready() { return false; }
+    void await_suspend(std::coroutine_handle<> coroutine) { bco::get_current_executor()->post(bco::PriorityTask { bco::Priority::Medium, [coroutine]() { coroutine.resume(); } }); }
+    void await_resume() { }
+};
+
+bco::Routine lock_loop(bco::AsyncMutex* mutex, Section* section, int rounds)
+{
+    for (int i = 0; i < rounds; i++) {
+        auto lock = co_await mutex->scoped_lock();
+        section->enter();
+        section->counter++;
+        if (i % 16 == 0) {
+            co_await Yield {};
+        }
+        section->leave();
+    }
+}
+
+bco::Routine acquire_loop(bco::Semaphore* semaphore, Section* section, int rounds)
+{
+    for (int i = 0; i < rounds; i++) {
+        co_await semaphore->acquire();
+        section->enter();
+        co_await Yield {};
+        section->leave();
+        semaphore->release();
+    }
+}
+
+bco::Routine read_loop(bco::RWLock* lock, Section* readers, Section* writers, std::atomic<int>* errors, int rounds)
+{
+    for (int i = 0; i < rounds; i++) {
+        co_await lock->lock_shared();
+        readers->enter();
+        if (writers->inside != 0) {
+            errors->fetch_add(1);
+        }
+        co_await Yield {};
+        readers->leave();
+        lock->unlock_shared();
+    }
+}
+
+bco::Routine write_loop(bco::RWLock* lock, Section* readers, Section* writers, std::atomic<int>* errors, int rounds)
+{
+    for (int i = 0; i < rounds; i++) {
+        co_await lock->lock();
+        writers->enter();
+        if (readers->inside != 0 || writers->inside != 1) {
+            errors->fetch_add(1);
+        }
+        writers->counter++;
+        writers->leave();
+        lock->unlock();
+    }
+}
+
+template <typename Event>
+bco::Routine wait_event(Event* event, std::atomic<int>* woken)
+{
+    co_await event->wait();
+    woken->fetch_add(1);
+}
+
+bco::Routine arrive_latch(bco::Latch* latch, std::atomic<int>* woken)
+{
+    co_await latch->arrive_and_wait();
+    woken->fetch_add(1);
+}
+
+//every participant checks that all others finished the phase before it goes on
+bco::Routine barrier_loop(bco::Barrier* barrier, std::atomic<int>* phases, int participants, int rounds, std::atomic<int>* errors)
+{
+    for (int i = 0; i < rounds; i++) {
+        phases->fetch_add(1);
+        co_await barrier->arrive_and_wait();
+        if (phases->load() < (i + 1) * participants) {
+            errors->fetch_add(1);
+        }
+        co_await barrier->arrive_and_wait();
+    }
+}
+
+} // namespace
+
+TEST_CASE("AsyncMutex excludes across threads")
+{
+    constexpr int kRoutines = 8;
+    constexpr int kRounds = 2000;
+
+    auto ctx = make_context(4);
+    bco::AsyncMutex mutex;
+    Section section;
+    for (int i = 0; i < kRoutines; i++) {
+        ctx->spawn(&lock_loop, &mutex, &section, kRounds);
+    }
+
+    REQUIRE(finished(*ctx, 30s));
+    CHECK(section.most == 1);
+    CHECK(section.counter == kRoutines * kRounds);
+    CHECK(mutex.try_lock());
+    mutex.unlock();
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("AsyncMutex hands itself to a waiter on unlock")
+{
+    auto ctx = make_context();
+    bco::AsyncMutex mutex;
+    Section section;
+    REQUIRE(mutex.try_lock());
+    ctx->spawn(&lock_loop, &mutex, &section, 1);
+
+    std::this_thread::sleep_for(10ms);
+    CHECK(section.counter == 0);
+    mutex.unlock();
+    REQUIRE(finished(*ctx));
+    CHECK(section.counter == 1);
+    CHECK(mutex.try_lock());
+    mutex.unlock();
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("Semaphore bounds the holders across threads")
+{
+    auto ctx = make_context(4);
+    bco::Semaphore semaphore { 3 };
+    Section section;
+    for (int i = 0; i < 8; i++) {
+        ctx->spawn(&acquire_loop, &semaphore, &section, 500);
+    }
+
+    REQUIRE(finished(*ctx, 30s));
+    CHECK(section.most <= 3);
+    CHECK(section.most >= 1);
+    CHECK(semaphore.available() == 3);
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("Semaphore try_acquire stops at zero")
+{
+    bco::Semaphore semaphore { 2 };
+    CHECK(semaphore.try_acquire());
+    CHECK(semaphore.try_acquire());
+    CHECK(!semaphore.try_acquire());
+    semaphore.release(2);
+    CHECK(semaphore.available() == 2);
+}
+
+TEST_CASE("RWLock shares readers and excludes writers across threads")
+{
+    auto ctx = make_context(4);
+    bco::RWLock lock;
+    Section readers;
+    Section writers;
+    std::atomic<int> errors { 0 };
+    for (int i = 0; i < 6; i++) {
+        ctx->spawn(&read_loop, &lock, &readers, &writers, &errors, 500);
+    }
+    for (int i = 0; i < 2; i++) {
+        ctx->spawn(&write_loop, &lock, &readers, &writers, &errors, 500);
+    }
+
+    REQUIRE(finished(*ctx, 30s));
+    CHECK(errors == 0);
+    CHECK(writers.most == 1);
+    CHECK(writers.counter == 1000);
+    CHECK(lock.try_lock());
+    CHECK(!lock.try_lock_shared());
+    lock.unlock();
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("ManualResetEvent resumes every waiter and stays set")
+{
+    auto ctx = make_context(2);
+    bco::ManualResetEvent event;
+    std::atomic<int> woken { 0 };
+    for (int i = 0; i < 5; i++) {
+        ctx->spawn(&wait_event<bco::ManualResetEvent>, &event, &woken);
+    }
+
+    std::this_thread::sleep_for(10ms);
+    CHECK(woken == 0);
+    event.set();
+    REQUIRE(finished(*ctx));
+    CHECK(woken == 5);
+    ctx->spawn(&wait_event<bco::ManualResetEvent>, &event, &woken);
+    REQUIRE(finished(*ctx));
+    CHECK(woken == 6);
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("AutoResetEvent lets one waiter through per set")
+{
+    auto ctx = make_context(2);
+    bco::AutoResetEvent event;
+    std::atomic<int> woken { 0 };
+    for (int i = 0; i < 3; i++) {
+        ctx->spawn(&wait_event<bco::AutoResetEvent>, &event, &woken);
+    }
+
+    std::this_thread::sleep_for(10ms);
+    event.set();
+    REQUIRE(eventually([&]() { return woken == 1; }));
+    std::this_thread::sleep_for(10ms);
+    CHECK(woken == 1);
+    event.set();
+    event.set();
+    REQUIRE(finished(*ctx));
+    CHECK(woken == 3);
+    //nobody waits, the next wait goes through
+    event.set();
+    ctx->spawn(&wait_event<bco::AutoResetEvent>, &event, &woken);
+    REQUIRE(finished(*ctx));
+    CHECK(woken == 4);
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("Latch opens once counted down to zero")
+{
+    auto ctx = make_context(2);
+    bco::Latch latch { 4 };
+    std::atomic<int> woken { 0 };
+    for (int i = 0; i < 3; i++) {
+        ctx->spawn(&arrive_latch, &latch, &woken);
+    }
+
+    std::this_thread::sleep_for(10ms);
+    CHECK(woken == 0);
+    CHECK(!latch.try_wait());
+    latch.count_down();
+    REQUIRE(finished(*ctx));
+    CHECK(woken == 3);
+    CHECK(latch.try_wait());
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("Barrier completes a phase once all participants arrived")
+{
+    constexpr int kParticipants = 5;
+    constexpr int kRounds = 200;
+
+    auto ctx = make_context(4);
+    bco::Barrier barrier { kParticipants };
+    std::atomic<int> phases { 0 };
+    std::atomic<int> errors { 0 };
+    for (int i = 0; i < kParticipants; i++) {
+        ctx->spawn(&barrier_loop, &barrier, &phases, kParticipants, kRounds, &errors);
+    }
+
+    REQUIRE(finished(*ctx, 30s));
+    CHECK(errors == 0);
+    CHECK(phases == kParticipants * kRounds);
+    ctx->shutdown(1s);
+}
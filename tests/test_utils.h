@@ -0,0 +1,49 @@
+#pragma once
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include <bco/context.h>
+#include <bco/executor/multithread_executor.h>
+#include <bco/executor/simple_executor.h>
+
+namespace bco::test {
+
+using namespace std::chrono_literals;
+
+//a started Context on a SimpleExecutor, or a MultithreadExecutor with 'threads' workers
+inline std::shared_ptr<Context> make_context(uint32_t threads = 0)
+{
+    std::unique_ptr<ExecutorInterface> executor;
+    if (threads == 0) {
+        executor = std::make_unique<SimpleExecutor>();
+    } else {
+        executor = std::make_unique<MultithreadExecutor>(threads);
+    }
+    auto ctx = std::make_shared<Context>(std::move(executor));
+    ctx->start();
+    return ctx;
+}
+
+//polls 'pred' from the test thread, false if it did not hold within 'timeout'
+template <typename Pred>
+bool eventually(Pred pred, std::chrono::milliseconds timeout = 10s)
+{
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!pred()) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(1ms);
+    }
+    return true;
+}
+
+//True once every routine of 'ctx' finished. Spawn them with Context::spawn(F, Args...), the
+//std::function overload only creates the routine once the executor runs it.
+inline bool finished(Context& ctx, std::chrono::milliseconds timeout = 10s)
+{
+    return eventually([&ctx]() { return ctx.routines_size() == 0; }, timeout);
+}
+
+} // namespace bco::test
@@ -0,0 +1,269 @@
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <doctest.h>
+
+#include <bco/cancellation.h>
+#include <bco/coroutine/cofunc.h>
+#include <bco/coroutine/when.h>
+
+#include "test_utils.h"
+
+namespace {
+
+using namespace bco::test;
+
+bco::Func<int> after(int value, std::chrono::milliseconds delay)
+{
+    co_await bco::sleep_for(delay);
+    co_return value;
+}
+
+bco::Func<int> hop(int value)
+{
+    co_await bco::switch_to(bco::get_current_executor());
+    co_return value;
+}
+
+bco::Func<std::unique_ptr<int>> boxed(int value)
+{
+    co_return std::make_unique<int>(value);
+}
+
+bco::Func<> nothing()
+{
+    co_await bco::switch_to(bco::get_current_executor());
+}
+
+bco::Func<int> fail_after(std::chrono::milliseconds delay)
+{
+    co_await bco::sleep_for(delay);
+    throw std::runtime_error("failed");
+}
+
+struct Results {
+    std::atomic<bool> done { false };
+    std::vector<int> values;
+    size_t index { 0 };
+    std::chrono::milliseconds took { 0 };
+    int disposed { 0 };
+    int errors { 0 };
+};
+
+bco::Routine join_tuple(Results* out)
+{
+    const auto start = std::chrono::steady_clock::now();
+    auto [a, b, c, d] = co_await bco::when_all(after(1, 30ms), after(2, 10ms), boxed(3), nothing());
+    out->took = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    out->values = { a, b, *c };
+    out->done = true;
+}
+
+bco::Routine join_range(Results* out, int count)
+{
+    std::vector<bco::Func<int>> funcs;
+    for (int i = 0; i < count; i++) {
+        funcs.push_back(hop(i));
+    }
+    out->values = co_await bco::when_all(std::move(funcs));
+    auto empty = co_await bco::when_all(std::vector<bco::Func<int>> {});
+    if (!empty.empty()) {
+        out->values.clear();
+    }
+    out->done = true;
+}
+
+bco::Routine race(Results* out)
+{
+    const auto start = std::chrono::steady_clock::now();
+    auto result = co_await bco::when_any(after(1, 5s), after(2, 10ms), after(3, 5s));
+    out->took = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    out->index = result.index();
+    out->values = { std::get<1>(result) };
+    out->done = true;
+}
+
+bco::Routine race_disposing(Results* out)
+{
+    std::atomic<int> disposed { 0 };
+    auto dispose = bco::on_loser([&disposed](std::unique_ptr<int>&& value) { disposed += value != nullptr ? 1 : 0; });
+    std::vector<bco::Func<std::unique_ptr<int>>> funcs;
+    for (int i = 0; i < 5; i++) {
+        funcs.push_back(boxed(i));
+    }
+    auto [index, value] = co_await bco::when_any(dispose, std::move(funcs));
+    out->index = index;
+    out->values = { *value };
+    out->disposed = disposed;
+    out->done = true;
+}
+
+bco::Func<int> pair_sum()
+{
+    auto [a, b] = co_await bco::when_all(hop(1), hop(2));
+    co_return a + b;
+}
+
+bco::Routine nested_joins(std::atomic<long>* sum, int rounds)
+{
+    for (int i = 0; i < rounds; i++) {
+        auto [a, b] = co_await bco::when_all(hop(i), pair_sum());
+        auto first = co_await bco::when_any(hop(i), hop(i));
+        *sum += a + b + (first.index() == 0 ? std::get<0>(first) : std::get<1>(first));
+    }
+}
+
+bco::Routine throwing_children(Results* out)
+{
+    const auto start = std::chrono::steady_clock::now();
+    try {
+        co_await bco::when_all(after(1, 30ms), fail_after(0ms), fail_after(10ms));
+    } catch (const std::runtime_error&) {
+        out->errors++;
+    }
+    //rethrown once the slower children finished as well
+    out->took = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    std::vector<bco::Func<int>> funcs;
+    funcs.push_back(hop(1));
+    funcs.push_back(fail_after(1ms));
+    try {
+        co_await bco::when_all(std::move(funcs));
+    } catch (const std::runtime_error&) {
+        out->errors++;
+    }
+    bco::CancellationSource never;
+    try {
+        co_await bco::with_cancellation(never.token(), fail_after(1ms));
+    } catch (const std::runtime_error&) {
+        out->errors++;
+    }
+    out->done = true;
+}
+
+bco::Routine throwing_race(Results* out)
+{
+    const auto start = std::chrono::steady_clock::now();
+    try {
+        co_await bco::when_any(after(1, 5s), fail_after(10ms));
+    } catch (const std::runtime_error&) {
+        out->errors++;
+    }
+    out->took = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    std::vector<bco::Func<int>> funcs;
+    funcs.push_back(fail_after(5ms));
+    funcs.push_back(after(2, 5s));
+    try {
+        co_await bco::when_any(std::move(funcs));
+    } catch (const std::runtime_error&) {
+        out->errors++;
+    }
+    //a loser failing after the winner does not count
+    auto result = co_await bco::when_any(hop(3), fail_after(10ms));
+    out->values = { std::get<0>(result) };
+    out->done = true;
+}
+
+} // namespace
+
+TEST_CASE("when_all joins every awaitable")
+{
+    auto ctx = make_context(2);
+    Results results;
+    ctx->spawn(&join_tuple, &results);
+
+    REQUIRE(finished(*ctx));
+    REQUIRE(results.done);
+    CHECK(results.values == std::vector<int> { 1, 2, 3 });
+    //run concurrently, not one after the other
+    CHECK(results.took >= 30ms);
+    CHECK(results.took < 1s);
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("when_all over a range keeps its order")
+{
+    auto ctx = make_context(2);
+    Results results;
+    ctx->spawn(&join_range, &results, 100);
+
+    REQUIRE(finished(*ctx));
+    REQUIRE(results.done);
+    REQUIRE(results.values.size() == 100);
+    for (int i = 0; i < 100; i++) {
+        CHECK(results.values[i] == i);
+    }
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("when_any returns the first and cancels the others")
+{
+    auto ctx = make_context(2);
+    Results results;
+    ctx->spawn(&race, &results);
+
+    REQUIRE(finished(*ctx));
+    REQUIRE(results.done);
+    CHECK(results.index == 1);
+    CHECK(results.values == std::vector<int> { 2 });
+    //the losers' sleeps were cancelled, they did not hold up the join
+    CHECK(results.took < 1s);
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("when_any hands the results of the losers to the disposer")
+{
+    auto ctx = make_context();
+    Results results;
+    ctx->spawn(&race_disposing, &results);
+
+    REQUIRE(finished(*ctx));
+    REQUIRE(results.done);
+    CHECK(results.values == std::vector<int> { static_cast<int>(results.index) });
+    CHECK(results.disposed == 4);
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("when_all and when_any nest across threads")
+{
+    constexpr int kRoutines = 16;
+    constexpr int kRounds = 500;
+
+    auto ctx = make_context(4);
+    std::atomic<long> sum { 0 };
+    for (int i = 0; i < kRoutines; i++) {
+        ctx->spawn(&nested_joins, &sum, kRounds);
+    }
+
+    REQUIRE(finished(*ctx, 30s));
+    CHECK(sum == long { kRoutines } * (2 * (long { kRounds } * (kRounds - 1) / 2) + 3 * kRounds));
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("when_all rethrows the exception of a child once all of them finished")
+{
+    auto ctx = make_context(2);
+    Results results;
+    ctx->spawn(&throwing_children, &results);
+
+    REQUIRE(finished(*ctx));
+    REQUIRE(results.done);
+    CHECK(results.errors == 3);
+    CHECK(results.took >= 30ms);
+    ctx->shutdown(1s);
+}
+
+TEST_CASE("when_any rethrows an exception which came first and cancels the others")
+{
+    auto ctx = make_context(2);
+    Results results;
+    ctx->spawn(&throwing_race, &results);
+
+    REQUIRE(finished(*ctx));
+    REQUIRE(results.done);
+    CHECK(results.errors == 2);
+    CHECK(results.took < 1s);
+    CHECK(results.values == std::vector<int> { 3 });
+    ctx->shutdown(1s);
+}